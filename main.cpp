@@ -2,19 +2,365 @@
 #include <fstream>
 #include <vector>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <map>
+#include <sstream>
+#include <iterator>
+#include <new>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <random>
 #include <sys/stat.h>
 #include <zlib.h>
+#ifdef use_libdeflate
+#include <libdeflate.h>
+#endif
+#ifdef use_lzma
+#include <lzma.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
 
 #define default_infile "test.bin"
 #define default_atzfile "atztest.atz"
 #define default_reconfile "recon.bin"
+#define read_chunk 1048576//the reader reads the input in pieces of this size
+#define validate_chunk 65536//phase 2 feeds inflate() this much input at a time
+#define zlib_chunk 1073741824//the most zlibPump() gives to a single inflate() or deflate() call
+#define fast_inflate_max 4194304//phase 2 goes back to zlib for streams that inflate to more than this, see inflateBackend
+#define search_queue_len 16//validated streams waiting for the search workers
+#define payload_queue_len 2//inflated payloads waiting to be written
+#define payload_chunk 4194304//phase 4 inflates payloads that do not fit the memory budget in pieces of this size, see -mem-limit
+#define search_overhead 1048576//what a search needs besides its buffers(zlib state, encoders), see searchMemory
+#define cost_backend_ratio 0.85//what the entropy cost model expects the backend compressor to get a payload down to, relative to deflate
+#define estimate_sample 100//default sample size of -estimate
+#define estimate_seed 20160915
+
+bool pipeMode=false;//stdin and stdout carry data, pause() must not read from stdin
 
 void pause(){
+    if (pipeMode) return;
     std::string dummy;
     std::cout << "Press enter to continue...";
     std::getline(std::cin, dummy);
 }
 
+//ATZ2 file layout:
+//  "ATZ" 2, atzlen(8 bytes), origlen(varint), number of recompressed streams(varint)
+//  then a list of sections, each one is a section id(1 byte), the length of the section(varint) and the section data
+//  sections with an unknown id are skipped by the reader
+#define atzsec_table 1//stream table, one record per recompressed stream:
+                      //  offset relative to the end of the previous recompressed stream(varint)
+                      //  streamLength(varint)
+                      //  inflatedLength-streamLength(zigzag varint)
+                      //  clevel(1 byte)
+                      //  clevel 0 (stored): zlib header(2 bytes), number of blocks(varint), block lengths(varint each)
+                      //  otherwise: window(1 byte), memlvl(1 byte), number of diff runs(varint)
+                      //  the zlib strategy is in bits 4-6 of the window byte, they are 0 for Z_DEFAULT_STRATEGY
+                      //  if the window byte has the atz_segments bit set, the segments of the stream(see putSegments) follow the flush points
+                      //  memlvl 0: the stream was made by another encoder than zlib, its id and version(see putEncoder) follow memlvl
+                      //  if clevel has the atz_dict bit set, the number of the preset dictionary of the stream in atzsec_dicts(varint) follows
+                      //  if clevel has the atz_flush bit set, the flush points of the stream follow(see putFlushPoints)
+                      //  if clevel has the atz_nested bit set, the length of the payload(varint) follows,
+                      //  the payload is then an ATZ2 image of the inflated data instead of the inflated data itself(see -depth)
+                      //  if clevel has the atz_shared bit set(archive members only), the position of the payload in the archive(varint) comes last,
+                      //  the payload is not in the payload section then, it belongs to an earlier member
+#define atzsec_diffruns 2//the diff runs of all partial matches in stream order, gap and length(varint each) for every run
+#define atzsec_diffvalues 3//the original values of the bytes in the diff runs, in stream order
+#define atzsec_payload 4//the inflated data of the recompressed streams, in stream order within their group(see atzsec_groups)
+#define atzsec_residue 5//the gaps between the recompressed streams and the streams that were not recompressed
+#define atzsec_index 6//sparse index for random access, written after the residue:
+                      //  interval(varint), a checkpoint is stored for every interval-th recompressed stream, starting with the first one
+                      //  then 6 fixed 8 byte values for every checkpoint: the end of the previous recompressed stream in the original file,
+                      //  and the position of the stream in the table, diff runs, diff values, payload and residue sections
+                      //  the payload position is the one of a payload section in stream order, atzsec_groups has the positions if it is grouped
+#define atzsec_keys 7//archive members only: the content key of every recompressed stream(8 bytes each) in stream order, see streamKey
+#define atzsec_dicts 8//the preset dictionaries of the streams that have one(see -dict): number of dictionaries(varint),
+                      //  then the length(varint) and the data of every dictionary, the section is left out if there are none
+#define atzsec_groups 9//the payload groups(payload_*), the payload section has the payloads of group 0 first, then those of group 1 and so on
+                      //  the number of groups(varint), then the group of every recompressed stream(1 byte each, 0 for a shared payload)
+                      //  and the position of the next payload of every group in the payload section at every index checkpoint(8 bytes each)
+                      //  the section is left out if all the payloads are in one group, the payload section is in stream order then
+#define atzsec_checksums 10//crc32 checksums that tell which part of a damaged file is hit(see -scrub), written last:
+                      //  for every recompressed stream: the length of its record in the table, diff runs and diff values sections(varint each),
+                      //  the crc32 of the record(those three parts in that order) and the crc32 of its payload(4 bytes each, 0 for a shared payload)
+                      //  then the crc32 of the residue from every index checkpoint to the next(4 bytes each, one for the whole residue without streams),
+                      //  the crc32 of the index, dicts, groups and keys sections(4 bytes each, 0 for a section that is left out)
+                      //  and the crc32 of everything before it in this section
+#define atz_index_interval 16
+#define atz_nested 128
+#define atz_shared 64
+#define atz_dict 32
+#define atz_flush 16
+#define atz_segments 128//in the window byte
+
+//payload groups: payloads that look alike go next to each other, so that the compressor that runs on the ATZ file
+//finds matches in text next to text, and the data it can do little with does not get in the way of its models
+#define payload_text 0
+#define payload_binary 1
+#define payload_nested 2//the ATZ images of -depth
+#define payload_dense 3//over payload_dense_bits bits per byte of order-0 entropy, eg. image data or data that was compressed before deflate
+#define payload_groups 4
+#define payload_sample 4096//the group is picked from this many bytes at the start of the payload
+#define payload_dense_bits 7.0
+
+//variable length integers: 7 bits per byte, least significant group first, the high bit is set on every byte except the last
+void putVarint(std::vector<unsigned char>& buf, uint64_t val){
+    while (val>=128){
+        buf.push_back((val&127)|128);
+        val=val>>7;
+    }
+    buf.push_back(val);
+}
+
+int varintLength(uint64_t val){
+    int len=1;
+    while (val>=128){
+        val=val>>7;
+        len++;
+    }
+    return len;
+}
+
+//read a varint that ends before end, returns false if it does not
+bool readVarint(const unsigned char* buf, uint64_t& pos, uint64_t end, uint64_t& val){
+    val=0;
+    int shift=0;
+    do {
+        if ((pos>=end)||(shift>63)) return false;
+        val=val|(static_cast<uint64_t>(buf[pos]&127)<<shift);
+        shift=shift+7;
+        pos++;
+    } while (buf[pos-1]&128);
+    return true;
+}
+
+uint64_t getVarint(const unsigned char* buf, uint64_t& pos, uint64_t end){
+    uint64_t val;
+    if (!readVarint(buf, pos, end, val)){
+        std::cout<<"corrupt ATZ file: varint out of bounds"<<std::endl;
+        pause();
+        abort();
+    }
+    return val;
+}
+
+//zigzag mapping keeps small negative numbers short as varints: 0,-1,1,-2,2... becomes 0,1,2,3,4...
+uint64_t zigzag(int64_t val){
+    return (static_cast<uint64_t>(val)<<1)^static_cast<uint64_t>(val>>63);
+}
+
+int64_t unzigzag(uint64_t val){
+    return static_cast<int64_t>(val>>1)^-static_cast<int64_t>(val&1);
+}
+
+void writeVarint(std::ostream& outfile, uint64_t val){
+    std::vector<unsigned char> buf;
+    putVarint(buf, val);
+    outfile.write(reinterpret_cast<char*>(buf.data()), buf.size());
+}
+
+//write the section id and the section length, the caller writes the data
+void writeSectionHeader(std::ostream& outfile, uint8_t id, uint64_t len){
+    outfile.write(reinterpret_cast<char*>(&id), 1);
+    writeVarint(outfile, len);
+}
+
+//the space a section takes up in the ATZ file, header included
+uint64_t sectionLength(uint64_t len){
+    return 1+varintLength(len)+len;
+}
+
+//crc32 of a buffer of any size, zlib's crc32() takes 32 bit lengths
+uint32_t crcBytes(uint32_t crc, const unsigned char* buf, uint64_t len){
+    for (uint64_t pos=0; pos<len; pos=pos+zlib_chunk){
+        crc=crc32(crc, buf+pos, std::min(len-pos, static_cast<uint64_t>(zlib_chunk)));
+    }
+    return crc;
+}
+
+void putCrc(std::vector<unsigned char>& buf, uint32_t crc){
+    buf.insert(buf.end(), reinterpret_cast<unsigned char*>(&crc), reinterpret_cast<unsigned char*>(&crc)+4);
+}
+
+//comparison kernels used to match recompressed streams against the original
+//equal regions are skipped 64 bytes at a time with AVX2 or 32 bytes at a time with SSE2, 8 bytes at a time otherwise
+
+//the position of the first byte at or after pos where a and b differ, n if there is none
+uint64_t findMismatch(const unsigned char* a, const unsigned char* b, uint64_t pos, uint64_t n){
+    #if defined(__AVX2__)
+    while ((pos+64)<=n){
+        __m256i eq1=_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a+pos)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+pos)));
+        __m256i eq2=_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a+pos+32)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+pos+32)));
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(eq1, eq2)))!=0xFFFFFFFFu){
+            uint32_t m=~static_cast<uint32_t>(_mm256_movemask_epi8(eq1));
+            if (m!=0) return pos+__builtin_ctz(m);
+            return pos+32+__builtin_ctz(~static_cast<uint32_t>(_mm256_movemask_epi8(eq2)));
+        }
+        pos=pos+64;
+    }
+    #elif defined(__SSE2__)
+    while ((pos+32)<=n){
+        __m128i eq1=_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a+pos)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+pos)));
+        __m128i eq2=_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a+pos+16)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+pos+16)));
+        if (_mm_movemask_epi8(_mm_and_si128(eq1, eq2))!=0xFFFF){
+            uint32_t m=(~_mm_movemask_epi8(eq1))&0xFFFF;
+            if (m!=0) return pos+__builtin_ctz(m);
+            return pos+16+__builtin_ctz((~_mm_movemask_epi8(eq2))&0xFFFF);
+        }
+        pos=pos+32;
+    }
+    #endif
+    while ((pos+8)<=n){
+        uint64_t wa, wb;
+        memcpy(&wa, a+pos, 8);
+        memcpy(&wb, b+pos, 8);
+        if (wa!=wb){
+            break;//let the byte loop find it
+        }
+        pos=pos+8;
+    }
+    while ((pos<n)&&(a[pos]==b[pos])){
+        pos++;
+    }
+    return pos;
+}
+
+//the position of the first byte at or after pos where a and b are equal, n if there is none
+//mismatches come in short runs, so this one only goes 16 bytes at a time
+uint64_t findMatch(const unsigned char* a, const unsigned char* b, uint64_t pos, uint64_t n){
+    #if defined(__SSE2__)
+    while ((pos+16)<=n){
+        int m=_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a+pos)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+pos))));
+        if (m!=0) return pos+__builtin_ctz(m);
+        pos=pos+16;
+    }
+    #endif
+    while ((pos<n)&&(a[pos]!=b[pos])){
+        pos++;
+    }
+    return pos;
+}
+
+//the number of positions where a and b are equal
+uint64_t countIdentical(const unsigned char* a, const unsigned char* b, uint64_t n){
+    uint64_t identical=0;
+    uint64_t pos=0;
+    #if defined(__AVX2__)
+    while ((pos+32)<=n){
+        //the byte counters are summed up before they could overflow, every 255 rounds
+        __m256i acc=_mm256_setzero_si256();
+        for (int k=0; (k<255)&&((pos+32)<=n); k++){
+            acc=_mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a+pos)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+pos))));
+            pos=pos+32;
+        }
+        __m256i sum=_mm256_sad_epu8(acc, _mm256_setzero_si256());
+        identical=identical+_mm256_extract_epi64(sum, 0)+_mm256_extract_epi64(sum, 1)+_mm256_extract_epi64(sum, 2)+_mm256_extract_epi64(sum, 3);
+    }
+    #elif defined(__SSE2__)
+    while ((pos+16)<=n){
+        __m128i acc=_mm_setzero_si128();
+        for (int k=0; (k<255)&&((pos+16)<=n); k++){
+            acc=_mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a+pos)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+pos))));
+            pos=pos+16;
+        }
+        __m128i sum=_mm_sad_epu8(acc, _mm_setzero_si128());
+        identical=identical+_mm_cvtsi128_si32(sum)+_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+    }
+    #endif
+    for (; pos<n; pos++){
+        if (a[pos]==b[pos]){
+            identical++;
+        }
+    }
+    return identical;
+}
+
+//adler32 of buf continued from adler, the same value as zlib's adler32()
+//the sums are reduced once every 5536 bytes, the most that can go by without overflowing the 32 bit lanes
+uint32_t adler32Simd(uint32_t adler, const unsigned char* buf, uint64_t len){
+    uint64_t a=adler&0xffff;
+    uint64_t b=adler>>16;
+    while (len>0){
+        uint64_t n=std::min(len, static_cast<uint64_t>(5536));
+        len=len-n;
+        uint64_t pos=0;
+        #if defined(__AVX2__)
+        //b gains 32*a for every block before the weighted sum of the block itself, the a values are collected in prefix
+        __m256i sum=_mm256_setzero_si256();
+        __m256i prefix=_mm256_setzero_si256();
+        __m256i weighted=_mm256_setzero_si256();
+        const __m256i wlo=_mm256_setr_epi16(32, 31, 30, 29, 28, 27, 26, 25, 16, 15, 14, 13, 12, 11, 10, 9);//unpack works in 128 bit lanes
+        const __m256i whi=_mm256_setr_epi16(24, 23, 22, 21, 20, 19, 18, 17, 8, 7, 6, 5, 4, 3, 2, 1);
+        for (; (pos+32)<=n; pos=pos+32){
+            __m256i v=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf+pos));
+            prefix=_mm256_add_epi32(prefix, sum);
+            sum=_mm256_add_epi32(sum, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+            weighted=_mm256_add_epi32(weighted, _mm256_madd_epi16(_mm256_unpacklo_epi8(v, _mm256_setzero_si256()), wlo));
+            weighted=_mm256_add_epi32(weighted, _mm256_madd_epi16(_mm256_unpackhi_epi8(v, _mm256_setzero_si256()), whi));
+        }
+        uint32_t s[8], p[8], w[8];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(s), sum);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), prefix);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(w), weighted);
+        uint64_t bytes=0, prefixes=0, weights=0;
+        for (int k=0; k<8; k++){
+            bytes=bytes+s[k];
+            prefixes=prefixes+p[k];
+            weights=weights+w[k];
+        }
+        b=b+a*pos+32*prefixes+weights;
+        a=a+bytes;
+        #elif defined(__SSE2__)
+        __m128i sum=_mm_setzero_si128();
+        __m128i prefix=_mm_setzero_si128();
+        __m128i weighted=_mm_setzero_si128();
+        const __m128i wlo=_mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+        const __m128i whi=_mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+        for (; (pos+16)<=n; pos=pos+16){
+            __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf+pos));
+            prefix=_mm_add_epi32(prefix, sum);
+            sum=_mm_add_epi32(sum, _mm_sad_epu8(v, _mm_setzero_si128()));
+            weighted=_mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), wlo));
+            weighted=_mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(v, _mm_setzero_si128()), whi));
+        }
+        uint32_t s[4], p[4], w[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s), sum);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), prefix);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(w), weighted);
+        b=b+a*pos+16*(static_cast<uint64_t>(p[0])+p[1]+p[2]+p[3])+w[0]+w[1]+w[2]+w[3];
+        a=a+s[0]+s[1]+s[2]+s[3];
+        #endif
+        for (; pos<n; pos++){
+            a=a+buf[pos];
+            b=b+a;
+        }
+        buf=buf+n;
+        a=a%65521;
+        b=b%65521;
+    }
+    return (b<<16)|a;
+}
+
+//a potential header found by phase 1, packed into 8 bytes since there can be many more of these than streams
+//offset types 1-32 are the zlib headers of zlibHeaders, the types above fdict_types are headers with a preset dictionary(see fdictType)
+#define fdict_types 32
 class fileOffset{
 public:
     fileOffset(){
@@ -26,12 +372,14 @@ public:
         offset=os;
         offsetType=ot;
     }
-    int_fast64_t offset;
-    int offsetType;
-    //int_fast64_t offset;
-    //int_fast64_t offset;
+    uint64_t offset:56;
+    uint64_t offsetType:8;
 };
 
+//the encoders a stream can have been made by, see deflateEncoder
+#define encoder_zlib 0
+#define encoder_libdeflate 1
+#define encoder_count 2
 class streamOffset{
 public:
     streamOffset(){
@@ -49,16 +397,41 @@ public:
         clevel=9;
         window=15;
         memlvl=9;
+        strategy=Z_DEFAULT_STRATEGY;
         identBytes=0;
-        firstDiffByte=-1;
+        diffEnd=0;
         recomp=false;
+        skipped=false;
+        cut=false;
+        streamEntropy=0;
+        payloadEntropy=0;
         atzInfos=0;
+        zlibHeader=0;
+        nestedLength=0;
+        sharedPos=0;
+        dict=0;
+        dictLength=0;
+        dictNumber=0;
+        fullFlush=false;
+        encoder=encoder_zlib;
+        encoderVersion=0;
+        encoderCrc=0;
     }
     ~streamOffset(){
-        diffByteOffsets.clear();
-        diffByteOffsets.shrink_to_fit();
+        diffRunGap.clear();
+        diffRunGap.shrink_to_fit();
+        diffRunLen.clear();
+        diffRunLen.shrink_to_fit();
         diffByteVal.clear();
         diffByteVal.shrink_to_fit();
+        storedBlockLen.clear();
+        storedBlockLen.shrink_to_fit();
+        flushPoints.clear();
+        flushPoints.shrink_to_fit();
+        segmentPoints.clear();
+        segmentPoints.shrink_to_fit();
+        segmentParams.clear();
+        segmentParams.shrink_to_fit();
     }
     uint64_t offset;
     int offsetType;
@@ -67,431 +440,5806 @@ public:
     uint8_t clevel;
     uint8_t window;
     uint8_t memlvl;
+    uint8_t strategy;//the zlib strategy, Z_DEFAULT_STRATEGY for almost every stream
+    uint8_t encoder;//the encoder that reproduces the stream, memlvl is 0 for the ones other than zlib and only clevel counts
+    uint64_t encoderVersion;//the version of that encoder, see deflateEncoder
+    uint32_t encoderCrc;//the crc32 of the original stream, a stream rebuilt by an encoder other than zlib is checked against it
+    const unsigned char* dict;//the preset dictionary of a stream with the FDICT flag, 0 for the others
+    uint64_t dictLength;
+    uint64_t dictNumber;//the number of the dictionary in the atzsec_dicts section+1 for a stream read from an ATZ file, 0 if it has none
+    std::vector<uint64_t> flushPoints;//the offsets in the inflated data where the producer flushed, see deflateFlushed
+    bool fullFlush;//Z_FULL_FLUSH instead of Z_SYNC_FLUSH at the flush points
+    //a stream that changes clevel or strategy on the way(see segmentStream) is split into segments, segment #k starts at segmentPoints[k]
+    //in the inflated data and is compressed with clevel segmentParams[k]&15 and strategy segmentParams[k]>>4, before the first one clevel and strategy apply
+    std::vector<uint64_t> segmentPoints;
+    std::vector<uint8_t> segmentParams;
     int_fast64_t identBytes;
-    int_fast64_t firstDiffByte;//the offset of the first byte that does not match, relative to stream start, not file start
-    std::vector<int_fast64_t> diffByteOffsets;//offsets of bytes that differ, this is an incremental offset list to enhance recompression, kinda like a PNG filter
-    //this improves compression if the mismatching bytes are consecutive, eg. 451,452,453,...(no repetitions, hard to compress)
-    //  transforms into 0, 1, 1, 1,...(repetitive, easy to compress)
+    //the bytes that differ in a partial match are stored as runs, since mismatches usually come in contiguous blocks
+    //run #k starts diffRunGap[k] bytes after the end of run #k-1 (the first run is relative to the stream start, not file start)
+    //and is diffRunLen[k] bytes long, the original values of all the runs are concatenated in diffByteVal
+    //no runs means that the stream is a full match
+    std::vector<uint64_t> diffRunGap;
+    std::vector<uint64_t> diffRunLen;
     std::vector<unsigned char> diffByteVal;
+    uint64_t diffEnd;//the end of the last run, relative to stream start
+    void clearDiff(){
+        diffRunGap.clear();
+        diffRunLen.clear();
+        diffByteVal.clear();
+        diffEnd=0;
+    }
+    //add a run of mismatching bytes, the runs have to be added in increasing order of position
+    void addDiffRun(uint64_t pos, const unsigned char* vals, uint64_t len){
+        if ((diffRunLen.size()>0)&&(pos==diffEnd)){//extend the last run
+            diffRunLen.back()=diffRunLen.back()+len;
+        } else {
+            diffRunGap.push_back(pos-diffEnd);
+            diffRunLen.push_back(len);
+        }
+        diffByteVal.insert(diffByteVal.end(), vals, vals+len);
+        diffEnd=pos+len;
+    }
+    void addDiffByte(uint64_t pos, unsigned char val){
+        addDiffRun(pos, &val, 1);
+    }
+    //the number of bytes the diff takes up in the ATZ file
+    uint64_t diffSize() const{
+        uint64_t sz=varintLength(diffRunLen.size())+diffByteVal.size();
+        for (uint64_t k=0; k<diffRunLen.size(); k++){
+            sz=sz+varintLength(diffRunGap[k])+varintLength(diffRunLen[k]);
+        }
+        return sz;
+    }
+    //compare a recompressed stream to the original and store the mismatching bytes as the diff
+    //if the recompressed stream is shorter, the missing bytes at the end are mismatches too
+    void collectDiff(const unsigned char* recompBuf, uint64_t recompLen, const unsigned char* orig){
+        clearDiff();
+        uint64_t n=(recompLen<streamLength)?recompLen:streamLength;
+        uint64_t pos=findMismatch(recompBuf, orig, 0, n);
+        while (pos<n){
+            uint64_t end=findMatch(recompBuf, orig, pos, n);
+            addDiffRun(pos, orig+pos, end-pos);
+            pos=findMismatch(recompBuf, orig, end, n);
+        }
+        if (n<streamLength){
+            addDiffRun(n, orig+n, streamLength-n);
+        }
+    }
+    //patch the original bytes back into the recompressed stream
+    void applyDiff(unsigned char* buf){
+        uint64_t pos=0;
+        uint64_t valpos=0;
+        for (uint64_t k=0; k<diffRunLen.size(); k++){
+            pos=pos+diffRunGap[k];
+            if ((pos+diffRunLen[k])>streamLength){
+                std::cout<<"corrupt ATZ file: diff run out of bounds"<<std::endl;
+                pause();
+                abort();
+            }
+            memcpy(buf+pos, diffByteVal.data()+valpos, diffRunLen[k]);
+            pos=pos+diffRunLen[k];
+            valpos=valpos+diffRunLen[k];
+        }
+    }
+    //stored streams (clevel 0) are not recompressed with zlib, they are rebuilt from their block lengths instead
+    std::vector<uint16_t> storedBlockLen;
+    uint16_t zlibHeader;//the 2 byte zlib header of a stored stream, eg. 0x7801
     bool recomp;
+    bool skipped;//the parameter search was skipped because the file budget was used up
+    bool cut;//the parameter search was stopped by a budget before it was through
+    uint64_t streamEntropy;//order-0 entropy of the stream and of the inflated data in bytes, measured by the entropy cost model
+    uint64_t payloadEntropy;
     unsigned char* atzInfos;
+    uint64_t nestedLength;//the length of the nested ATZ image in the payload section, 0 if the payload is the inflated data
+    uint64_t sharedPos;//archive members: the position of the payload in the archive if an earlier member has it, 0 if not
+    //the bytes the stream takes up in the payload section
+    uint64_t payloadLength() const{
+        return (nestedLength>0)?nestedLength:inflatedLength;
+    }
 };
 
-int main(int argc, char* argv[]) {
-	using std::cout;
-	using std::endl;
-	using std::cin;
-	using std::vector;
-	uint64_t lastos=0;
-    uint64_t lastlen=0;
-    uint64_t atzlen=0;//placeholder for the length of the atz file
-    std::ofstream outfile;
-    int_fast64_t numGoodOffsets;
-    int_fast64_t identicalBytes;
-    #ifdef debug
-    int_fast64_t numFullmatch=0;
-    #endif // debug
-    int_fast64_t j=0;
-    int memlevel=9;
-    int clevel=9;
-    int window=15;
-    bool fullmatch=false;
-    z_stream strm1;
-    uint64_t recomp=0;
+//order-0 entropy of buf in bytes, the size an ideal order-0 coder would get it down to
+double entropyBytes(const unsigned char* buf, uint64_t len){
+    uint64_t count[256]={0};
+    for (uint64_t k=0; k<len; k++){
+        count[buf[k]]++;
+    }
+    double bits=0;
+    for (int k=0; k<256; k++){
+        if (count[k]>0){
+            bits=bits-count[k]*std::log2(static_cast<double>(count[k])/len);
+        }
+    }
+    return bits/8;
+}
 
-    int recompTresh=128;//streams are only recompressed if the best match differs from the original in <= recompTresh bytes
-    int sizediffTresh=128;//streams are only compared when the size difference is <= sizediffTresh
-    //DO NOT turn off slowmode, the alternative code (optimized mode) does not work at all
-    bool slowmode=true;//slowmode bruteforces the zlib parameters, optimized mode only tries probable parameters based on the 2-byte header
-    int_fast64_t concentrate=-404;//only try to recompress the stream# givel here, -1 disables this and runs on all streams
+//the bytes a recompressed stream takes up in the ATZ file besides its payload and diff: the table record and its share of the index
+uint64_t recordLength(const streamOffset& so){
+    uint64_t len=varintLength(so.offset)+varintLength(so.streamLength)+varintLength(zigzag(so.inflatedLength-so.streamLength))+3+48/atz_index_interval;
+    if (so.clevel==0){
+        len=len+2;
+        for (uint64_t k=0; k<so.storedBlockLen.size(); k++){
+            len=len+varintLength(so.storedBlockLen[k]);
+        }
+    }
+    if (so.dict!=0){//the number of the dictionary, the dictionary itself is shared
+        len=len+1;
+    }
+    if ((so.clevel!=0)&&(so.memlvl==0)){
+        len=len+1+varintLength(so.encoderVersion)+4;
+    }
+    if (!so.flushPoints.empty()){
+        len=len+varintLength(so.flushPoints.size()<<1);
+    }
+    uint64_t last=0;
+    for (uint64_t k=0; k<so.flushPoints.size(); k++){
+        len=len+varintLength(so.flushPoints[k]-last);
+        last=so.flushPoints[k];
+    }
+    if (!so.segmentPoints.empty()){
+        len=len+varintLength(so.segmentPoints.size())+so.segmentPoints.size();
+    }
+    last=0;
+    for (uint64_t k=0; k<so.segmentPoints.size(); k++){
+        len=len+varintLength(so.segmentPoints[k]-last);
+        last=so.segmentPoints[k];
+    }
+    return len;
+}
 
-    int_fast64_t lastGoodOffset=0;
-    int_fast64_t lastStreamLength=0;
-    int_fast64_t memScale=1;
-	int_fast64_t numOffsets=0;
-	int ret=-9;
-	vector<streamOffset> streamOffsetList;
-	z_stream strm;
-    #ifdef debug
-	int_fast64_t dataErrors=0;
-    int_fast64_t numDecomp32k=0;
-    int_fast64_t numDecomp16k=0;
-    int_fast64_t numDecomp8k=0;
-    int_fast64_t numDecomp4k=0;
-    int_fast64_t numDecomp2k=0;
-    int_fast64_t numDecomp1k=0;
-    uint_fast64_t type1=0;
-    uint_fast64_t type2=0;
-    uint_fast64_t type3=0;
-    uint_fast64_t type4=0;
-    #endif // debug
+//cost models decide which streams are worth recompressing, selected with -cost
+//the search asks the model how big a diff can get before a stream is not worth it anymore, and stops comparing streams that are further off
+class costModel{
+public:
+    virtual ~costModel(){}
+    //look at a stream and its inflated data before the search, the model may keep what it finds in so
+    virtual void measure(streamOffset& so, const unsigned char* orig, const unsigned char* payload) const=0;
+    //the largest diff that would still be worth it, negative if not even a full match would be
+    virtual int64_t maxDiff(const streamOffset& so) const=0;
+    //decide after the search
+    virtual bool recompress(const streamOffset& so) const=0;
+    //the model and its parameters for the journal key(see searchJournal), a search result only holds for the same settings
+    virtual void putSettings(std::vector<unsigned char>& buf) const=0;
+};
 
-    #ifdef debug
-	uint_fast64_t nMatch1=0;
-	uint_fast64_t nMatch2=0;
-	uint_fast64_t nMatch3=0;
-	uint_fast64_t nMatch4=0;
-	uint_fast64_t nMatch5=0;
-	uint_fast64_t nMatch6=0;
-	#endif
-	//offsetList stores memory offsets where potential headers can be found, and the type of the offset
-	vector<fileOffset> offsetList;
-	int_fast64_t i;
-	unsigned char* rBuffer;
-	std::ifstream infile;
+//the default: any stream with a diff of at most recompTresh bytes is recompressed
+class thresholdCostModel: public costModel{
+public:
+    thresholdCostModel(int t){
+        recompTresh=t;
+    }
+    int recompTresh;
+    void measure(streamOffset&, const unsigned char*, const unsigned char*) const{}
+    int64_t maxDiff(const streamOffset&) const{
+        return recompTresh;
+    }
+    bool recompress(const streamOffset& so) const{
+        return (so.diffSize()<=static_cast<uint64_t>(recompTresh))&&(so.identBytes>0);
+    }
+    void putSettings(std::vector<unsigned char>& buf) const{
+        buf.push_back(1);
+        putVarint(buf, recompTresh);
+    }
+};
 
-	//PHASE 0
-	//opening file
-	/*for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << std::endl;
-    }*/
-	uint64_t infileSize;
-	char* infile_name;
-	char* reconfile_name;
-	char* atzfile_name;
-	if (argc>=2){// if we get at least one string use it as input file name
-        cout<<"Input file: "<<argv[1]<<endl;
-        if (argc>=3){//if we get at least two strings use the second as a parameter
-            if (strcmp(argv[2], "-r")==0){//if we get -r, treat the file as an ATZ file and skip to reconstruction
-                atzfile_name=argv[1];
+//-cost entropy: weigh what the stream costs after the backend compressor against what its payload, diff and record would cost
+//the backend gets deflate data down to about its order-0 entropy, and the payload down to backendRatio times the stream,
+//or to its own order-0 entropy if that is less(eg. sparse data that deflate compressed poorly)
+//rebuilding a stream costs cpuCost bytes per MB of payload(-cost-cpu), so that slow streams with little gain can be left alone
+//stored streams are always recompressed, they cost nothing to rebuild
+class entropyCostModel: public costModel{
+public:
+    entropyCostModel(double r, double c){
+        backendRatio=r;
+        cpuCost=c;
+    }
+    double backendRatio;
+    double cpuCost;
+    void measure(streamOffset& so, const unsigned char* orig, const unsigned char* payload) const{
+        so.streamEntropy=entropyBytes(orig, so.streamLength);
+        so.payloadEntropy=entropyBytes(payload, so.inflatedLength);
+    }
+    //the gain with a full match
+    double benefit(const streamOffset& so) const{
+        double payload=std::min(backendRatio*so.streamLength, static_cast<double>(so.payloadEntropy));
+        return so.streamEntropy-payload-recordLength(so)-cpuCost*so.inflatedLength/1048576;
+    }
+    int64_t maxDiff(const streamOffset& so) const{
+        return static_cast<int64_t>(std::floor(benefit(so)));
+    }
+    bool recompress(const streamOffset& so) const{
+        if (so.identBytes<=0) return false;
+        if (so.clevel==0) return true;
+        //the diff values are charged their order-0 entropy, the runs are mostly incompressible
+        double diff=so.diffSize()-so.diffByteVal.size()+entropyBytes(so.diffByteVal.data(), so.diffByteVal.size());
+        return (benefit(so)-diff)>0;
+    }
+    void putSettings(std::vector<unsigned char>& buf) const{
+        buf.push_back(2);
+        buf.insert(buf.end(), reinterpret_cast<const unsigned char*>(&backendRatio), reinterpret_cast<const unsigned char*>(&backendRatio)+8);
+        buf.insert(buf.end(), reinterpret_cast<const unsigned char*>(&cpuCost), reinterpret_cast<const unsigned char*>(&cpuCost)+8);
+    }
+};
 
-                reconfile_name= new char[strlen(argv[1])+5];
-                memset(reconfile_name, 0, (strlen(argv[1])+5));//null out the entire string
-                strcpy(reconfile_name, argv[1]);
-                reconfile_name=strcat(reconfile_name, ".rec");
-                cout<<"assuming input file is an ATZ file, attempting to reconstruct"<<endl;
-                cout<<"overwriting "<<reconfile_name<<" if present"<<endl;
-                goto PHASE5;
-            }else{//if the third stig is not a valid parameter then ignore it
-                infile_name=argv[1];
-                atzfile_name= new char[strlen(argv[1])+5];
-                memset(atzfile_name, 0, (strlen(argv[1])+5));//null out the entire string
-                strcpy(atzfile_name, argv[1]);
-                atzfile_name=strcat(atzfile_name, ".atz");
+//a stream with memlvl 0 was made by another encoder than zlib, the memlvl byte is followed by this in the stream table, the journal and the ATZ file:
+//  encoder id(1 byte), encoder version(varint), crc32 of the original stream(4 bytes)
+//the version is the one the encoder was built against, a shared library can be swapped for one with other output under it,
+//so the rebuilt stream is checked against the crc32
+void putEncoder(std::vector<unsigned char>& buf, const streamOffset& so){
+    buf.push_back(so.encoder);
+    putVarint(buf, so.encoderVersion);
+    putCrc(buf, so.encoderCrc);
+}
 
-                reconfile_name= new char[strlen(argv[1])+5];
-                memset(reconfile_name, 0, (strlen(argv[1])+5));//null out the entire string
-                strcpy(reconfile_name, argv[1]);
-                reconfile_name=strcat(reconfile_name, ".rec");
-                cout<<"overwriting "<<atzfile_name<<" and "<<reconfile_name<<" if present"<<endl;
-            }
-        }else{//if we get only the filename go forward to creating an ATZ file from it
-            infile_name=argv[1];
-            atzfile_name= new char[strlen(argv[1])+5];
-            memset(atzfile_name, 0, (strlen(argv[1])+5));//null out the entire string
-            strcpy(atzfile_name, argv[1]);
-            atzfile_name=strcat(atzfile_name, ".atz");
+//the read* functions return false on bad data, the get* ones are for ATZ files and abort
+bool readEncoder(const unsigned char* buf, uint64_t& pos, uint64_t end, streamOffset& so){
+    if ((pos>=end)||(buf[pos]>=encoder_count)||(buf[pos]==encoder_zlib)) return false;
+    so.encoder=buf[pos];
+    pos++;
+    if ((!readVarint(buf, pos, end, so.encoderVersion))||((end-pos)<4)) return false;
+    memcpy(&so.encoderCrc, buf+pos, 4);
+    pos=pos+4;
+    return true;
+}
 
-            reconfile_name= new char[strlen(argv[1])+5];
-            memset(reconfile_name, 0, (strlen(argv[1])+5));//null out the entire string
-            strcpy(reconfile_name, argv[1]);
-            reconfile_name=strcat(reconfile_name, ".rec");
-            cout<<"overwriting "<<atzfile_name<<" and "<<reconfile_name<<" if present"<<endl;
-        }
-	}else{//if we get nothing from the CLI
-        cout<<"no input specified, trying to open test.bin"<<endl;
-        infile_name= new char[9];
-        infile_name=default_infile;
-        cout<<"overwriting atztest.atz and recon.bin if present"<<endl;
-        atzfile_name= new char[12];
-        atzfile_name=default_atzfile;
-        reconfile_name= new char[10];
-        reconfile_name=default_reconfile;
-	}
+void getEncoder(const unsigned char* buf, uint64_t& pos, uint64_t end, streamOffset& so){
+    if (!readEncoder(buf, pos, end, so)){
+        std::cout<<"corrupt ATZ file: unknown encoder"<<std::endl;
+        pause();
+        abort();
+    }
+}
 
-	infile.open(infile_name, std::ios::in | std::ios::binary);
-	if (!infile.is_open()) {
-       cout << "error: open file for input failed!" << endl;
-       pause();
- 	   abort();
-	}
-	//getting the size of the file
-	struct stat statresults;
-    if (stat(infile_name, &statresults) == 0){
-    	cout<<"Input size:"<<statresults.st_size<<endl;
+//the flush points of a stream in the stream table, the journal and the ATZ file:
+//  number of flush points*2, +1 for Z_FULL_FLUSH(varint), then every flush point relative to the one before(varint each)
+void putFlushPoints(std::vector<unsigned char>& buf, const streamOffset& so){
+    putVarint(buf, (so.flushPoints.size()<<1)|(so.fullFlush?1:0));
+    uint64_t last=0;
+    for (uint64_t k=0; k<so.flushPoints.size(); k++){
+        putVarint(buf, so.flushPoints[k]-last);
+        last=so.flushPoints[k];
     }
-    else{
-    	cout<<"Error determining file size."<<endl;
-    	pause();
-    	abort();
+}
+
+bool readFlushPoints(const unsigned char* buf, uint64_t& pos, uint64_t end, streamOffset& so){
+    uint64_t n;
+    if (!readVarint(buf, pos, end, n)) return false;
+    so.fullFlush=n&1;
+    n=n>>1;
+    if (n>(end-pos)) return false;//every flush point takes at least a byte
+    so.flushPoints.clear();
+    uint64_t last=0;
+    for (uint64_t k=0; k<n; k++){
+        uint64_t delta;
+        if (!readVarint(buf, pos, end, delta)) return false;
+        last=last+delta;
+        so.flushPoints.push_back(last);
     }
-    infileSize=statresults.st_size;
-    //setting up read buffer and reading the entire file into the buffer
-    rBuffer = new unsigned char[infileSize];
-    infile.read(reinterpret_cast<char*>(rBuffer), infileSize);
-    infile.close();
+    return true;
+}
 
-    //PHASE 1
-	//search the file for zlib headers, count them and create an offset list
+void getFlushPoints(const unsigned char* buf, uint64_t& pos, uint64_t end, streamOffset& so){
+    if (!readFlushPoints(buf, pos, end, so)){
+        std::cout<<"corrupt ATZ file: bad flush points"<<std::endl;
+        pause();
+        abort();
+    }
+}
 
-	//try to guess the number of potential zlib headers in the file from the file size
-	//this value is purely empirical, may need tweaking
-	offsetList.reserve(static_cast<int_fast64_t>(infileSize/1912));
-	#ifdef debug
-	cout<<"Offset list initial capacity:"<<offsetList.capacity()<<endl;
-	pause();
-	#endif
-	cout<<endl;
-	for(i=0;i<infileSize;i++){
-        switch(rBuffer[i]){
-            case 120://hex 78
-            {
-                switch(rBuffer[i+1]){
-                    case 1:{//hex 78 01
-                        #ifdef debug
-                        nMatch1++;
-                        cout<<"Found zlib header(78 01) with 32K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 1));
-                        break;
-                    }
-                    case 94:{//hex 78 5E
-                        #ifdef debug
-                        nMatch1++;
-                        cout<<"Found zlib header(78 5E) with 32K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 2));
-                        break;
-                    }
-                    case 156:{//hex 78 9C
-                        #ifdef debug
-                        nMatch1++;
-                        cout<<"Found zlib header(78 9C) with 32K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 3));
-                        break;
-                    }
-                    case 218:{//hex 78 DA
-                        #ifdef debug
-                        nMatch1++;
-                        cout<<"Found zlib header(78 DA) with 32K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 4));
-                        break;
-                    }
-                }
-                break;
-            }
-            case 104://hex 68
-            {
-                switch(rBuffer[i+1]){
-                    case 222:{//hex 68 DE
-                        #ifdef debug
-                        nMatch2++;
-                        cout<<"Found zlib header(68 DE) with 16K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 5));
-                        break;
-                    }
-                    case 129:{//hex 68 81
-                        #ifdef debug
-                        nMatch2++;
-                        cout<<"Found zlib header(68 81) with 16K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 6));
-                        break;
-                    }
-                    case 67:{//hex 68 43
-                        #ifdef debug
-                        nMatch2++;
-                        cout<<"Found zlib header(68 43) with 16K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 7));
-                        break;
-                    }
-                    case 5:{//hex 68 05
-                        #ifdef debug
-                        nMatch2++;
-                        cout<<"Found zlib header(68 05) with 16K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 8));
-                        break;
-                    }
+//the segments of a stream in the stream table, the journal and the ATZ file:
+//  number of segments(varint), then for every segment its start relative to the one before(varint) and clevel|strategy<<4(1 byte)
+void putSegments(std::vector<unsigned char>& buf, const streamOffset& so){
+    putVarint(buf, so.segmentPoints.size());
+    uint64_t last=0;
+    for (uint64_t k=0; k<so.segmentPoints.size(); k++){
+        putVarint(buf, so.segmentPoints[k]-last);
+        buf.push_back(so.segmentParams[k]);
+        last=so.segmentPoints[k];
+    }
+}
+
+bool readSegments(const unsigned char* buf, uint64_t& pos, uint64_t end, streamOffset& so){
+    uint64_t n;
+    if (!readVarint(buf, pos, end, n)) return false;
+    if (n>((end-pos)/2)) return false;//every segment takes at least 2 bytes
+    so.segmentPoints.clear();
+    so.segmentParams.clear();
+    uint64_t last=0;
+    for (uint64_t k=0; k<n; k++){
+        uint64_t delta;
+        if (!readVarint(buf, pos, end, delta)) return false;
+        last=last+delta;
+        if ((pos>=end)||((buf[pos]&15)>9)||((buf[pos]>>4)>Z_FIXED)) return false;
+        so.segmentPoints.push_back(last);
+        so.segmentParams.push_back(buf[pos]);
+        pos++;
+    }
+    return true;
+}
+
+void getSegments(const unsigned char* buf, uint64_t& pos, uint64_t end, streamOffset& so){
+    if (!readSegments(buf, pos, end, so)){
+        std::cout<<"corrupt ATZ file: bad segments"<<std::endl;
+        pause();
+        abort();
+    }
+}
+
+//the streams found by phase 2 and what phase 3 found out about them, as a struct of arrays
+//inputs like git packfiles or big jar collections have millions of small streams, and a streamOffset per stream costs
+//hundreds of bytes, so here every stream only takes the fixed size fields in parallel arrays(37 bytes),
+//and the diff or stored block lengths of a recompressed stream are serialized into one shared arena, in the encoding of the ATZ stream table:
+//  clevel 0 (stored): zlib header(2 bytes), number of blocks(varint), block lengths(varint each)
+//  otherwise: the encoder(see putEncoder) if memlvl is 0, number of diff runs(varint), gap and length of the runs(varint each), diff values,
+//  then the flush points(see putFlushPoints) and the segments(see putSegments)
+//phase 2 adds streams while the search workers store their results, so add() and store() take the lock
+#define table_recomp 2048//flags in params, above clevel(bits 0-3), memlvl(bits 4-7) and window-8(bits 8-10)
+#define table_skipped 4096//the strategy is in bits 13-15
+#define table_cut 65536//above the strategy
+class streamTable{
+public:
+    std::vector<uint64_t> offset;
+    std::vector<uint64_t> streamLength;
+    std::vector<uint64_t> inflatedLength;
+    std::vector<uint64_t> arenaPos;//where the diff of a recompressed stream starts in the arena
+    std::vector<uint32_t> params;
+    std::vector<uint8_t> offsetType;
+    std::vector<unsigned char> arena;
+    std::map<uint64_t, const std::vector<unsigned char>*> dicts;//the preset dictionaries of the few streams that have one, see dictionaryFinder
+    std::mutex lock;
+    uint64_t size() const{
+        return offset.size();
+    }
+    bool recomp(uint64_t j) const{
+        return params[j]&table_recomp;
+    }
+    bool skipped(uint64_t j) const{
+        return params[j]&table_skipped;
+    }
+    bool cut(uint64_t j) const{
+        return params[j]&table_cut;
+    }
+    uint64_t add(uint64_t os, int ot, uint64_t sl, uint64_t il){
+        std::lock_guard<std::mutex> l(lock);
+        offset.push_back(os);
+        offsetType.push_back(ot);
+        streamLength.push_back(sl);
+        inflatedLength.push_back(il);
+        arenaPos.push_back(0);
+        params.push_back(0);
+        return offset.size()-1;
+    }
+    //keep the search result of stream #j, the diff is only kept if the stream is going to be recompressed
+    void store(uint64_t j, const streamOffset& so){
+        std::lock_guard<std::mutex> l(lock);
+        params[j]=so.clevel|(so.memlvl<<4)|((so.window-8)<<8)|(so.recomp?table_recomp:0)|(so.skipped?table_skipped:0)|(so.strategy<<13)|(so.cut?table_cut:0);
+        if (!so.recomp) return;
+        arenaPos[j]=arena.size();
+        if (so.clevel==0){
+            arena.push_back(so.zlibHeader>>8);
+            arena.push_back(so.zlibHeader&255);
+            putVarint(arena, so.storedBlockLen.size());
+            for (uint64_t k=0; k<so.storedBlockLen.size(); k++){
+                putVarint(arena, so.storedBlockLen[k]);
+            }
+        } else {
+            if (so.memlvl==0){
+                putEncoder(arena, so);
+            }
+            putVarint(arena, so.diffRunLen.size());
+            for (uint64_t k=0; k<so.diffRunLen.size(); k++){
+                putVarint(arena, so.diffRunGap[k]);
+                putVarint(arena, so.diffRunLen[k]);
+            }
+            arena.insert(arena.end(), so.diffByteVal.begin(), so.diffByteVal.end());
+            putFlushPoints(arena, so);
+            putSegments(arena, so);
+        }
+    }
+    //phase 2 sets the dictionary before the stream is searched, the dictionary has to outlive the table
+    void setDictionary(uint64_t j, const std::vector<unsigned char>* dict){
+        std::lock_guard<std::mutex> l(lock);
+        dicts[j]=dict;
+    }
+    //unpack stream #j into a streamOffset for the stages that work on one stream at a time
+    streamOffset get(uint64_t j) const{
+        streamOffset so(offset[j], offsetType[j], streamLength[j], inflatedLength[j]);
+        if (!dicts.empty()){
+            std::map<uint64_t, const std::vector<unsigned char>*>::const_iterator it=dicts.find(j);
+            if (it!=dicts.end()){
+                so.dict=it->second->data();
+                so.dictLength=it->second->size();
+            }
+        }
+        so.clevel=params[j]&15;
+        so.memlvl=(params[j]>>4)&15;
+        so.window=((params[j]>>8)&7)+8;
+        so.strategy=(params[j]>>13)&7;
+        so.recomp=recomp(j);
+        so.skipped=skipped(j);
+        so.cut=cut(j);
+        if (!so.recomp) return so;
+        uint64_t pos=arenaPos[j];
+        if (so.clevel==0){
+            so.zlibHeader=(arena[pos]<<8)|arena[pos+1];
+            pos=pos+2;
+            uint64_t nblocks=getVarint(arena.data(), pos, arena.size());
+            for (uint64_t k=0; k<nblocks; k++){
+                so.storedBlockLen.push_back(getVarint(arena.data(), pos, arena.size()));
+            }
+            so.identBytes=so.streamLength;
+        } else {
+            if (so.memlvl==0){
+                getEncoder(arena.data(), pos, arena.size(), so);
+            }
+            uint64_t nruns=getVarint(arena.data(), pos, arena.size());
+            std::vector<uint64_t> gap(nruns);
+            std::vector<uint64_t> runlen(nruns);
+            uint64_t nvals=0;
+            for (uint64_t k=0; k<nruns; k++){
+                gap[k]=getVarint(arena.data(), pos, arena.size());
+                runlen[k]=getVarint(arena.data(), pos, arena.size());
+                nvals=nvals+runlen[k];
+            }
+            uint64_t runpos=0;
+            for (uint64_t k=0; k<nruns; k++){
+                runpos=runpos+gap[k];
+                so.addDiffRun(runpos, arena.data()+pos, runlen[k]);
+                pos=pos+runlen[k];
+                runpos=runpos+runlen[k];
+            }
+            so.identBytes=so.streamLength-nvals;
+            getFlushPoints(arena.data(), pos, arena.size(), so);
+            getSegments(arena.data(), pos, arena.size(), so);
+        }
+        return so;
+    }
+    void swap(streamTable& other){
+        offset.swap(other.offset);
+        streamLength.swap(other.streamLength);
+        inflatedLength.swap(other.inflatedLength);
+        arenaPos.swap(other.arenaPos);
+        params.swap(other.params);
+        offsetType.swap(other.offsetType);
+        arena.swap(other.arena);
+        dicts.swap(other.dicts);
+    }
+    void clear(){
+        streamTable empty;
+        swap(empty);
+    }
+    //the memory the table takes up, including what the vectors have reserved
+    uint64_t memoryUsage() const{
+        return (offset.capacity()+streamLength.capacity()+inflatedLength.capacity()+arenaPos.capacity())*8+params.capacity()*4+offsetType.capacity()+arena.capacity();
+    }
+};
+
+//run inflate() or deflate() over whole buffers of any size
+//zlib takes 32 bit lengths per call(and total_in/total_out are 32 bits on some platforms),
+//so the buffers are fed and drained zlib_chunk bytes at a time, and inUsed/outUsed count the bytes consumed and produced in 64 bits
+//returns Z_STREAM_END on success, Z_BUF_ERROR if out is full or in ended before the end of the stream, or any other zlib error
+int zlibPump(z_stream& strm, bool compress, const unsigned char* in, uint64_t inLen, unsigned char* out, uint64_t outLen, uint64_t& inUsed, uint64_t& outUsed){
+    int ret;
+    inUsed=0;
+    outUsed=0;
+    do {
+        uInt inChunk=std::min(inLen-inUsed, static_cast<uint64_t>(zlib_chunk));
+        uInt outChunk=std::min(outLen-outUsed, static_cast<uint64_t>(zlib_chunk));
+        strm.next_in=const_cast<unsigned char*>(in)+inUsed;
+        strm.avail_in=inChunk;
+        strm.next_out=out+outUsed;
+        strm.avail_out=outChunk;
+        //deflate() may only be told to finish once it has been given all the input
+        int flush=((inLen-inUsed)==inChunk)?Z_FINISH:Z_NO_FLUSH;
+        if (compress){
+            ret=deflate(&strm, flush);
+        } else {
+            ret=inflate(&strm, flush);
+        }
+        inUsed=inUsed+(inChunk-strm.avail_in);
+        outUsed=outUsed+(outChunk-strm.avail_out);
+        if ((ret==Z_OK)||(ret==Z_BUF_ERROR)){
+            if ((outUsed==outLen)||((inUsed==inLen)&&(!compress))||((inChunk==strm.avail_in)&&(outChunk==strm.avail_out))){
+                return Z_BUF_ERROR;//no room left, no input left or no progress
+            }
+            ret=Z_OK;
+        }
+    } while (ret==Z_OK);
+    return ret;
+}
+
+//deflate() a whole buffer like zlibPump, but flush at every flush point of so the way a streaming producer did,
+//and change clevel and strategy with deflateParams() at every segment point, a flush goes first if both are at the same offset
+//a flush is done when deflate() leaves some output space, or when it returns Z_BUF_ERROR because there was nothing left to flush
+int deflateFlushed(z_stream& strm, const unsigned char* in, uint64_t inLen, const streamOffset& so,
+                   unsigned char* out, uint64_t outLen, uint64_t& inUsed, uint64_t& outUsed){
+    if (so.flushPoints.empty()&&so.segmentPoints.empty()){
+        return zlibPump(strm, true, in, inLen, out, outLen, inUsed, outUsed);
+    }
+    if (((!so.flushPoints.empty())&&(so.flushPoints.back()>inLen))||((!so.segmentPoints.empty())&&(so.segmentPoints.back()>inLen))){
+        return Z_DATA_ERROR;//only a corrupt ATZ file can have points past the end
+    }
+    int ret=Z_OK;
+    inUsed=0;
+    outUsed=0;
+    uint64_t f=0;
+    uint64_t s=0;
+    while (true){
+        //the next offset where something has to be done
+        uint64_t end=inLen;
+        if (f<so.flushPoints.size()) end=std::min(end, so.flushPoints[f]);
+        if (s<so.segmentPoints.size()) end=std::min(end, so.segmentPoints[s]);
+        if (end<inUsed){
+            return Z_DATA_ERROR;//the points are out of order, only a corrupt ATZ file can have that
+        }
+        bool flushHere=(f<so.flushPoints.size())&&(so.flushPoints[f]==end);
+        bool paramsHere=(s<so.segmentPoints.size())&&(so.segmentPoints[s]==end);
+        int segmentFlush=flushHere?(so.fullFlush?Z_FULL_FLUSH:Z_SYNC_FLUSH):(paramsHere?Z_NO_FLUSH:Z_FINISH);
+        while (true){
+            uInt inChunk=std::min(end-inUsed, static_cast<uint64_t>(zlib_chunk));
+            uInt outChunk=std::min(outLen-outUsed, static_cast<uint64_t>(zlib_chunk));
+            strm.next_in=const_cast<unsigned char*>(in)+inUsed;
+            strm.avail_in=inChunk;
+            strm.next_out=out+outUsed;
+            strm.avail_out=outChunk;
+            int flush=((end-inUsed)==inChunk)?segmentFlush:Z_NO_FLUSH;
+            ret=deflate(&strm, flush);
+            inUsed=inUsed+(inChunk-strm.avail_in);
+            outUsed=outUsed+(outChunk-strm.avail_out);
+            if (ret==Z_STREAM_END){
+                return ret;
+            }
+            if ((ret!=Z_OK)&&(ret!=Z_BUF_ERROR)){
+                return ret;
+            }
+            if ((flush!=Z_FINISH)&&(inUsed==end)&&((strm.avail_out>0)||(ret==Z_BUF_ERROR))){
+                break;//this flush is done, or all the input of the segment is in
+            }
+            if ((outUsed==outLen)||((inChunk==strm.avail_in)&&(outChunk==strm.avail_out))){
+                return Z_BUF_ERROR;//no room left or no progress
+            }
+        }
+        if (flushHere){
+            f++;
+        }
+        if (paramsHere){
+            //deflateParams() ends the current block if the compression function or the strategy changes, it needs output space for that
+            uInt outChunk=std::min(outLen-outUsed, static_cast<uint64_t>(zlib_chunk));
+            strm.next_in=const_cast<unsigned char*>(in)+inUsed;
+            strm.avail_in=0;
+            strm.next_out=out+outUsed;
+            strm.avail_out=outChunk;
+            ret=deflateParams(&strm, so.segmentParams[s]&15, so.segmentParams[s]>>4);
+            outUsed=outUsed+(outChunk-strm.avail_out);
+            if (ret!=Z_OK){
+                return ret;//Z_BUF_ERROR if there was no room left
+            }
+            s++;
+        }
+    }
+}
+
+//check if the zlib stream at buf consists of stored blocks only, and collect the lengths of the blocks if it does
+//the stream is only accepted if it can be rebuilt byte-identical: the padding bits of the block headers must be zero,
+//NLEN must be the complement of LEN, only the last block can be final and the adler32 must match the data
+bool parseStoredStream(const unsigned char* buf, uint64_t streamLength, std::vector<uint16_t>& blockLen, uint64_t& inflatedLength){
+    uint64_t pos=2;//skip the zlib header
+    uLong adler=adler32(0, Z_NULL, 0);
+    bool lastBlock=false;
+    blockLen.clear();
+    inflatedLength=0;
+    while (!lastBlock){
+        if ((pos+5)>streamLength) return false;
+        //a stored block header is 3 bits (BFINAL, BTYPE=00) padded to a byte boundary, so the byte can only be 0 or 1
+        //the first block starts at a byte boundary, and since stored blocks end on one too, every later block does as well
+        if (buf[pos]>1) return false;
+        lastBlock=(buf[pos]==1);
+        uint16_t len=buf[pos+1]|(buf[pos+2]<<8);
+        uint16_t nlen=buf[pos+3]|(buf[pos+4]<<8);
+        if (len!=static_cast<uint16_t>(~nlen)) return false;
+        pos=pos+5;
+        if ((pos+len)>streamLength) return false;
+        adler=adler32(adler, buf+pos, len);
+        blockLen.push_back(len);
+        inflatedLength=inflatedLength+len;
+        pos=pos+len;
+    }
+    if ((pos+4)!=streamLength) return false;//only the adler32 trailer should follow the last block
+    if (adler!=((static_cast<uLong>(buf[pos])<<24)|(buf[pos+1]<<16)|(buf[pos+2]<<8)|buf[pos+3])) return false;
+    return true;
+}
+
+//rebuild a stored zlib stream from the inflated data and the block lengths, returns the number of bytes written to out
+uint64_t rebuildStoredStream(const unsigned char* data, const std::vector<uint16_t>& blockLen, uint16_t zlibHeader, unsigned char* out){
+    uint64_t pos=2;
+    uLong adler=adler32(0, Z_NULL, 0);
+    out[0]=zlibHeader>>8;
+    out[1]=zlibHeader&255;
+    for (uint64_t i=0; i<blockLen.size(); i++){
+        uint16_t len=blockLen[i];
+        uint16_t nlen=~len;
+        out[pos]=((i+1)==blockLen.size());//BFINAL is set on the last block only
+        out[pos+1]=len&255;
+        out[pos+2]=len>>8;
+        out[pos+3]=nlen&255;
+        out[pos+4]=nlen>>8;
+        memcpy(out+pos+5, data, len);
+        adler=adler32(adler, data, len);
+        data=data+len;
+        pos=pos+5+len;
+    }
+    out[pos]=(adler>>24)&255;
+    out[pos+1]=(adler>>16)&255;
+    out[pos+2]=(adler>>8)&255;
+    out[pos+3]=adler&255;
+    return pos+4;
+}
+
+//token statistics of a deflate stream, phase 3 uses them to decide which zlib strategies are worth trying
+//usually only the first token_scan_limit bytes of a stream are scanned, the strategy shows long before that
+#define token_scan_limit 262144
+class tokenStats{
+public:
+    tokenStats(){
+        literals=0;
+        matches=0;
+        shortMatches=0;
+        farMatches=0;
+        maxDistance=0;
+        storedBlocks=0;
+        fixedBlocks=0;
+        dynamicBlocks=0;
+        outPos=0;
+        crossFlush=false;
+        firstBlockSymbols=0;
+    }
+    uint64_t literals;
+    uint64_t matches;
+    uint64_t shortMatches;//matches of 3-5 bytes, Z_FILTERED throws those away at clevel 4-9
+    uint64_t farMatches;//matches with a distance other than 1, Z_RLE never makes those
+    uint64_t maxDistance;
+    uint64_t storedBlocks;
+    uint64_t fixedBlocks;
+    uint64_t dynamicBlocks;
+    uint64_t outPos;//the inflated length so far
+    std::vector<uint64_t> flushPoints;//where the empty stored blocks of Z_SYNC_FLUSH and Z_FULL_FLUSH are in the inflated data
+    bool crossFlush;//a match reaches back past a flush point, which Z_FULL_FLUSH does not allow
+    uint64_t firstBlockSymbols;//the literals and matches of the first block, 0 if it is the last one or a stored block
+    std::vector<uint64_t> blockBits;//where every block starts, in bits from the start of the deflate data
+    std::vector<uint64_t> blockOut;//and in the inflated data
+    std::vector<uint64_t> blockShortMatches;//and the short matches of every block, a block without any can be Z_FILTERED(see segmentStream)
+};
+
+//a canonical huffman code as the deflate spec describes it: the number of codes of each length, and the symbols in code order
+class tokenCode{
+public:
+    uint16_t count[16];
+    uint16_t symbol[288];
+    //returns false if the lengths do not make a valid code, incomplete codes are allowed like zlib allows them
+    bool build(const uint8_t* lengths, int n){
+        uint16_t offs[16];
+        memset(count, 0, sizeof(count));
+        for (int k=0; k<n; k++){
+            count[lengths[k]]++;
+        }
+        int left=1;
+        for (int len=1; len<16; len++){
+            left=(left<<1)-count[len];
+            if (left<0) return false;
+        }
+        offs[1]=0;
+        for (int len=1; len<15; len++){
+            offs[len+1]=offs[len]+count[len];
+        }
+        for (int k=0; k<n; k++){
+            if (lengths[k]!=0){
+                symbol[offs[lengths[k]]]=k;
+                offs[lengths[k]]++;
+            }
+        }
+        return true;
+    }
+};
+
+//reads the bits of a deflate stream least significant bit first
+class tokenReader{
+public:
+    tokenReader(const unsigned char* b, uint64_t l){
+        buf=b;
+        len=l;
+        pos=0;
+        bitbuf=0;
+        bitcnt=0;
+        ended=false;
+    }
+    const unsigned char* buf;
+    uint64_t len;
+    uint64_t pos;
+    uint32_t bitbuf;
+    int bitcnt;
+    bool ended;//the data ran out, not an error since the scan can stop in the middle of a stream
+    bool bits(int n, uint32_t& val){
+        while (bitcnt<n){
+            if (pos>=len){
+                ended=true;
+                return false;
+            }
+            bitbuf=bitbuf|(static_cast<uint32_t>(buf[pos])<<bitcnt);
+            pos++;
+            bitcnt=bitcnt+8;
+        }
+        val=bitbuf&((1u<<n)-1);
+        bitbuf=bitbuf>>n;
+        bitcnt=bitcnt-n;
+        return true;
+    }
+    //decode one symbol a bit at a time, slow but this only runs once per stream
+    bool decode(const tokenCode& code, int& sym){
+        int c=0;
+        int first=0;
+        int index=0;
+        for (int len=1; len<16; len++){
+            uint32_t b;
+            if (!bits(1, b)) return false;
+            c=c|b;
+            if ((c-code.count[len])<first){
+                sym=code.symbol[index+(c-first)];
+                return true;
+            }
+            index=index+code.count[len];
+            first=(first+code.count[len])<<1;
+            c=c<<1;
+        }
+        return false;
+    }
+};
+
+//collect the token statistics of the first limit bytes of the raw deflate data in buf(a zlib stream without its header)
+//returns false if it is not valid deflate data
+bool scanTokens(const unsigned char* buf, uint64_t len, uint64_t limit, tokenStats& st){
+    static const uint16_t lenBase[29]={3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t lenExtra[29]={0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t distBase[30]={1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+                                        4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t distExtra[30]={0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    static const uint8_t lengthOrder[19]={16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    tokenReader in(buf, std::min(len, limit));
+    tokenCode lenCode;
+    tokenCode distCode;
+    uint8_t lengths[320];
+    uint32_t last=0;
+    while (last==0){
+        uint32_t type;
+        st.blockBits.push_back(in.pos*8-in.bitcnt);
+        st.blockOut.push_back(st.outPos);
+        st.blockShortMatches.push_back(0);
+        if ((!in.bits(1, last))||(!in.bits(2, type))) return in.ended;
+        if (type==0){//stored block, skip the data
+            st.storedBlocks++;
+            in.bitbuf=0;
+            in.bitcnt=0;
+            if ((in.pos+4)>in.len) return true;
+            uint64_t blockLen=in.buf[in.pos]|(in.buf[in.pos+1]<<8);
+            if ((blockLen==0)&&(last==0)){//only a flush makes an empty stored block that is not the last one
+                st.flushPoints.push_back(st.outPos);
+            }
+            st.outPos=st.outPos+blockLen;
+            in.pos=in.pos+4+blockLen;
+            if (in.pos>in.len) return true;
+            continue;
+        }
+        if (type==1){
+            st.fixedBlocks++;
+            for (int k=0; k<288; k++){
+                lengths[k]=(k<144)?8:((k<256)?9:((k<280)?7:8));
+            }
+            for (int k=0; k<30; k++){
+                lengths[288+k]=5;
+            }
+            lenCode.build(lengths, 288);
+            distCode.build(lengths+288, 30);
+        } else if (type==2){
+            st.dynamicBlocks++;
+            uint32_t nlen, ndist, ncode;
+            if ((!in.bits(5, nlen))||(!in.bits(5, ndist))||(!in.bits(4, ncode))) return in.ended;
+            nlen=nlen+257;
+            ndist=ndist+1;
+            ncode=ncode+4;
+            if ((nlen>286)||(ndist>30)) return false;
+            memset(lengths, 0, 19);
+            for (uint32_t k=0; k<ncode; k++){
+                uint32_t l;
+                if (!in.bits(3, l)) return in.ended;
+                lengths[lengthOrder[k]]=l;
+            }
+            if (!lenCode.build(lengths, 19)) return false;
+            uint32_t k=0;
+            while (k<(nlen+ndist)){
+                int sym;
+                if (!in.decode(lenCode, sym)) return in.ended;
+                if (sym<16){
+                    lengths[k]=sym;
+                    k++;
+                    continue;
+                }
+                uint8_t val=0;
+                uint32_t rep;
+                if (sym==16){
+                    if (k==0) return false;
+                    val=lengths[k-1];
+                    if (!in.bits(2, rep)) return in.ended;
+                    rep=rep+3;
+                } else if (sym==17){
+                    if (!in.bits(3, rep)) return in.ended;
+                    rep=rep+3;
+                } else {
+                    if (!in.bits(7, rep)) return in.ended;
+                    rep=rep+11;
+                }
+                if ((k+rep)>(nlen+ndist)) return false;
+                memset(lengths+k, val, rep);
+                k=k+rep;
+            }
+            if ((!lenCode.build(lengths, nlen))||(!distCode.build(lengths+nlen, ndist))) return false;
+        } else {
+            return false;
+        }
+        int sym=0;
+        while (sym!=256){
+            if (!in.decode(lenCode, sym)) return in.ended;
+            if (sym<256){
+                st.literals++;
+                st.outPos++;
+            } else if (sym>256){
+                sym=sym-257;
+                if (sym>=29) return false;
+                uint32_t extra;
+                if (!in.bits(lenExtra[sym], extra)) return in.ended;
+                uint32_t matchLen=lenBase[sym]+extra;
+                int dsym;
+                if (!in.decode(distCode, dsym)) return in.ended;
+                if (dsym>=30) return false;
+                if (!in.bits(distExtra[dsym], extra)) return in.ended;
+                uint64_t dist=distBase[dsym]+extra;
+                st.matches++;
+                if (matchLen<6){
+                    st.shortMatches++;
+                    st.blockShortMatches.back()++;
+                }
+                if (dist!=1) st.farMatches++;
+                st.maxDistance=std::max(st.maxDistance, dist);
+                if ((!st.flushPoints.empty())&&(dist>(st.outPos-st.flushPoints.back()))){
+                    st.crossFlush=true;
+                }
+                st.outPos=st.outPos+matchLen;
+                sym=257;//not the end of the block
+            }
+        }
+        if ((st.blockOut.size()==1)&&(last==0)){
+            st.firstBlockSymbols=st.literals+st.matches;
+        }
+    }
+    return true;
+}
+
+//inflate the zlib stream at in, which has the preset dictionary dict, out has to have room for the whole inflated data
+//zlib only takes a dictionary it has not checked the id of in raw mode, so the header and the dictionary id are skipped
+int inflateDictStream(const unsigned char* in, uint64_t inLen, const unsigned char* dict, uint64_t dictLength, unsigned char* out, uint64_t outLen){
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.avail_in=0;
+    strm.next_in=Z_NULL;
+    int ret=inflateInit2(&strm, -15);
+    if (ret != Z_OK)
+    {
+        std::cout<<"inflateInit2() failed with exit code:"<<ret<<std::endl;
+        pause();
+        abort();
+    }
+    inflateSetDictionary(&strm, dict, dictLength);
+    uint64_t inUsed;
+    uint64_t outUsed;
+    ret=zlibPump(strm, false, in+6, inLen-6, out, outLen, inUsed, outUsed);
+    inflateEnd(&strm);
+    return ret;
+}
+
+//the encoders besides zlib that phase 3 tries, for streams that the zlib AntiZ is linked with does not reproduce
+//an encoder is known by its id(encoder_*), which goes to the ATZ file with the clevel of the stream, the other parameters are zlib's own
+//an encoder only gives the same output as the one that made a stream in the same version, so its version goes with the id,
+//and a stream is only rebuilt by an encoder of the same version
+class deflateEncoder{
+public:
+    virtual ~deflateEncoder(){}
+    virtual const char* name() const=0;
+    virtual uint64_t version() const=0;
+    //the search tries clevel maxLevel() down to 1
+    virtual int maxLevel() const=0;
+    //a clevel for which the encoder writes FLEVEL flevel(0-3) into the zlib header, see probeEncoders
+    virtual int headerLevel(int flevel) const=0;
+    //compress in into a zlib stream at out, returns the length of the stream, 0 if it does not fit into outLen bytes
+    virtual uint64_t compress(int clevel, const unsigned char* in, uint64_t inLen, unsigned char* out, uint64_t outLen) const=0;
+};
+
+#ifdef use_libdeflate
+//libdeflate's whole buffer compressor, clevel 1-12, made by tools that link libdeflate instead of zlib
+class libdeflateEncoder: public deflateEncoder{
+public:
+    const char* name() const{
+        return "libdeflate";
+    }
+    uint64_t version() const{
+        return (LIBDEFLATE_VERSION_MAJOR<<8)|LIBDEFLATE_VERSION_MINOR;
+    }
+    int maxLevel() const{
+        return 12;
+    }
+    int headerLevel(int flevel) const{
+        static const int level[4]={1, 5, 6, 9};
+        return level[flevel];
+    }
+    uint64_t compress(int clevel, const unsigned char* in, uint64_t inLen, unsigned char* out, uint64_t outLen) const{
+        libdeflate_compressor* c=libdeflate_alloc_compressor(clevel);
+        if (c==0){
+            std::cout<<"error: libdeflate_alloc_compressor() failed"<<std::endl;
+            abort();
+        }
+        uint64_t len=libdeflate_zlib_compress(c, in, inLen, out, outLen);
+        libdeflate_free_compressor(c);
+        return len;
+    }
+};
+#endif // use_libdeflate
+
+//the registry of the encoders besides zlib: the encoder with the given id, 0 if it is not built in
+const deflateEncoder* encoderById(int id){
+    if (id!=encoder_libdeflate) return 0;
+    #ifdef use_libdeflate
+    static libdeflateEncoder libdeflate;
+    return &libdeflate;
+    #else
+    return 0;
+    #endif // use_libdeflate
+}
+
+//the encoders besides zlib that are built in, with their versions, for the start of a run
+//the default build has none, phase 3 only tries zlib then
+std::string encoderList(){
+    std::ostringstream list;
+    for (int id=0; id<encoder_count; id++){
+        const deflateEncoder* e=encoderById(id);
+        if (e==0) continue;
+        if (list.tellp()>0) list<<", ";
+        list<<e->name()<<" "<<(e->version()>>8)<<"."<<(e->version()&255);
+    }
+    if (list.tellp()==0) return "none, only zlib is tried(build with -Duse_libdeflate for libdeflate)";
+    return list.str();
+}
+
+//rebuild the original compressed stream from its inflated data(atzInfos) and its parameters
+//out has to have room for streamLength+32768 bytes
+void rebuildStream(streamOffset& so, unsigned char* out){
+    if (so.clevel==0){//stored streams are rebuilt directly from the block lengths
+        #ifdef debug
+        std::cout<<"   rebuilding "<<so.storedBlockLen.size()<<" stored blocks"<<std::endl;
+        #endif // debug
+        rebuildStoredStream(so.atzInfos, so.storedBlockLen, so.zlibHeader, out);
+        return;
+    }
+    if (so.memlvl==0){//made by another encoder
+        const deflateEncoder* e=encoderById(so.encoder);
+        if (e==0){
+            std::cout<<"the stream at "<<so.offset<<" needs encoder #"<<+so.encoder<<", which is not built in"<<std::endl;
+            pause();
+            abort();
+        }
+        if (e->version()!=so.encoderVersion){
+            std::cout<<"the stream at "<<so.offset<<" was made by "<<e->name()<<" version "<<(so.encoderVersion>>8)<<"."<<(so.encoderVersion&255)
+                     <<", this build has version "<<(e->version()>>8)<<"."<<(e->version()&255)<<std::endl;
+            pause();
+            abort();
+        }
+        #ifdef debug
+        std::cout<<"   compressing with "<<e->name()<<std::endl;
+        #endif // debug
+        if (e->compress(so.clevel, so.atzInfos, so.inflatedLength, out, so.streamLength+32768)==0){
+            std::cout<<e->name()<<" failed to compress the stream at "<<so.offset<<std::endl;
+            pause();
+            abort();
+        }
+        if (so.diffRunLen.size()>0){
+            so.applyDiff(out);
+        }
+        if (crcBytes(0, out, so.streamLength)!=so.encoderCrc){
+            std::cout<<"the stream at "<<so.offset<<" rebuilt by "<<e->name()<<" does not match the original, the "<<e->name()<<" this build is linked with gives other output"<<std::endl;
+            pause();
+            abort();
+        }
+        return;
+    }
+    #ifdef debug
+    std::cout<<"   compressing"<<std::endl;
+    #endif // debug
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    //initialize the stream for compression and check for error
+    int ret=deflateInit2(&strm, so.clevel, Z_DEFLATED, so.window, so.memlvl, so.strategy);
+    if (ret != Z_OK)
+    {
+        std::cout<<"deflateInit() failed with exit code:"<<ret<<std::endl;
+        pause();
+        abort();
+    }
+    if (so.dict!=0){
+        deflateSetDictionary(&strm, so.dict, so.dictLength);
+    }
+    uint64_t inUsed;
+    uint64_t outUsed;
+    ret=deflateFlushed(strm, so.atzInfos, so.inflatedLength, so, out, so.streamLength+32768, inUsed, outUsed);
+    if (ret!=Z_STREAM_END){//shit hit the fan, should never happen normally
+        std::cout<<"deflate() failed with exit code:"<<ret<<std::endl;
+        pause();
+        abort();
+    }
+    //deallocate the zlib stream, check for errors
+    ret=deflateEnd(&strm);
+    if (ret!=Z_OK)
+    {
+        std::cout<<"deflateEnd() failed with exit code:"<<ret<<std::endl;//should never happen normally
+        pause();
+        abort();
+    }
+    //do stream modification if needed
+    if (so.diffRunLen.size()>0){
+        #ifdef debug
+        std::cout<<"   modifying "<<so.diffByteVal.size()<<" bytes in "<<so.diffRunLen.size()<<" runs"<<std::endl;
+        #endif // debug
+        so.applyDiff(out);
+    }
+}
+
+//read-only stream over a memory buffer, used to parse ATZ data that has already been read completely(eg. from stdin)
+class memoryStreamBuf: public std::streambuf{
+public:
+    memoryStreamBuf(unsigned char* buf, uint64_t len){
+        setg(reinterpret_cast<char*>(buf), reinterpret_cast<char*>(buf), reinterpret_cast<char*>(buf)+len);
+    }
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which){
+        if (!(which&std::ios_base::in)) return pos_type(off_type(-1));
+        off_type pos=off;
+        if (dir==std::ios_base::cur) pos=pos+(gptr()-eback());
+        if (dir==std::ios_base::end) pos=pos+(egptr()-eback());
+        if ((pos<0)||(pos>(egptr()-eback()))) return pos_type(off_type(-1));
+        setg(eback(), eback()+pos, egptr());
+        return pos_type(pos);
+    }
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which){
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+//xz files start with FD 37 7A 58 5A 00 and ATZ files with "ATZ", so the first byte tells them apart
+bool isXzFile(std::istream& f){
+    return f.peek()==0xFD;
+}
+
+#ifdef use_lzma
+//-lzma [preset]: phase 4 writes the ATZ data as an xz file, made by liblzma's multithreaded encoder,
+//which compresses blocks of it on all cores while the rest is being written, instead of a separate compressor reading the ATZ file back
+//phase 5 recognizes the xz header(see isXzFile) and decompresses the ATZ data as it reads it, the xz tools can decompress it too
+class lzmaOutputBuf: public std::streambuf{
+public:
+    lzmaOutputBuf(std::ostream& dest, uint32_t preset, unsigned threads): out(dest), in(read_chunk), comp(read_chunk){
+        lzma_stream init=LZMA_STREAM_INIT;
+        strm=init;
+        lzma_mt mt;
+        memset(&mt, 0, sizeof(mt));
+        mt.threads=threads;
+        mt.preset=preset;
+        mt.check=LZMA_CHECK_CRC64;
+        lzma_ret ret=lzma_stream_encoder_mt(&strm, &mt);
+        if (ret!=LZMA_OK){
+            std::cout<<"error: lzma_stream_encoder_mt() failed with exit code:"<<ret<<std::endl;
+            pause();
+            abort();
+        }
+        setp(reinterpret_cast<char*>(in.data()), reinterpret_cast<char*>(in.data())+in.size());
+        written=0;
+    }
+    ~lzmaOutputBuf(){
+        lzma_end(&strm);
+    }
+    //the memory the encoder takes with these settings, see -mem-limit
+    static uint64_t memoryUsage(uint32_t preset, unsigned threads){
+        lzma_mt mt;
+        memset(&mt, 0, sizeof(mt));
+        mt.threads=threads;
+        mt.preset=preset;
+        mt.check=LZMA_CHECK_CRC64;
+        return lzma_stream_encoder_mt_memusage(&mt);
+    }
+    uint64_t written;//the compressed bytes that went to out
+    //compress what is left and end the xz file, nothing can be written after that
+    void finish(){
+        code(LZMA_FINISH);
+    }
+protected:
+    int_type overflow(int_type c){
+        code(LZMA_RUN);
+        if (!traits_type::eq_int_type(c, traits_type::eof())){
+            *pptr()=traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+private:
+    std::ostream& out;
+    std::vector<unsigned char> in;
+    std::vector<unsigned char> comp;
+    lzma_stream strm;
+    void code(lzma_action action){
+        strm.next_in=reinterpret_cast<uint8_t*>(pbase());
+        strm.avail_in=pptr()-pbase();
+        lzma_ret ret;
+        do {
+            strm.next_out=comp.data();
+            strm.avail_out=comp.size();
+            ret=lzma_code(&strm, action);
+            if ((ret!=LZMA_OK)&&(ret!=LZMA_STREAM_END)){
+                std::cout<<"error: compressing the ATZ file failed with exit code:"<<ret<<std::endl;
+                pause();
+                abort();
+            }
+            out.write(reinterpret_cast<char*>(comp.data()), comp.size()-strm.avail_out);
+            written=written+(comp.size()-strm.avail_out);
+        } while ((strm.avail_in>0)||((action==LZMA_FINISH)&&(ret!=LZMA_STREAM_END)));
+        setp(reinterpret_cast<char*>(in.data()), reinterpret_cast<char*>(in.data())+in.size());
+    }
+};
+
+//the other half of -lzma: decompress an xz file with liblzma's multithreaded decoder while it is read
+//the decoder can only work on several blocks at once if the block headers have their sizes, which the multithreaded encoder writes
+class lzmaInputBuf: public std::streambuf{
+public:
+    lzmaInputBuf(std::istream& src, unsigned threads): f(src), comp(read_chunk), data(read_chunk){
+        lzma_stream init=LZMA_STREAM_INIT;
+        strm=init;
+        lzma_ret ret;
+        #if LZMA_VERSION>=50040002
+        lzma_mt mt;
+        memset(&mt, 0, sizeof(mt));
+        mt.threads=threads;
+        mt.memlimit_threading=lzma_physmem()/4;//it decodes in one thread instead of going over this
+        mt.memlimit_stop=UINT64_MAX;
+        ret=lzma_stream_decoder_mt(&strm, &mt);
+        #else
+        ret=lzma_stream_decoder(&strm, UINT64_MAX, 0);//liblzma before 5.4 only decodes in one thread
+        #endif
+        if (ret!=LZMA_OK){
+            std::cout<<"error: initializing the xz decoder failed with exit code:"<<ret<<std::endl;
+            pause();
+            abort();
+        }
+        action=LZMA_RUN;
+        done=false;
+        setg(0, 0, 0);
+    }
+    ~lzmaInputBuf(){
+        lzma_end(&strm);
+    }
+protected:
+    int_type underflow(){
+        if (gptr()<egptr()) return traits_type::to_int_type(*gptr());
+        strm.next_out=data.data();
+        strm.avail_out=data.size();
+        while ((strm.avail_out==data.size())&&(!done)){
+            if ((strm.avail_in==0)&&(action==LZMA_RUN)){
+                f.read(reinterpret_cast<char*>(comp.data()), comp.size());
+                strm.next_in=comp.data();
+                strm.avail_in=f.gcount();
+                if (f.gcount()==0){
+                    action=LZMA_FINISH;
                 }
+            }
+            lzma_ret ret=lzma_code(&strm, action);
+            if (ret==LZMA_STREAM_END){
+                done=true;
+            } else if (ret!=LZMA_OK){
+                std::cout<<"corrupt ATZ file: decompressing it failed with exit code:"<<ret<<std::endl;
+                pause();
+                abort();
+            }
+        }
+        char* start=reinterpret_cast<char*>(data.data());
+        setg(start, start, start+(data.size()-strm.avail_out));
+        if (gptr()==egptr()) return traits_type::eof();
+        return traits_type::to_int_type(*gptr());
+    }
+private:
+    std::istream& f;
+    std::vector<unsigned char> comp;
+    std::vector<unsigned char> data;
+    lzma_stream strm;
+    lzma_action action;
+    bool done;
+};
+#endif // use_lzma
+
+//where the parts of an ATZ file are, filled in by readAtzLayout()
+class atzLayout{
+public:
+    atzLayout(){
+        version=0;
+        atzlen=0;
+        origlen=0;
+        nstrms=0;
+        tableos=0;
+        tablelen=0;
+        diffrunos=0;
+        diffrunlen=0;
+        diffvalos=0;
+        diffvallen=0;
+        payloados=0;
+        payloadlen=0;
+        residueos=28;//ATZ1 files without streams have the residue right after the header
+        residuelen=0;
+        indexos=0;
+        indexlen=0;
+        keysos=0;
+        keyslen=0;
+        dictsos=0;
+        dictslen=0;
+        groupsos=0;
+        groupslen=0;
+        checksumsos=0;
+        checksumslen=0;
+    }
+    int version;
+    uint64_t atzlen;
+    uint64_t origlen;
+    uint64_t nstrms;
+    uint64_t tableos;
+    uint64_t tablelen;
+    uint64_t diffrunos;
+    uint64_t diffrunlen;
+    uint64_t diffvalos;
+    uint64_t diffvallen;
+    uint64_t payloados;
+    uint64_t payloadlen;
+    uint64_t residueos;
+    uint64_t residuelen;
+    uint64_t indexos;
+    uint64_t indexlen;//0 if the file has no index
+    uint64_t keysos;
+    uint64_t keyslen;
+    uint64_t dictsos;
+    uint64_t dictslen;//0 if no stream has a preset dictionary
+    uint64_t groupsos;
+    uint64_t groupslen;//0 if the payloads are in stream order
+    uint64_t checksumsos;
+    uint64_t checksumslen;//0 for files written before there were checksums
+};
+
+//read a varint from f, returns false if f ends before it does
+bool readVarint(std::istream& f, uint64_t& val){
+    val=0;
+    int shift=0;
+    int c;
+    do {
+        c=f.get();
+        if ((c==EOF)||(shift>63)) return false;
+        val=val|(static_cast<uint64_t>(c&127)<<shift);
+        shift=shift+7;
+    } while (c&128);
+    return true;
+}
+
+uint64_t readVarint(std::istream& f){
+    uint64_t val;
+    if (!readVarint(f, val)){
+        std::cout<<"corrupt ATZ file: varint out of bounds"<<std::endl;
+        pause();
+        abort();
+    }
+    return val;
+}
+
+//read the file header and the section directory of an ATZ file, only the section headers are read, not the sections
+//base is where the ATZ data starts in f(archive members), the positions in l are positions in f
+void readAtzLayout(std::istream& f, atzLayout& l, uint64_t base){
+    unsigned char head[12];
+    f.seekg(base);
+    f.read(reinterpret_cast<char*>(head), 12);
+    if ((!f)||(head[0]!=65)||(head[1]!=84)||(head[2]!=90)||((head[3]!=1)&&(head[3]!=2))){
+        std::cout<<"ATZ header not found"<<std::endl;
+        pause();
+        abort();
+    }
+    l.version=head[3];
+    memcpy(&l.atzlen, head+4, 8);
+    if (l.version==1){
+        f.read(reinterpret_cast<char*>(&l.origlen), 8);
+        f.read(reinterpret_cast<char*>(&l.nstrms), 8);
+        return;
+    }
+    l.origlen=readVarint(f);
+    l.nstrms=readVarint(f);
+    bool foundResidue=false;
+    uint64_t pos=f.tellg();
+    while (pos<(base+l.atzlen)){
+        f.seekg(pos);
+        int id=f.get();
+        uint64_t len=readVarint(f);
+        pos=f.tellg();
+        if ((id==EOF)||(len>l.atzlen)||((pos+len)>(base+l.atzlen))){
+            std::cout<<"corrupt ATZ file: section #"<<id<<" is out of bounds"<<std::endl;
+            pause();
+            abort();
+        }
+        switch (id){
+            case atzsec_table:{
+                l.tableos=pos;
+                l.tablelen=len;
+                break;
+            }
+            case atzsec_diffruns:{
+                l.diffrunos=pos;
+                l.diffrunlen=len;
+                break;
+            }
+            case atzsec_diffvalues:{
+                l.diffvalos=pos;
+                l.diffvallen=len;
+                break;
+            }
+            case atzsec_payload:{
+                l.payloados=pos;
+                l.payloadlen=len;
+                break;
+            }
+            case atzsec_residue:{
+                l.residueos=pos;
+                l.residuelen=len;
+                foundResidue=true;
+                break;
+            }
+            case atzsec_index:{
+                l.indexos=pos;
+                l.indexlen=len;
+                break;
+            }
+            case atzsec_keys:{
+                l.keysos=pos;
+                l.keyslen=len;
+                break;
+            }
+            case atzsec_dicts:{
+                l.dictsos=pos;
+                l.dictslen=len;
+                break;
+            }
+            case atzsec_groups:{
+                l.groupsos=pos;
+                l.groupslen=len;
+                break;
+            }
+            case atzsec_checksums:{
+                l.checksumsos=pos;
+                l.checksumslen=len;
                 break;
             }
-            case 88://hex 58
-            {
-                switch(rBuffer[i+1]){
-                    case 195:{//hex 58 C3
-                        #ifdef debug
-                        nMatch3++;
-                        cout<<"Found zlib header(58 C3) with 8K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 9));
-                        break;
-                    }
-                    case 133:{//hex 58 85
-                        #ifdef debug
-                        nMatch3++;
-                        cout<<"Found zlib header(58 85) with 8K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 10));
-                        break;
-                    }
-                    case 71:{//hex 58 47
-                        #ifdef debug
-                        nMatch3++;
-                        cout<<"Found zlib header(58 47) with 8K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 11));
-                        break;
-                    }
-                    case 9:{//hex 58 09
-                        #ifdef debug
-                        nMatch3++;
-                        cout<<"Found zlib header(58 09) with 8K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 12));
-                        break;
-                    }
-                }
-                break;
+            #ifdef debug
+            default:{
+                std::cout<<"skipping unknown section #"<<id<<std::endl;
+            }
+            #endif // debug
+        }
+        pos=pos+len;
+    }
+    if (!foundResidue){
+        std::cout<<"corrupt ATZ file: residue section not found"<<std::endl;
+        pause();
+        abort();
+    }
+}
+
+//read position in the metadata sections of an ATZ2 file
+//the buffers can hold the whole sections or just a part of them, the positions are relative to the buffers
+class atzCursor{
+public:
+    atzCursor(){
+        table=0;
+        tablepos=0;
+        tableend=0;
+        diffruns=0;
+        diffrunpos=0;
+        diffrunend=0;
+        diffvals=0;
+        diffvalpos=0;
+        diffvalend=0;
+        lastend=0;
+    }
+    const unsigned char* table;
+    uint64_t tablepos;
+    uint64_t tableend;
+    const unsigned char* diffruns;
+    uint64_t diffrunpos;
+    uint64_t diffrunend;
+    const unsigned char* diffvals;
+    uint64_t diffvalpos;
+    uint64_t diffvalend;
+    uint64_t lastend;//the end of the previous recompressed stream in the original file
+};
+
+//the block lengths of a stored stream have to add up to the inflated data and, with the headers, to the stream,
+//rebuildStoredStream writes the whole stream into a buffer of streamLength bytes
+void checkStoredBlocks(const streamOffset& so){
+    uint64_t sum=0;
+    for (uint64_t i=0; i<so.storedBlockLen.size(); i++){
+        sum=sum+so.storedBlockLen[i];
+    }
+    if ((sum!=so.inflatedLength)||(so.streamLength!=(6+5*so.storedBlockLen.size()+sum))){
+        std::cout<<"corrupt ATZ file: the block lengths of the stored stream at "<<so.offset<<" do not match the stream"<<std::endl;
+        pause();
+        abort();
+    }
+}
+
+//read the next record of the stream table along with the diff of the stream, and add the stream to the end of list
+void readStreamRecord(atzCursor& cur, std::vector<streamOffset>& list){
+    uint64_t offset=cur.lastend+getVarint(cur.table, cur.tablepos, cur.tableend);
+    uint64_t streamLength=getVarint(cur.table, cur.tablepos, cur.tableend);
+    uint64_t inflatedLength=streamLength+unzigzag(getVarint(cur.table, cur.tablepos, cur.tableend));
+    list.push_back(streamOffset(offset, -1, streamLength, inflatedLength));
+    streamOffset& so=list.back();
+    cur.lastend=offset+streamLength;
+    if ((cur.tablepos+3)>cur.tableend){
+        std::cout<<"corrupt ATZ file: stream table is truncated"<<std::endl;
+        pause();
+        abort();
+    }
+    so.clevel=cur.table[cur.tablepos]&~(atz_nested|atz_shared|atz_dict|atz_flush);
+    bool nested=cur.table[cur.tablepos]&atz_nested;
+    bool shared=cur.table[cur.tablepos]&atz_shared;
+    bool dict=cur.table[cur.tablepos]&atz_dict;
+    bool flush=cur.table[cur.tablepos]&atz_flush;
+    #ifdef debug
+    std::cout<<"   offset:"<<so.offset<<std::endl;
+    #endif // debug
+    if (so.clevel==0){//stored stream, read the zlib header and the block lengths
+        so.zlibHeader=(cur.table[cur.tablepos+1]<<8)|cur.table[cur.tablepos+2];
+        cur.tablepos=cur.tablepos+3;
+        uint64_t nblocks=getVarint(cur.table, cur.tablepos, cur.tableend);
+        #ifdef debug
+        std::cout<<"   stored, "<<nblocks<<" blocks"<<std::endl;
+        #endif // debug
+        if (nblocks>(cur.tableend-cur.tablepos)){//every block length takes at least a byte
+            std::cout<<"corrupt ATZ file: stream table is truncated"<<std::endl;
+            pause();
+            abort();
+        }
+        so.storedBlockLen.reserve(nblocks);
+        for (uint64_t i=0; i<nblocks; i++){
+            uint64_t len=getVarint(cur.table, cur.tablepos, cur.tableend);
+            if (len>65535){
+                std::cout<<"corrupt ATZ file: stored block longer than 65535 bytes"<<std::endl;
+                pause();
+                abort();
+            }
+            so.storedBlockLen.push_back(len);
+        }
+        checkStoredBlocks(so);
+        if (nested){
+            so.nestedLength=getVarint(cur.table, cur.tablepos, cur.tableend);
+        }
+        if (shared){
+            so.sharedPos=getVarint(cur.table, cur.tablepos, cur.tableend);
+        }
+        return;
+    }
+    so.window=cur.table[cur.tablepos+1]&15;
+    so.strategy=(cur.table[cur.tablepos+1]>>4)&7;
+    bool segments=cur.table[cur.tablepos+1]&atz_segments;
+    so.memlvl=cur.table[cur.tablepos+2];
+    cur.tablepos=cur.tablepos+3;
+    if (so.memlvl==0){
+        getEncoder(cur.table, cur.tablepos, cur.tableend, so);
+        #ifdef debug
+        std::cout<<"   encoder #"<<+so.encoder<<", version "<<so.encoderVersion<<std::endl;
+        #endif // debug
+    }
+    #ifdef debug
+    std::cout<<"   memlevel:"<<+so.memlvl<<std::endl;
+    std::cout<<"   clevel:"<<+so.clevel<<std::endl;
+    std::cout<<"   window:"<<+so.window<<std::endl;
+    std::cout<<"   strategy:"<<+so.strategy<<std::endl;
+    #endif // debug
+    uint64_t diffruns=getVarint(cur.table, cur.tablepos, cur.tableend);
+    if (diffruns>0){//if the stream is just a partial match
+        #ifdef debug
+        std::cout<<"   partial match, "<<diffruns<<" diff runs"<<std::endl;
+        #endif // debug
+        uint64_t diffbytes=0;
+        so.diffRunGap.reserve(diffruns);
+        so.diffRunLen.reserve(diffruns);
+        for (uint64_t i=0; i<diffruns; i++){
+            so.diffRunGap.push_back(getVarint(cur.diffruns, cur.diffrunpos, cur.diffrunend));
+            so.diffRunLen.push_back(getVarint(cur.diffruns, cur.diffrunpos, cur.diffrunend));
+            diffbytes=diffbytes+so.diffRunLen[i];
+        }
+        if ((diffbytes>cur.diffvalend)||((cur.diffvalpos+diffbytes)>cur.diffvalend)){
+            std::cout<<"corrupt ATZ file: diff values of the stream at "<<so.offset<<" are out of bounds"<<std::endl;
+            pause();
+            abort();
+        }
+        so.diffByteVal.insert(so.diffByteVal.end(), cur.diffvals+cur.diffvalpos, cur.diffvals+cur.diffvalpos+diffbytes);
+        cur.diffvalpos=cur.diffvalpos+diffbytes;
+    }
+    #ifdef debug
+    else{//if the stream is a full match
+        std::cout<<"   full match"<<std::endl;
+    }
+    #endif // debug
+    if (dict){
+        so.dictNumber=getVarint(cur.table, cur.tablepos, cur.tableend)+1;
+        #ifdef debug
+        std::cout<<"   preset dictionary #"<<(so.dictNumber-1)<<std::endl;
+        #endif // debug
+    }
+    if (flush){
+        getFlushPoints(cur.table, cur.tablepos, cur.tableend, so);
+        #ifdef debug
+        std::cout<<"   "<<so.flushPoints.size()<<" flush points"<<std::endl;
+        #endif // debug
+    }
+    if (segments){
+        getSegments(cur.table, cur.tablepos, cur.tableend, so);
+        #ifdef debug
+        std::cout<<"   "<<so.segmentPoints.size()<<" segments"<<std::endl;
+        #endif // debug
+    }
+    if (nested){
+        so.nestedLength=getVarint(cur.table, cur.tablepos, cur.tableend);
+        #ifdef debug
+        std::cout<<"   nested payload, "<<so.nestedLength<<" bytes"<<std::endl;
+        #endif // debug
+    }
+    if (shared){
+        so.sharedPos=getVarint(cur.table, cur.tablepos, cur.tableend);
+        #ifdef debug
+        std::cout<<"   payload shared with an earlier archive member at "<<so.sharedPos<<std::endl;
+        #endif // debug
+    }
+}
+
+//point the streams of list from first on that have a preset dictionary to their dictionary in sec, the atzsec_dicts section
+void attachDictionaries(const unsigned char* sec, uint64_t len, std::vector<streamOffset>& list, uint64_t first){
+    std::vector<uint64_t> dictPos;
+    std::vector<uint64_t> dictLength;
+    uint64_t pos=0;
+    if (len>0){
+        uint64_t n=getVarint(sec, pos, len);
+        for (uint64_t k=0; (k<n)&&(pos<=len); k++){
+            dictLength.push_back(getVarint(sec, pos, len));
+            dictPos.push_back(pos);
+            pos=pos+dictLength.back();
+        }
+    }
+    for (uint64_t j=first; j<list.size(); j++){
+        if (list[j].dictNumber==0) continue;
+        uint64_t k=list[j].dictNumber-1;
+        if ((k>=dictPos.size())||(dictLength[k]>len)||((dictPos[k]+dictLength[k])>len)){
+            std::cout<<"corrupt ATZ file: preset dictionary #"<<k<<" is out of bounds"<<std::endl;
+            pause();
+            abort();
+        }
+        list[j].dict=sec+dictPos[k];
+        list[j].dictLength=dictLength[k];
+    }
+}
+
+//read len bytes from pos of the ATZ file into buf
+void readAtzBytes(std::istream& f, uint64_t pos, uint64_t len, unsigned char* buf){
+    f.seekg(pos);
+    f.read(reinterpret_cast<char*>(buf), len);
+    if (!f){
+        std::cout<<"error: reading "<<len<<" bytes at "<<pos<<" of the ATZ file failed"<<std::endl;
+        pause();
+        abort();
+    }
+}
+
+//read the groups section(see atzsec_groups) for the n streams from index checkpoint #k on: their groups and where the next payload of every group is
+//if the file has no groups section, the payloads are in stream order, group is all 0 then and next is left as it is
+void readPayloadGroups(std::istream& f, const atzLayout& l, uint64_t k, uint64_t n, std::vector<unsigned char>& group, std::vector<uint64_t>& next){
+    group.assign(n, 0);
+    if (l.groupslen==0) return;
+    f.seekg(l.groupsos);
+    uint64_t count=readVarint(f);
+    uint64_t head=varintLength(count);
+    uint64_t first=k*atz_index_interval;
+    if ((count==0)||(count>256)||(l.nstrms>l.groupslen)||(first>l.nstrms)||(n>(l.nstrms-first))
+        ||((head+l.nstrms+((l.nstrms+atz_index_interval-1)/atz_index_interval)*count*8)>l.groupslen)){
+        std::cout<<"corrupt ATZ file: the groups section does not match the stream table"<<std::endl;
+        pause();
+        abort();
+    }
+    if (n>0){
+        readAtzBytes(f, l.groupsos+head+first, n, group.data());
+    }
+    next.resize(count);
+    readAtzBytes(f, l.groupsos+head+l.nstrms+k*count*8, count*8, reinterpret_cast<unsigned char*>(next.data()));
+}
+
+//the position of the payload of so(stream #n, in group) in the payload section, the next payload of the group comes after it
+uint64_t nextPayload(const atzLayout& l, const streamOffset& so, uint64_t n, unsigned char group, std::vector<uint64_t>& next){
+    uint64_t len=so.payloadLength();
+    if ((group>=next.size())||(len>l.payloadlen)||(next[group]>(l.payloadlen-len))){
+        std::cout<<"corrupt ATZ file: payload of stream #"<<n<<" is out of bounds"<<std::endl;
+        pause();
+        abort();
+    }
+    uint64_t pos=next[group];
+    next[group]=pos+len;
+    return pos;
+}
+
+//read the stream table of an ATZ2 file that is all in memory, atzInfos of the streams point to their payloads in atzBuffer
+//except for the payloads shared with an earlier archive member, atzInfos is left at 0 for those
+void readStreamList(unsigned char* atzBuffer, const atzLayout& layout, std::vector<streamOffset>& list){
+    atzCursor cur;
+    cur.table=atzBuffer;
+    cur.tablepos=layout.tableos;
+    cur.tableend=layout.tableos+layout.tablelen;
+    cur.diffruns=atzBuffer;
+    cur.diffrunpos=layout.diffrunos;
+    cur.diffrunend=layout.diffrunos+layout.diffrunlen;
+    cur.diffvals=atzBuffer;
+    cur.diffvalpos=layout.diffvalos;
+    cur.diffvalend=layout.diffvalos+layout.diffvallen;
+    memoryStreamBuf atzBuf(atzBuffer, layout.atzlen);
+    std::istream atzStream(&atzBuf);
+    std::vector<unsigned char> group;
+    std::vector<uint64_t> next(1, 0);
+    readPayloadGroups(atzStream, layout, 0, layout.nstrms, group, next);
+    list.reserve(layout.nstrms);
+    for (uint64_t j=0;j<layout.nstrms;j++){
+        #ifdef debug
+        std::cout<<"stream #"<<j<<std::endl;
+        #endif // debug
+        readStreamRecord(cur, list);
+        if (list[j].sharedPos>0){//the caller finds it in the archive
+            continue;
+        }
+        list[j].atzInfos=atzBuffer+layout.payloados+nextPayload(layout, list[j], j, group[j], next);
+    }
+    attachDictionaries(atzBuffer+layout.dictsos, layout.dictslen, list, 0);
+}
+
+//rebuild the original data of an ATZ2 image in memory into out, which has room for exactly outLen bytes
+//this is phase 5 for the nested payloads of -depth and for archive members, the images inside the image are rebuilt first
+//archive is the whole archive for members(see -archive), 0 otherwise
+void rebuildImage(unsigned char* atz, uint64_t len, unsigned char* out, uint64_t outLen, unsigned char* archive, uint64_t archiveLen){
+    memoryStreamBuf atzBuf(atz, len);
+    std::istream atzStream(&atzBuf);
+    atzLayout layout;
+    readAtzLayout(atzStream, layout, 0);
+    if ((layout.version!=2)||(layout.atzlen!=len)||(layout.origlen!=outLen)){
+        std::cout<<"corrupt ATZ file: nested payload does not match its stream"<<std::endl;
+        pause();
+        abort();
+    }
+    std::vector<streamOffset> list;
+    readStreamList(atz, layout, list);
+    uint64_t pos=0;//everything before pos in out is done
+    uint64_t residuepos=layout.residueos;
+    for (uint64_t j=0; j<list.size(); j++){
+        streamOffset& so=list[j];
+        if ((so.offset<pos)||((so.offset+so.streamLength)>outLen)||((residuepos+(so.offset-pos))>(layout.residueos+layout.residuelen))){
+            std::cout<<"corrupt ATZ file: nested stream #"<<j<<" is out of bounds"<<std::endl;
+            pause();
+            abort();
+        }
+        memcpy(out+pos, atz+residuepos, so.offset-pos);
+        residuepos=residuepos+(so.offset-pos);
+        if (so.sharedPos>0){
+            if ((archive==0)||(so.sharedPos>archiveLen)||(so.payloadLength()>(archiveLen-so.sharedPos))){
+                std::cout<<"corrupt ATZ file: shared payload of stream #"<<j<<" is out of bounds"<<std::endl;
+                pause();
+                abort();
+            }
+            so.atzInfos=archive+so.sharedPos;
+        }
+        std::vector<unsigned char> payload;
+        if (so.nestedLength>0){
+            payload.resize(so.inflatedLength);
+            rebuildImage(so.atzInfos, so.nestedLength, payload.data(), so.inflatedLength, 0, 0);
+            so.atzInfos=payload.data();
+        }
+        unsigned char* compBuffer=new unsigned char[so.streamLength+32768];
+        rebuildStream(so, compBuffer);
+        memcpy(out+so.offset, compBuffer, so.streamLength);
+        delete [] compBuffer;
+        pos=so.offset+so.streamLength;
+    }
+    if ((residuepos+(outLen-pos))!=(layout.residueos+layout.residuelen)){
+        std::cout<<"corrupt ATZ file: nested residue does not match"<<std::endl;
+        pause();
+        abort();
+    }
+    memcpy(out+pos, atz+residuepos, outLen-pos);
+}
+
+//replace a nested payload with the inflated data it was made from, so that the stream can be rebuilt from it
+//payload keeps the data, atzInfos points into it afterwards
+void unpackNested(streamOffset& so, std::vector<unsigned char>& payload){
+    if (so.nestedLength==0) return;
+    #ifdef debug
+    std::cout<<"   unpacking a nested payload of "<<so.nestedLength<<" bytes"<<std::endl;
+    #endif // debug
+    payload.resize(so.inflatedLength);
+    rebuildImage(so.atzInfos, so.nestedLength, payload.data(), so.inflatedLength, 0, 0);
+    so.atzInfos=payload.data();
+    so.nestedLength=0;
+}
+
+//copy len bytes from pos of the ATZ file to out in pieces
+void copyAtzBytes(std::istream& f, uint64_t pos, uint64_t len, std::ostream& out){
+    const uint64_t chunk=1<<20;
+    unsigned char* buf=new unsigned char[chunk];
+    while (len>0){
+        uint64_t n=(len<chunk)?len:chunk;
+        readAtzBytes(f, pos, n, buf);
+        out.write(reinterpret_cast<char*>(buf), n);
+        pos=pos+n;
+        len=len-n;
+    }
+    delete [] buf;
+}
+
+//read checkpoint #k of the index
+void readCheckpoint(std::istream& f, const atzLayout& l, uint64_t k, uint64_t* cp){
+    readAtzBytes(f, l.indexos+varintLength(atz_index_interval)+k*48, 48, reinterpret_cast<unsigned char*>(cp));
+}
+
+//read the streams between checkpoint #k and #k+1 of the index, the positions of their payloads are stored in payloadPos
+//cp gets the values of checkpoint #k, dictSec gets the dictionary section the first time a stream needs it
+void readIndexGroup(std::istream& f, const atzLayout& l, uint64_t k, uint64_t* cp, std::vector<streamOffset>& list, std::vector<uint64_t>& payloadPos, std::vector<unsigned char>& dictSec){
+    uint64_t next[6]={0, l.tablelen, l.diffrunlen, l.diffvallen, l.payloadlen, l.residuelen};
+    readCheckpoint(f, l, k, cp);
+    if (((k+1)*atz_index_interval)<l.nstrms){
+        readCheckpoint(f, l, k+1, next);
+    }
+    if ((next[1]<cp[1])||(next[2]<cp[2])||(next[3]<cp[3])||(next[1]>l.tablelen)||(next[2]>l.diffrunlen)||(next[3]>l.diffvallen)){
+        std::cout<<"corrupt ATZ file: index checkpoint #"<<k<<" is out of bounds"<<std::endl;
+        pause();
+        abort();
+    }
+    std::vector<unsigned char> table(next[1]-cp[1]);
+    std::vector<unsigned char> diffruns(next[2]-cp[2]);
+    std::vector<unsigned char> diffvals(next[3]-cp[3]);
+    readAtzBytes(f, l.tableos+cp[1], table.size(), table.data());
+    readAtzBytes(f, l.diffrunos+cp[2], diffruns.size(), diffruns.data());
+    readAtzBytes(f, l.diffvalos+cp[3], diffvals.size(), diffvals.data());
+    atzCursor cur;
+    cur.table=table.data();
+    cur.tableend=table.size();
+    cur.diffruns=diffruns.data();
+    cur.diffrunend=diffruns.size();
+    cur.diffvals=diffvals.data();
+    cur.diffvalend=diffvals.size();
+    cur.lastend=cp[0];
+    uint64_t first=k*atz_index_interval;
+    std::vector<unsigned char> group;
+    std::vector<uint64_t> payload(1, cp[4]);
+    readPayloadGroups(f, l, k, std::min(l.nstrms-first, static_cast<uint64_t>(atz_index_interval)), group, payload);
+    list.clear();
+    payloadPos.clear();
+    for (uint64_t n=first; (n<l.nstrms)&&(n<(first+atz_index_interval)); n++){
+        readStreamRecord(cur, list);
+        if (list.back().sharedPos>0){
+            std::cout<<"this is an archive member, unpack the archive with -unpack"<<std::endl;
+            pause();
+            abort();
+        }
+        payloadPos.push_back(nextPayload(l, list.back(), n, group[n-first], payload));
+    }
+    if ((l.dictslen>0)&&dictSec.empty()){
+        dictSec.resize(l.dictslen);
+        readAtzBytes(f, l.dictsos, l.dictslen, dictSec.data());
+    }
+    attachDictionaries(dictSec.data(), dictSec.size(), list, 0);
+}
+
+//open an ATZ file for random access, it has to be an ATZ2 file with an index
+void openIndexedAtz(const char* atzfile_name, std::ifstream& f, atzLayout& l){
+    f.open(atzfile_name, std::ios::in | std::ios::binary);
+    if (!f.is_open()){
+        std::cout<<"error: open ATZ file for input failed!"<<std::endl;
+        pause();
+        abort();
+    }
+    if (isXzFile(f)){
+        std::cout<<"error: the ATZ file is compressed with xz(see -lzma), random access needs it decompressed with xz -d first"<<std::endl;
+        pause();
+        abort();
+    }
+    readAtzLayout(f, l, 0);
+    if ((l.version<2)||((l.nstrms>0)&&(l.indexlen<varintLength(atz_index_interval)+((l.nstrms+atz_index_interval-1)/atz_index_interval)*48))){
+        std::cout<<"this ATZ file has no index, reconstruct the whole file with -r"<<std::endl;
+        pause();
+        abort();
+    }
+    f.seekg(l.indexos);
+    if ((l.nstrms>0)&&(readVarint(f)!=atz_index_interval)){
+        std::cout<<"unsupported index interval"<<std::endl;
+        pause();
+        abort();
+    }
+}
+
+//rebuild bytes [start, start+len) of the original file, only the streams and the residue in that range are read from the ATZ file
+void extractRange(const char* atzfile_name, uint64_t start, uint64_t len, std::ostream& out){
+    std::ifstream f;
+    atzLayout l;
+    openIndexedAtz(atzfile_name, f, l);
+    if (start>=l.origlen){
+        return;
+    }
+    uint64_t end=((len>(l.origlen-start)))?l.origlen:(start+len);
+    uint64_t pos=0;//everything before pos in the original file is done
+    uint64_t residuepos=0;//the residue belonging to pos
+    if (l.nstrms>0){
+        //find the last checkpoint that starts before the range, every stream before it ends before the range too
+        uint64_t cp[6];
+        uint64_t lo=0;
+        uint64_t hi=(l.nstrms-1)/atz_index_interval;
+        while (lo<hi){
+            uint64_t mid=(lo+hi+1)/2;
+            readCheckpoint(f, l, mid, cp);
+            if (cp[0]<=start){
+                lo=mid;
+            } else {
+                hi=mid-1;
+            }
+        }
+        std::vector<streamOffset> group;
+        std::vector<uint64_t> payloadPos;
+        std::vector<unsigned char> dictSec;
+        for (uint64_t k=lo; ((k*atz_index_interval)<l.nstrms)&&(pos<end); k++){
+            readIndexGroup(f, l, k, cp, group, payloadPos, dictSec);
+            pos=cp[0];
+            residuepos=cp[5];
+            for (uint64_t n=0; (n<group.size())&&(pos<end); n++){
+                streamOffset& so=group[n];
+                if (so.offset>start){//the gap before the stream
+                    uint64_t from=(pos>start)?pos:start;
+                    uint64_t to=(so.offset<end)?so.offset:end;
+                    if (from<to){
+                        copyAtzBytes(f, l.residueos+residuepos+(from-pos), to-from, out);
+                    }
+                }
+                residuepos=residuepos+(so.offset-pos);
+                pos=so.offset;
+                if ((pos<end)&&((so.offset+so.streamLength)>start)){//the stream itself
+                    #ifdef debug
+                    std::cout<<"reconstructing the stream at "<<so.offset<<std::endl;
+                    #endif // debug
+                    unsigned char* payload=new unsigned char[so.payloadLength()];
+                    unsigned char* compBuffer=new unsigned char[so.streamLength+32768];
+                    readAtzBytes(f, l.payloados+payloadPos[n], so.payloadLength(), payload);
+                    so.atzInfos=payload;
+                    std::vector<unsigned char> unpacked;
+                    unpackNested(so, unpacked);
+                    rebuildStream(so, compBuffer);
+                    uint64_t from=(pos>start)?pos:start;
+                    uint64_t to=((so.offset+so.streamLength)<end)?(so.offset+so.streamLength):end;
+                    out.write(reinterpret_cast<char*>(compBuffer+(from-pos)), to-from);
+                    delete [] compBuffer;
+                    delete [] payload;
+                }
+                pos=so.offset+so.streamLength;
+            }
+        }
+    }
+    if (pos<end){//the residue after the last stream
+        uint64_t from=(pos>start)?pos:start;
+        copyAtzBytes(f, l.residueos+residuepos+(from-pos), end-from, out);
+    }
+}
+
+//rebuild recompressed stream #n, in the order of the stream table
+void extractStream(const char* atzfile_name, uint64_t n, std::ostream& out){
+    std::ifstream f;
+    atzLayout l;
+    openIndexedAtz(atzfile_name, f, l);
+    if (n>=l.nstrms){
+        std::cout<<"error: the ATZ file has only "<<l.nstrms<<" recompressed streams"<<std::endl;
+        pause();
+        abort();
+    }
+    uint64_t cp[6];
+    std::vector<streamOffset> group;
+    std::vector<uint64_t> payloadPos;
+    std::vector<unsigned char> dictSec;
+    readIndexGroup(f, l, n/atz_index_interval, cp, group, payloadPos, dictSec);
+    streamOffset& so=group[n%atz_index_interval];
+    std::cout<<"stream #"<<n<<" is at offset "<<so.offset<<", "<<so.streamLength<<" bytes"<<std::endl;
+    unsigned char* payload=new unsigned char[so.payloadLength()];
+    unsigned char* compBuffer=new unsigned char[so.streamLength+32768];
+    readAtzBytes(f, l.payloados+payloadPos[n%atz_index_interval], so.payloadLength(), payload);
+    so.atzInfos=payload;
+    std::vector<unsigned char> unpacked;
+    unpackNested(so, unpacked);
+    rebuildStream(so, compBuffer);
+    out.write(reinterpret_cast<char*>(compBuffer), so.streamLength);
+    delete [] compBuffer;
+    delete [] payload;
+}
+
+//the atzsec_checksums section of an ATZ2 file, see readChecksums
+class atzChecksums{
+public:
+    std::vector<uint64_t> recordPos;//3 per stream: where its record starts in the table, diff runs and diff values sections
+    std::vector<uint64_t> recordLen;//3 per stream: the length of the record in those sections
+    std::vector<uint32_t> recordCrc;
+    std::vector<uint32_t> payloadCrc;
+    std::vector<uint32_t> residueCrc;
+    uint32_t sectionCrc[4];//the index, dicts, groups and keys sections
+};
+
+//read the checksums section, returns false if the section itself is damaged
+bool readChecksums(std::istream& f, const atzLayout& l, atzChecksums& c){
+    if ((l.checksumslen<4)||(l.nstrms>l.checksumslen)){
+        return false;
+    }
+    std::vector<unsigned char> sec(l.checksumslen);
+    readAtzBytes(f, l.checksumsos, sec.size(), sec.data());
+    uint64_t end=sec.size()-4;
+    uint32_t crc;
+    memcpy(&crc, sec.data()+end, 4);
+    if (crc!=crcBytes(0, sec.data(), end)){
+        return false;
+    }
+    uint64_t pieces=std::max((l.nstrms+atz_index_interval-1)/atz_index_interval, static_cast<uint64_t>(1));
+    uint64_t sectionEnd[3]={l.tablelen, l.diffrunlen, l.diffvallen};
+    uint64_t next[3]={0, 0, 0};
+    uint64_t pos=0;
+    c.recordCrc.resize(l.nstrms);
+    c.payloadCrc.resize(l.nstrms);
+    for (uint64_t n=0; n<l.nstrms; n++){
+        for (int k=0; k<3; k++){
+            uint64_t len=getVarint(sec.data(), pos, end);
+            if (len>(sectionEnd[k]-next[k])){
+                return false;
+            }
+            c.recordPos.push_back(next[k]);
+            c.recordLen.push_back(len);
+            next[k]=next[k]+len;
+        }
+        if ((pos+8)>end){
+            return false;
+        }
+        memcpy(&c.recordCrc[n], sec.data()+pos, 4);
+        memcpy(&c.payloadCrc[n], sec.data()+pos+4, 4);
+        pos=pos+8;
+    }
+    if ((pos+pieces*4+16)!=end){
+        return false;
+    }
+    c.residueCrc.resize(pieces);
+    memcpy(c.residueCrc.data(), sec.data()+pos, pieces*4);
+    memcpy(c.sectionCrc, sec.data()+pos+pieces*4, 16);
+    return true;
+}
+
+//the crc32 of len bytes at pos of the ATZ file, read in pieces
+uint32_t crcAtzBytes(std::istream& f, uint64_t pos, uint64_t len){
+    const uint64_t chunk=1<<20;
+    std::vector<unsigned char> buf(std::min(len, chunk));
+    uint32_t crc=0;
+    while (len>0){
+        uint64_t n=std::min(len, chunk);
+        readAtzBytes(f, pos, n, buf.data());
+        crc=crcBytes(crc, buf.data(), n);
+        pos=pos+n;
+        len=len-n;
+    }
+    return crc;
+}
+
+//check the streams from index checkpoint #k on and the residue up to the next checkpoint against c, every damaged part gets a line in report
+//positions is false if the index or the groups section is damaged, then only the records can be checked
+void scrubGroup(std::istream& f, const atzLayout& l, const atzChecksums& c, uint64_t k, bool positions, std::vector<std::string>& report){
+    std::ostringstream out;
+    uint64_t first=k*atz_index_interval;
+    uint64_t n=std::min(l.nstrms-first, static_cast<uint64_t>(atz_index_interval));
+    uint64_t cp[6]={0, 0, 0, 0, 0, 0};
+    std::vector<unsigned char> group(n, 0);
+    std::vector<uint64_t> next(1, 0);
+    std::vector<bool> lost;//the payload groups whose position is lost because a record before is damaged
+    if (positions&&(n>0)){
+        readCheckpoint(f, l, k, cp);
+        next[0]=cp[4];
+        readPayloadGroups(f, l, k, n, group, next);
+    }
+    lost.resize(next.size(), !positions);
+    for (uint64_t i=0; i<n; i++){
+        const uint64_t* pos=&c.recordPos[(first+i)*3];
+        const uint64_t* len=&c.recordLen[(first+i)*3];
+        std::vector<unsigned char> table(len[0]);
+        std::vector<unsigned char> diffruns(len[1]);
+        std::vector<unsigned char> diffvals(len[2]);
+        readAtzBytes(f, l.tableos+pos[0], len[0], table.data());
+        readAtzBytes(f, l.diffrunos+pos[1], len[1], diffruns.data());
+        readAtzBytes(f, l.diffvalos+pos[2], len[2], diffvals.data());
+        uint32_t crc=crcBytes(0, table.data(), table.size());
+        crc=crcBytes(crc, diffruns.data(), diffruns.size());
+        crc=crcBytes(crc, diffvals.data(), diffvals.size());
+        if ((crc!=c.recordCrc[first+i])||(group[i]>=next.size())){
+            out.str("");
+            out<<"stream #"<<(first+i)<<": the record is damaged";
+            report.push_back(out.str());
+            if (group[i]<next.size()){
+                lost[group[i]]=true;
+            }
+            continue;
+        }
+        //the record is intact, so it can be read to find the payload
+        atzCursor cur;
+        cur.table=table.data();
+        cur.tableend=table.size();
+        cur.diffruns=diffruns.data();
+        cur.diffrunend=diffruns.size();
+        cur.diffvals=diffvals.data();
+        cur.diffvalend=diffvals.size();
+        std::vector<streamOffset> list;
+        readStreamRecord(cur, list);
+        if (list[0].sharedPos>0) continue;//checked with the member that has it
+        if (lost[group[i]]){
+            if (positions){
+                out.str("");
+                out<<"stream #"<<(first+i)<<": the payload is not checked, it comes after a damaged record";
+                report.push_back(out.str());
+            }
+            continue;
+        }
+        uint64_t payloadLen=list[0].payloadLength();
+        if ((payloadLen>l.payloadlen)||(next[group[i]]>(l.payloadlen-payloadLen))){
+            out.str("");
+            out<<"stream #"<<(first+i)<<": the payload is out of bounds";
+            report.push_back(out.str());
+            lost[group[i]]=true;
+            continue;
+        }
+        if (crcAtzBytes(f, l.payloados+next[group[i]], payloadLen)!=c.payloadCrc[first+i]){
+            out.str("");
+            out<<"stream #"<<(first+i)<<": the payload is damaged";
+            report.push_back(out.str());
+        }
+        next[group[i]]=next[group[i]]+payloadLen;
+    }
+    if (!positions) return;
+    uint64_t start=cp[5];
+    uint64_t end=l.residuelen;
+    if ((first+atz_index_interval)<l.nstrms){
+        uint64_t nextcp[6];
+        readCheckpoint(f, l, k+1, nextcp);
+        end=nextcp[5];
+    }
+    if ((start>end)||(end>l.residuelen)||(crcAtzBytes(f, l.residueos+start, end-start)!=c.residueCrc[k])){
+        out.str("");
+        if (n>0){
+            out<<"the residue around streams #"<<first<<" to #"<<(first+n-1)<<" is damaged";
+        } else {
+            out<<"the residue is damaged";
+        }
+        report.push_back(out.str());
+    }
+}
+
+//scrub worker, checks the index groups it takes from next until there are none left
+//the ATZ2 data is image if that is not 0, otherwise it is read from the file name, every worker has its own stream to read it with
+void scrubWorker(const char* name, unsigned char* image, uint64_t imageLen, const atzLayout* l, const atzChecksums* c, bool positions,
+                 std::atomic<uint64_t>* next, std::vector<std::vector<std::string> >* reports){
+    memoryStreamBuf imageBuf(image, imageLen);
+    std::istream imageStream(&imageBuf);
+    std::ifstream file;
+    std::istream* f=&imageStream;
+    if (image==0){
+        file.open(name, std::ios::in | std::ios::binary);
+        if (!file.is_open()){
+            std::cout<<"error: open ATZ file for input failed!"<<std::endl;
+            pause();
+            abort();
+        }
+        f=&file;
+    }
+    for (uint64_t k=(*next)++; k<reports->size(); k=(*next)++){
+        scrubGroup(*f, *l, *c, k, positions, (*reports)[k]);
+    }
+}
+
+//check the ATZ2 data with the layout l against its checksums(see atzsec_checksums) on all cores, without rebuilding anything
+//the data is image if that is not 0, otherwise it is read from the file name, the layout can be that of an archive member
+//prints what is damaged and returns how many parts are, 0 if everything matches or the data has no checksums
+uint64_t scrubAtz(const char* name, unsigned char* image, uint64_t imageLen, const atzLayout& l, unsigned threads){
+    if (l.checksumslen==0){
+        std::cout<<"no checksums, the ATZ data was written before there were any"<<std::endl;
+        return 0;
+    }
+    memoryStreamBuf imageBuf(image, imageLen);
+    std::istream imageStream(&imageBuf);
+    std::ifstream file;
+    std::istream* f=&imageStream;
+    if (image==0){
+        file.open(name, std::ios::in | std::ios::binary);
+        f=&file;
+    }
+    atzChecksums c;
+    if (!readChecksums(*f, l, c)){
+        std::cout<<"the checksums section is damaged"<<std::endl;
+        return 1;
+    }
+    uint64_t damaged=0;
+    const char* names[4]={"index", "dicts", "groups", "keys"};
+    uint64_t os[4]={l.indexos, l.dictsos, l.groupsos, l.keysos};
+    uint64_t len[4]={l.indexlen, l.dictslen, l.groupslen, l.keyslen};
+    bool intact[4];
+    for (int k=0; k<4; k++){
+        intact[k]=(len[k]>0)?(crcAtzBytes(*f, os[k], len[k])==c.sectionCrc[k]):(c.sectionCrc[k]==0);
+        if (!intact[k]){
+            std::cout<<"the "<<names[k]<<" section is damaged"<<std::endl;
+            damaged++;
+        }
+    }
+    //the payloads and the residue are found with the index and the groups section
+    bool positions=intact[0]&&intact[2]&&(l.indexlen>=(varintLength(atz_index_interval)+((l.nstrms+atz_index_interval-1)/atz_index_interval)*48));
+    if (!positions){
+        std::cout<<"the payloads and the residue cannot be checked without the index and the groups section"<<std::endl;
+    }
+    std::vector<std::vector<std::string> > reports(c.residueCrc.size());
+    std::atomic<uint64_t> next(0);
+    std::vector<std::thread> workers;
+    for (unsigned k=0; (k<threads)&&(k<reports.size()); k++){
+        workers.push_back(std::thread(scrubWorker, name, image, imageLen, &l, &c, positions, &next, &reports));
+    }
+    for (unsigned k=0; k<workers.size(); k++){
+        workers[k].join();
+    }
+    for (uint64_t k=0; k<reports.size(); k++){
+        for (uint64_t i=0; i<reports[k].size(); i++){
+            std::cout<<reports[k][i]<<std::endl;
+        }
+        damaged=damaged+reports[k].size();
+    }
+    return damaged;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+//the phases run as a pipeline of stages connected by bounded queues:
+//  reader: a thread that reads the input(a file or stdin) into the input buffer
+//  scanner/validator: phase 1 and 2 on the main thread, they look at the data as soon as it arrives
+//  search: phase 3 on one worker thread per core, each stream is searched as soon as it is validated
+//  writer: phase 4, the payload is inflated on a separate thread while the main thread writes it out
+
+//blocking queue with a fixed capacity
+//push() waits while the queue is full, pop() waits while it is empty and returns false once the queue is closed and empty
+//an ordered queue is kept as a heap and pop() returns the largest item instead of the oldest one
+template <class T> class boundedQueue{
+public:
+    boundedQueue(size_t cap, bool ord=false){
+        capacity=cap;
+        ordered=ord;
+        closed=false;
+    }
+    void push(T& item){
+        std::unique_lock<std::mutex> l(lock);
+        while (items.size()>=capacity){
+            notFull.wait(l);
+        }
+        items.push_back(std::move(item));
+        if (ordered) std::push_heap(items.begin(), items.end());
+        notEmpty.notify_one();
+    }
+    bool pop(T& item){
+        std::unique_lock<std::mutex> l(lock);
+        while (items.empty()&&(!closed)){
+            notEmpty.wait(l);
+        }
+        if (items.empty()) return false;
+        if (ordered){
+            std::pop_heap(items.begin(), items.end());
+            item=std::move(items.back());
+            items.pop_back();
+        } else {
+            item=std::move(items.front());
+            items.pop_front();
+        }
+        notFull.notify_one();
+        return true;
+    }
+    void close(){
+        std::lock_guard<std::mutex> l(lock);
+        closed=true;
+        notEmpty.notify_all();
+    }
+    size_t capacity;
+    bool ordered;
+    bool closed;
+    std::deque<T> items;
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+//the memory budget of the whole run, set with -mem-limit, 0 means no limit
+//what has to stay in memory(the input, the nested images of -depth) is pinned, the rest of the limit is shared by the parts that can wait:
+//a stream is only handed to the search workers once its search fits and phase 4 holds a payload only until it is written
+//what can never fit goes the slow way: streams are left to the residue, payloads are inflated in pieces, payloads are not nested again,
+//and phase 5 rebuilds the file from the ATZ file instead of reading all of it into memory
+class memoryBudget{
+public:
+    memoryBudget(){
+        limit=0;
+        pinned=0;
+        used=0;
+        peak=0;
+        numTooLarge=0;
+    }
+    uint64_t limit;
+    uint64_t pinned;
+    uint64_t used;//what is reserved right now
+    uint64_t peak;//the most that was pinned and reserved at the same time
+    std::atomic<uint64_t> numTooLarge;//streams that were not searched because their search can never fit
+    std::mutex lock;
+    std::condition_variable freed;
+    //can n bytes be reserved at all, with nothing else reserved
+    bool fits(uint64_t n){
+        std::lock_guard<std::mutex> l(lock);
+        return (limit==0)||((pinned<=limit)&&(n<=(limit-pinned)));
+    }
+    //n more bytes have to stay in memory, aborts if that is over the limit
+    void pin(uint64_t n){
+        std::lock_guard<std::mutex> l(lock);
+        pinned=pinned+n;
+        peak=std::max(peak, pinned+used);
+        if ((limit>0)&&(pinned>limit)){
+            std::cout<<"error: the data that has to be in memory takes "<<pinned<<" bytes, more than the limit of "<<limit<<" bytes(see -mem-limit)"<<std::endl;
+            pause();
+            abort();
+        }
+    }
+    //pin n bytes only if they are free right now
+    bool tryPin(uint64_t n){
+        std::lock_guard<std::mutex> l(lock);
+        if ((limit>0)&&((pinned+used+n)>limit)) return false;
+        pinned=pinned+n;
+        peak=std::max(peak, pinned+used);
+        return true;
+    }
+    void unpin(uint64_t n){
+        {
+            std::lock_guard<std::mutex> l(lock);
+            pinned=pinned-n;
+        }
+        freed.notify_all();
+    }
+    //reserve n bytes, waits until the others have released enough, n must fit(see fits)
+    void reserve(uint64_t n){
+        std::unique_lock<std::mutex> l(lock);
+        while ((limit>0)&&(used>0)&&((pinned+used+n)>limit)){
+            freed.wait(l);
+        }
+        used=used+n;
+        peak=std::max(peak, pinned+used);
+    }
+    void release(uint64_t n){
+        {
+            std::lock_guard<std::mutex> l(lock);
+            used=used-n;
+        }
+        freed.notify_all();
+    }
+};
+
+//the input data, filled by the reader while the other stages are already working on it
+//the vector can be reallocated while it grows, so data may only be touched with the lock held until the reader is done
+class inputBuffer{
+public:
+    inputBuffer(){
+        done=false;
+        hashing=false;
+        crc=crc32(0, Z_NULL, 0);
+        adler=adler32(0, Z_NULL, 0);
+    }
+    std::vector<unsigned char> data;
+    bool done;
+    bool hashing;//have the reader compute crc and adler of all the input, set before it starts
+    uint32_t crc;
+    uint32_t adler;
+    std::mutex lock;
+    std::condition_variable grown;
+    //wait until at least len bytes are available or the input has ended, returns the number of available bytes
+    uint64_t waitFor(uint64_t len){
+        std::unique_lock<std::mutex> l(lock);
+        while ((data.size()<len)&&(!done)){
+            grown.wait(l);
+        }
+        return data.size();
+    }
+};
+
+//reader stage: read everything from in, read_chunk bytes at a time
+//the memory the buffer takes is pinned in memory if that is not 0(see memoryBudget)
+void readInput(std::istream* in, inputBuffer* buf, memoryBudget* memory){
+    std::vector<unsigned char> chunk(read_chunk);
+    bool eof=false;
+    if (memory!=0){//what was reserved for the data already
+        memory->pin(buf->data.capacity());
+    }
+    while (!eof){
+        in->read(reinterpret_cast<char*>(chunk.data()), read_chunk);
+        uint64_t n=in->gcount();
+        if (in->bad()){
+            std::cout<<"error: reading the input failed"<<std::endl;
+            abort();
+        }
+        eof=(n<read_chunk);
+        if (buf->hashing){//done as the chunks come in, so the checksums are ready when the input is
+            buf->crc=crc32(buf->crc, chunk.data(), n);
+            buf->adler=adler32(buf->adler, chunk.data(), n);
+        }
+        uint64_t grown;
+        {
+            std::lock_guard<std::mutex> l(buf->lock);
+            uint64_t capacity=buf->data.capacity();
+            buf->data.insert(buf->data.end(), chunk.begin(), chunk.begin()+n);
+            buf->done=eof;
+            grown=buf->data.capacity()-capacity;
+        }
+        if ((memory!=0)&&(grown>0)){
+            memory->pin(grown);
+        }
+        buf->grown.notify_all();
+    }
+}
+
+//inflate backend for the paths that only read deflate data: phase 2 and the payloads of phase 4
+//they only need the inflated data, never the exact output of zlib, so a faster decoder can be chosen at build time:
+//  default: zlib
+//  -Duse_libdeflate(link with -ldeflate): libdeflate's whole buffer decoder, see the "Release libdeflate" target,
+//  that build also has libdeflate's compressor as an encoder for phase 3(see deflateEncoder)
+//the parameter search and the reconstruction use zlib, deflate() has to give the same output on every machine,
+//streams made by other encoders are the exception, see deflateEncoder
+#ifdef use_libdeflate
+#define inflate_backend "libdeflate"
+#else
+#define inflate_backend "zlib"
+#endif
+class inflateBackend{
+public:
+    inflateBackend(){
+        #ifdef use_libdeflate
+        d=libdeflate_alloc_decompressor();
+        if (d==0){
+            std::cout<<"error: libdeflate_alloc_decompressor() failed"<<std::endl;
+            abort();
+        }
+        #endif // use_libdeflate
+    }
+    ~inflateBackend(){
+        #ifdef use_libdeflate
+        libdeflate_free_decompressor(d);
+        #endif // use_libdeflate
+    }
+    //inflate the whole zlib stream in into out, outLen has to be the inflated length
+    //returns Z_STREAM_END on success, anything else means that the stream is not what phase 2 found
+    int inflateWhole(const unsigned char* in, uint64_t inLen, unsigned char* out, uint64_t outLen){
+        #ifdef use_libdeflate
+        size_t outUsed;
+        if ((libdeflate_zlib_decompress_ex(d, in, inLen, out, outLen, 0, &outUsed)!=LIBDEFLATE_SUCCESS)||(outUsed!=outLen)){
+            return Z_DATA_ERROR;
+        }
+        return Z_STREAM_END;
+        #else
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        strm.avail_in=0;
+        strm.next_in=Z_NULL;
+        int ret=inflateInit(&strm);
+        if (ret != Z_OK)
+        {
+            std::cout<<"inflateInit() failed with exit code:"<<ret<<std::endl;
+            pause();
+            abort();
+        }
+        uint64_t inUsed;
+        uint64_t outUsed;
+        ret=zlibPump(strm, false, in, inLen, out, outLen, inUsed, outUsed);
+        inflateEnd(&strm);
+        return ret;
+        #endif // use_libdeflate
+    }
+    #ifdef use_libdeflate
+    //phase 2 on a stream that is all in memory: find out if there is a zlib stream at in, and its lengths
+    //returns Z_STREAM_END, Z_DATA_ERROR if it is not a stream, or Z_MEM_ERROR if the stream inflates to more than fast_inflate_max
+    //the scratch buffer does not grow: libdeflate accepts some junk that zlib rejects right away(eg. incomplete huffman codes),
+    //and that can inflate to any length, so long streams are left to zlib, which only pays for them if they are real
+    int validate(const unsigned char* in, uint64_t inLen, uint64_t& streamLength, uint64_t& inflatedLength){
+        if (scratch.empty()){
+            scratch.resize(fast_inflate_max);
+        }
+        size_t inUsed;
+        size_t outUsed;
+        libdeflate_result r=libdeflate_zlib_decompress_ex(d, in, inLen, scratch.data(), scratch.size(), &inUsed, &outUsed);
+        if (r==LIBDEFLATE_SUCCESS){
+            streamLength=inUsed;
+            inflatedLength=outUsed;
+            return Z_STREAM_END;
+        }
+        if (r==LIBDEFLATE_INSUFFICIENT_SPACE){
+            return Z_MEM_ERROR;
+        }
+        return Z_DATA_ERROR;
+    }
+    std::vector<unsigned char> scratch;
+    libdeflate_decompressor* d;
+    #else
+    //zlib has no whole buffer decoder, phase 2 always uses validateZlib
+    int validate(const unsigned char*, uint64_t, uint64_t&, uint64_t&){
+        return Z_MEM_ERROR;
+    }
+    #endif // use_libdeflate
+};
+
+//phase 2 for a single offset with zlib: try to inflate a zlib stream starting at offset
+//the input is fed in chunks as it arrives, the inflated data is thrown away since only the lengths are needed here
+//the deflate data is inflated raw and the adler32 trailer is checked here with adler32Simd, zlib's own checksum is the slowest part of inflate() on this data
+//a stream with a preset dictionary is only validated with dict, which has to be the dictionary its header asks for, dict is 0 for the other streams
+//returns Z_STREAM_END for a valid stream, Z_DATA_ERROR if it is not a stream, Z_BUF_ERROR if the input ends before the stream does
+int validateZlib(inputBuffer& in, uint64_t offset, uint64_t& streamLength, uint64_t& inflatedLength, const std::vector<unsigned char>* dict){
+    inflatedLength=0;
+    streamLength=0;
+    uint64_t headerLength=(dict!=0)?6:2;//the dictionary id follows the header
+    if (in.waitFor(offset+headerLength)<(offset+headerLength)){
+        return Z_BUF_ERROR;
+    }
+    {
+        std::lock_guard<std::mutex> l(in.lock);
+        unsigned char cmf=in.data[offset];
+        unsigned char flg=in.data[offset+1];
+        //deflate, at most 32K window, a valid check value and a preset dictionary only with dict, the same header checks inflate() does
+        if (((cmf&0x0f)!=8)||((cmf>>4)>7)||((((cmf<<8)|flg)%31)!=0)||(((flg&0x20)!=0)!=(dict!=0))){
+            return Z_DATA_ERROR;
+        }
+    }
+    unsigned char scratch[validate_chunk];
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.avail_in=0;
+    strm.next_in=Z_NULL;
+    int ret=inflateInit2(&strm, -15);//inflate() also allows the full 32K window whatever the header says
+    if (ret != Z_OK)
+    {
+        std::cout<<"inflateInit2() failed with exit code:"<<ret<<std::endl;
+        pause();
+        abort();
+    }
+    if (dict!=0){
+        inflateSetDictionary(&strm, dict->data(), dict->size());
+    }
+    uint64_t pos=offset+headerLength;
+    uint32_t adler=1;
+    do {
+        uint64_t avail=in.waitFor(pos+1);
+        if (avail<=pos){//the input has ended in the middle of the stream
+            ret=Z_BUF_ERROR;
+            break;
+        }
+        std::lock_guard<std::mutex> l(in.lock);//the reader must not move the buffer while inflate() is reading it
+        strm.next_in=in.data.data()+pos;
+        strm.avail_in=std::min(avail-pos, static_cast<uint64_t>(validate_chunk));
+        pos=pos+strm.avail_in;
+        do {
+            strm.next_out=scratch;
+            strm.avail_out=validate_chunk;
+            ret=inflate(&strm, Z_NO_FLUSH);
+            adler=adler32Simd(adler, scratch, validate_chunk-strm.avail_out);
+            inflatedLength=inflatedLength+(validate_chunk-strm.avail_out);
+        } while ((ret==Z_OK)&&((strm.avail_in>0)||(strm.avail_out==0)));
+        pos=pos-strm.avail_in;//the input after the end of the stream is not part of it
+        //Z_OK and Z_BUF_ERROR both mean that inflate() needs more input
+    } while ((ret==Z_OK)||(ret==Z_BUF_ERROR));
+    switch (ret){
+        case Z_STREAM_END:
+        {
+            if (in.waitFor(pos+4)<(pos+4)){//the trailer is cut off
+                ret=Z_BUF_ERROR;
+                break;
+            }
+            std::lock_guard<std::mutex> l(in.lock);
+            const unsigned char* t=in.data.data()+pos;
+            uint32_t trailer=(static_cast<uint32_t>(t[0])<<24)|(t[1]<<16)|(t[2]<<8)|t[3];
+            if (trailer!=adler){
+                ret=Z_DATA_ERROR;
+            }
+            pos=pos+4;
+            break;
+        }
+        case Z_DATA_ERROR:
+        case Z_BUF_ERROR:
+            break;
+        default://shit hit the fan, should never happen normally
+        {
+            std::cout<<"inflate() failed with exit code:"<<ret<<std::endl;
+            pause();
+            abort();
+        }
+    }
+    streamLength=pos-offset;//counted here, total_in and total_out can be 32 bits
+    inflateEnd(&strm);
+    return ret;
+}
+
+//phase 2 for a single offset, with the inflate backend once all the input is in memory, and zlib until then
+int validateStream(inputBuffer& in, inflateBackend& backend, uint64_t offset, uint64_t& streamLength, uint64_t& inflatedLength){
+    bool done;
+    {
+        std::lock_guard<std::mutex> l(in.lock);
+        done=in.done;
+    }
+    if (done&&(offset<in.data.size())){//the buffer does not move anymore
+        int ret=backend.validate(in.data.data()+offset, in.data.size()-offset, streamLength, inflatedLength);
+        if (ret!=Z_MEM_ERROR){
+            return ret;
+        }
+    }
+    return validateZlib(in, offset, streamLength, inflatedLength, 0);
+}
+
+#ifdef debug
+std::atomic<int_fast64_t> numFullmatch(0);//phase 3 statistics, counted by the search workers
+std::atomic<int_fast64_t> numStored(0);
+#endif // debug
+
+//limits on the parameter search, set with -stream-budget and -file-budget
+//a limit is a number of deflate attempts, or milliseconds if it is given with an ms suffix, 0 means no limit
+//a stream that runs out of its budget keeps the best match found so far, once the file budget is used up
+//the streams that have not been searched yet are not searched at all and end up in the residue
+class searchBudget{
+public:
+    searchBudget(){
+        streamLimit=0;
+        streamMs=false;
+        fileLimit=0;
+        fileMs=false;
+        fileAttempts=0;
+        numSkipped=0;
+        numCut=0;
+        start=std::chrono::steady_clock::now();
+    }
+    uint64_t streamLimit;
+    bool streamMs;
+    uint64_t fileLimit;
+    bool fileMs;
+    std::atomic<uint64_t> fileAttempts;//deflate attempts made by all the search workers together
+    std::atomic<uint64_t> numSkipped;//streams that were not searched because of the file budget
+    std::atomic<uint64_t> numCut;//streams whose search was stopped by a budget
+    std::chrono::steady_clock::time_point start;//the file budget is counted from here
+    bool fileExhausted(){
+        if (fileLimit==0) return false;
+        if (fileMs) return (secondsSince(start)*1000)>=fileLimit;
+        return fileAttempts>=fileLimit;
+    }
+    //called before every deflate attempt, returns false if the attempt must not be made
+    bool allowAttempt(uint64_t attempts, std::chrono::steady_clock::time_point streamStart){
+        if (streamLimit>0){
+            if (streamMs){
+                if ((secondsSince(streamStart)*1000)>=streamLimit) return false;
+            } else {
+                if (attempts>=streamLimit) return false;
+            }
+        }
+        if (fileExhausted()) return false;
+        fileAttempts++;
+        return true;
+    }
+};
+
+//parse a budget given on the command line: a number of deflate attempts, or milliseconds with an ms suffix
+void parseBudget(const char* arg, uint64_t& limit, bool& ms){
+    char* end;
+    limit=strtoull(arg, &end, 10);
+    ms=(strcmp(end, "ms")==0);
+    if ((end==arg)||((*end!=0)&&(!ms))){
+        std::cout<<"invalid budget: "<<arg<<std::endl;
+        pause();
+        abort();
+    }
+}
+
+//parse a memory size given on the command line: a number of bytes, with an optional K, M or G suffix
+uint64_t parseSize(const char* arg){
+    char* end;
+    uint64_t n=strtoull(arg, &end, 10);
+    if ((*end=='K')||(*end=='k')){
+        n=n<<10;
+        end++;
+    } else if ((*end=='M')||(*end=='m')){
+        n=n<<20;
+        end++;
+    } else if ((*end=='G')||(*end=='g')){
+        n=n<<30;
+        end++;
+    }
+    if ((end==arg)||(*end!=0)){
+        std::cout<<"invalid size: "<<arg<<std::endl;
+        pause();
+        abort();
+    }
+    return n;
+}
+
+//one part of the parameter search: a strategy with a range of windows, memlevel 9 to 1 and a range of clevels, from high to low
+class searchPass{
+public:
+    searchPass(int s, int wh, int wl, int ch, int cl){
+        strategy=s;
+        windowHi=wh;
+        windowLo=wl;
+        clevelHi=ch;
+        clevelLo=cl;
+    }
+    int strategy;
+    int windowHi;
+    int windowLo;
+    int clevelHi;
+    int clevelLo;
+};
+
+//the passes of the parameter search for a stream, in the order they are tried
+//the default strategy is searched with every parameter like it always was, the others only get a pass when the tokens of the stream look like theirs,
+//and only with the window of the header, so a stream of the usual kind costs no more attempts than before
+//the flush points of a stream written with Z_SYNC_FLUSH or Z_FULL_FLUSH go to so, every attempt has to flush at the same places
+//zlib ends a block when its buffer of 2^(memlevel+6)-1 literals and matches is full, unless it is the last block or a flush or deflateParams() ended it,
+//so blockHint is 1 if the first block has any other number of them and another encoder made the stream, 0 if it has,
+//and -1 if the first block says nothing(it is the last one or a stored block), see probeEncoders
+void planSearch(const unsigned char* orig, streamOffset& so, std::vector<searchPass>& passes, int& blockHint){
+    int headerWindow=std::max((orig[0]>>4)+8, 9);//zlib writes a 512 byte window instead of a 256 byte one, the header diff covers that
+    int windowLo=(headerWindow<10)?9:10;
+    uint64_t headerLength=(orig[1]&0x20)?6:2;//the dictionary id of a preset dictionary follows the header
+    //the flush points have to be found in the whole stream, but that is only scanned if it has the LEN and NLEN of an empty stored block somewhere
+    static const unsigned char emptyStored[4]={0x00, 0x00, 0xFF, 0xFF};
+    uint64_t limit=token_scan_limit;
+    if (std::search(orig+headerLength, orig+so.streamLength, emptyStored, emptyStored+4)!=(orig+so.streamLength)){
+        limit=so.streamLength;
+    }
+    tokenStats st;
+    bool scanned=scanTokens(orig+headerLength, so.streamLength-headerLength, limit, st)&&((st.literals+st.matches)>0);
+    so.flushPoints.clear();
+    if (scanned&&(limit==so.streamLength)&&(st.outPos==so.inflatedLength)){
+        so.flushPoints.swap(st.flushPoints);
+        so.fullFlush=!st.crossFlush;//a sync flush that no match reaches across gives the same stream as a full flush almost always
+        #ifdef debug
+        if (!so.flushPoints.empty()){
+            std::cout<<"   "<<so.flushPoints.size()<<" flush points, "<<(so.fullFlush?"Z_FULL_FLUSH":"Z_SYNC_FLUSH")<<std::endl;
+        }
+        #endif // debug
+    }
+    blockHint=-1;
+    if (!so.flushPoints.empty()){
+        blockHint=0;
+    } else if (scanned&&(st.firstBlockSymbols>0)){
+        blockHint=1;
+        for (int memlevel=1; memlevel<=9; memlevel++){
+            if (st.firstBlockSymbols==((static_cast<uint64_t>(1)<<(memlevel+6))-1)){
+                blockHint=0;
+            }
+        }
+        #ifdef debug
+        std::cout<<"   "<<st.firstBlockSymbols<<" symbols in the first block"<<((blockHint==1)?", not zlib":"")<<std::endl;
+        #endif // debug
+    }
+    if (scanned){
+        //zlib cannot reach back further than the window minus 262 bytes, smaller windows can never be a full match
+        while ((windowLo<15)&&(st.maxDistance>((static_cast<uint64_t>(1)<<windowLo)-262))){
+            windowLo++;
+        }
+        //Z_HUFFMAN_ONLY and Z_RLE ignore clevel and the window except for the header(which gets flevel 0), so only memlevel is searched
+        if (st.matches==0){
+            passes.push_back(searchPass(Z_HUFFMAN_ONLY, headerWindow, headerWindow, 9, 9));
+        } else if (st.farMatches==0){
+            passes.push_back(searchPass(Z_RLE, headerWindow, headerWindow, 9, 9));
+        } else if (st.shortMatches==0){//libpng's default, clevel 1-3 are the same as Z_DEFAULT_STRATEGY
+            passes.push_back(searchPass(Z_FILTERED, headerWindow, headerWindow, 9, 4));
+        }
+    }
+    passes.push_back(searchPass(Z_DEFAULT_STRATEGY, 15, windowLo, 9, 1));
+    //small streams are often fixed huffman with the default strategy too, so Z_FIXED only comes after it
+    if (scanned&&(st.fixedBlocks>0)&&(st.dynamicBlocks==0)){
+        passes.push_back(searchPass(Z_FIXED, headerWindow, headerWindow, 9, 1));
+    }
+}
+
+//phase 3 with the encoders besides zlib(see deflateEncoder): every clevel of every one that is built in, a better match than the one so has goes into so
+//they cannot flush, so streams with flush points are left to zlib, returns true on a full match
+bool searchEncoders(streamOffset& so, const unsigned char* orig, const unsigned char* decomp, unsigned char* recompBuffer, uint64_t recompSize, int64_t diffLimit,
+                    searchBudget& budget, uint64_t& attempts, std::chrono::steady_clock::time_point streamStart, bool& outOfBudget){
+    if (!so.flushPoints.empty()) return false;
+    for (int id=0; id<encoder_count; id++){
+        const deflateEncoder* e=encoderById(id);
+        if (e==0) continue;
+        for (int clevel=e->maxLevel(); clevel>=1; clevel--){
+            if (!budget.allowAttempt(attempts, streamStart)){
+                #ifdef debug
+                std::cout<<"   out of budget after "<<attempts<<" attempts"<<std::endl;
+                #endif // debug
+                outOfBudget=true;
+                budget.numCut++;
+                so.cut=true;
+                return false;
+            }
+            attempts++;
+            uint64_t recompLen=e->compress(clevel, decomp, so.inflatedLength, recompBuffer, recompSize);
+            if ((recompLen==0)||(abs(static_cast<int_fast64_t>(recompLen)-static_cast<int_fast64_t>(so.streamLength))>diffLimit)){
+                continue;
+            }
+            int_fast64_t identicalBytes=countIdentical(recompBuffer, orig, std::min(recompLen, so.streamLength));
+            #ifdef debug
+            std::cout<<"   "<<e->name()<<" clevel "<<clevel<<": "<<identicalBytes<<" bytes out of "<<so.streamLength<<" identical"<<std::endl;
+            #endif // debug
+            if (identicalBytes>so.identBytes){
+                so.identBytes=identicalBytes;
+                so.clevel=clevel;
+                so.memlvl=0;
+                so.strategy=Z_DEFAULT_STRATEGY;
+                so.encoder=id;
+                so.encoderVersion=e->version();
+                so.encoderCrc=crcBytes(0, orig, so.streamLength);
+                so.collectDiff(recompBuffer, recompLen, orig);
+            }
+            //the header can differ in FLEVEL, that still counts as a full match like with zlib
+            if ((recompLen==so.streamLength)&&(findMismatch(recompBuffer, orig, 2, so.streamLength)==so.streamLength)){
+                #ifdef debug
+                std::cout<<"   recompression succesful, full match with "<<e->name()<<std::endl;
+                numFullmatch++;
+                #endif // debug
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//one zlib attempt outside the parameter search: recompress with the parameters, flush points and segments of so
+//returns how far the result matches orig, not counting the 2 byte zlib header, which can differ in FLEVEL
+uint64_t deflateAttempt(const streamOffset& so, const unsigned char* orig, const unsigned char* decomp, unsigned char* recompBuffer, uint64_t recompSize, uint64_t& recompLen){
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    int ret=deflateInit2(&strm, so.clevel, Z_DEFLATED, so.window, so.memlvl, so.strategy);
+    if (ret != Z_OK)
+    {
+        std::cout<<"deflateInit() failed with exit code:"<<ret<<std::endl;//should never happen normally
+        pause();
+        abort();
+    }
+    if (so.dict!=0){
+        deflateSetDictionary(&strm, so.dict, so.dictLength);
+    }
+    uint64_t inUsed;
+    ret=deflateFlushed(strm, decomp, so.inflatedLength, so, recompBuffer, recompSize, inUsed, recompLen);
+    if ((ret!=Z_STREAM_END)&&(ret!=Z_BUF_ERROR)){
+        std::cout<<"recompression failed with exit code:"<<ret<<std::endl;
+        pause();
+        abort();
+    }
+    deflateEnd(&strm);//Z_DATA_ERROR only means that the stream was stopped before the end
+    uint64_t n=std::min(recompLen, so.streamLength);
+    if (n<=2) return n;
+    return findMismatch(recompBuffer, orig, 2, n);
+}
+
+//the fingerprint for a stream whose first block does not tell(see planSearch): one attempt with zlib and one with every other encoder,
+//each at a clevel that writes the FLEVEL of the header, whichever gets further into the first block is likely what made the stream
+//returns true if the other encoders should be searched before zlib, in a build without any it costs nothing
+bool probeEncoders(const streamOffset& so, const unsigned char* orig, const unsigned char* decomp, unsigned char* recompBuffer, uint64_t recompSize,
+                   searchBudget& budget, uint64_t& attempts, std::chrono::steady_clock::time_point streamStart){
+    static const int zlibLevel[4]={1, 5, 6, 9};
+    int flevel=orig[1]>>6;
+    uint64_t zlibReach=0;
+    bool other=false;
+    for (int id=0; id<encoder_count; id++){
+        const deflateEncoder* e=encoderById(id);
+        if (e==0) continue;
+        if (!budget.allowAttempt(attempts, streamStart)) return other;
+        attempts++;
+        if (zlibReach==0){//zlib goes first, only once there is something to compare it with
+            streamOffset t(so.offset, so.offsetType, so.streamLength, so.inflatedLength);
+            t.clevel=zlibLevel[flevel];
+            t.window=std::max((orig[0]>>4)+8, 9);
+            t.memlvl=8;
+            t.dict=so.dict;
+            t.dictLength=so.dictLength;
+            uint64_t recompLen;
+            zlibReach=deflateAttempt(t, orig, decomp, recompBuffer, recompSize, recompLen);
+            if (!budget.allowAttempt(attempts, streamStart)) return other;
+            attempts++;
+        }
+        uint64_t recompLen=e->compress(e->headerLevel(flevel), decomp, so.inflatedLength, recompBuffer, recompSize);
+        uint64_t n=std::min(recompLen, so.streamLength);
+        uint64_t reach=(n<=2)?n:findMismatch(recompBuffer, orig, 2, n);
+        #ifdef debug
+        std::cout<<"   probe: zlib matches "<<zlibReach<<" bytes, "<<e->name()<<" "<<reach<<std::endl;
+        #endif // debug
+        if (reach>zlibReach){
+            other=true;
+        }
+    }
+    return other;
+}
+
+//the parameters of a segment that make deflateParams() end the block before it when they follow p:
+//another strategy for Z_HUFFMAN_ONLY and Z_RLE, otherwise another compression function(stored for clevel 0, fast for 1-3, slow for 4-9)
+uint8_t blockEndingParams(uint8_t p){
+    int clevel=p&15;
+    int strategy=p>>4;
+    if ((strategy==Z_HUFFMAN_ONLY)||(strategy==Z_RLE)){
+        return clevel|(Z_DEFAULT_STRATEGY<<4);
+    }
+    return ((clevel>=4)?1:6)|(strategy<<4);
+}
+
+//one step of segmentStream on t, kind 0: params for the current segment, 1 and 2: a new segment with params at point,
+//3: params for the current segment and a new segment at point that makes the block before it end
+void setSegmentStep(streamOffset& t, int kind, uint64_t point, uint8_t params){
+    if ((kind==0)||(kind==3)){
+        if (t.segmentPoints.empty()){
+            t.clevel=params&15;
+            t.strategy=params>>4;
+        } else {
+            t.segmentParams.back()=params;
+        }
+    }
+    if ((kind==1)||(kind==2)){
+        t.segmentPoints.push_back(point);
+        t.segmentParams.push_back(params);
+    }
+    if (kind==3){
+        t.segmentPoints.push_back(point);
+        t.segmentParams.push_back(blockEndingParams(params));
+    }
+}
+
+//take back a step of setSegmentStep, lastParams are the parameters the current segment had before
+void undoSegmentStep(streamOffset& t, int kind, uint8_t lastParams){
+    if (kind>0){
+        t.segmentPoints.pop_back();
+        t.segmentParams.pop_back();
+    }
+    if ((kind==0)||(kind==3)){
+        if (t.segmentPoints.empty()){
+            t.clevel=lastParams&15;
+            t.strategy=lastParams>>4;
+        } else {
+            t.segmentParams.back()=lastParams;
+        }
+    }
+}
+
+//phase 3 for a stream that no single set of parameters reproduces: producers that call deflateParams() in the middle of a stream,
+//or glue together pieces compressed with different clevels, switch parameters at a block boundary(deflateParams() ends the block
+//when the compression function or the strategy changes), so the stream is split there into segments with their own clevel and strategy
+//window and memlevel cannot change in a zlib stream, they stay the ones the search found
+//the segments are found greedily, block by block: where the best attempt so far goes wrong, the current segment gets other parameters,
+//or a new segment starts at that block or the next one, or both(the block can only have ended early because of the next segment)
+//whatever gets furthest is kept, as long as it reproduces the whole block, the segments are only kept if the diff gets smaller
+#define max_segments 64
+void segmentStream(streamOffset& so, const unsigned char* orig, const unsigned char* decomp, unsigned char* recompBuffer, uint64_t recompSize, int64_t diffLimit,
+                   searchBudget& budget, uint64_t& attempts, std::chrono::steady_clock::time_point streamStart){
+    uint64_t headerLength=(orig[1]&0x20)?6:2;
+    tokenStats st;
+    if ((!scanTokens(orig+headerLength, so.streamLength-headerLength, so.streamLength, st))||(st.outPos!=so.inflatedLength)||(st.blockOut.size()<2)){
+        return;
+    }
+    //where every block starts in the stream, plus the adler32 trailer
+    std::vector<uint64_t> blockStart;
+    for (uint64_t k=0; k<st.blockBits.size(); k++){
+        blockStart.push_back(headerLength+st.blockBits[k]/8);
+    }
+    blockStart.push_back(so.streamLength-4);
+    //the greedy search starts from the parameters the search found, and if those do not get through, from the window of the header
+    //and zlib's default memlevel, the search could only compare streams of about the right size, so its window and memlevel can be off
+    streamOffset best(so.offset, so.offsetType, so.streamLength, so.inflatedLength);
+    uint64_t bestReach=0;
+    bool outOfBudget=false;
+    for (int from=(((so.identBytes>0)&&(so.encoder==encoder_zlib))?0:1); (from<2)&&(bestReach<so.streamLength)&&(!outOfBudget); from++){
+        streamOffset t(so.offset, so.offsetType, so.streamLength, so.inflatedLength);
+        t.clevel=so.clevel;
+        t.window=so.window;
+        t.memlvl=so.memlvl;
+        t.strategy=so.strategy;
+        if (from==1){
+            t.clevel=6;
+            t.window=std::max((orig[0]>>4)+8, 9);
+            t.memlvl=8;
+            t.strategy=Z_DEFAULT_STRATEGY;
+            if ((so.identBytes>0)&&(so.encoder==encoder_zlib)&&(t.window==so.window)&&(t.memlvl==so.memlvl)) break;
+        }
+        t.dict=so.dict;
+        t.dictLength=so.dictLength;
+        t.flushPoints=so.flushPoints;
+        t.fullFlush=so.fullFlush;
+        //the parameters a segment can have: every clevel with the strategy of the stream and with the default one, Z_HUFFMAN_ONLY and Z_RLE,
+        //Z_FILTERED at clevel 4-9 if a block has no short matches(1-3 are the same as the default) and Z_FIXED if there are fixed blocks
+        std::vector<uint8_t> candidates;
+        for (int clevel=9; clevel>=0; clevel--){
+            candidates.push_back(clevel|(t.strategy<<4));
+        }
+        if (t.strategy!=Z_DEFAULT_STRATEGY){
+            for (int clevel=9; clevel>=0; clevel--){
+                candidates.push_back(clevel|(Z_DEFAULT_STRATEGY<<4));
+            }
+        }
+        if (t.strategy!=Z_HUFFMAN_ONLY){
+            candidates.push_back(6|(Z_HUFFMAN_ONLY<<4));
+        }
+        if (t.strategy!=Z_RLE){
+            candidates.push_back(6|(Z_RLE<<4));
+        }
+        if ((t.strategy!=Z_FILTERED)&&(std::find(st.blockShortMatches.begin(), st.blockShortMatches.end(), 0)!=st.blockShortMatches.end())){
+            for (int clevel=9; clevel>=4; clevel--){
+                candidates.push_back(clevel|(Z_FILTERED<<4));
+            }
+        }
+        if ((t.strategy!=Z_FIXED)&&(st.fixedBlocks>0)){
+            for (int clevel=9; clevel>=1; clevel--){
+                candidates.push_back(clevel|(Z_FIXED<<4));
+            }
+        }
+        if (!budget.allowAttempt(attempts, streamStart)){
+            outOfBudget=true;
+            break;
+        }
+        attempts++;
+        uint64_t recompLen;
+        uint64_t reach=deflateAttempt(t, orig, decomp, recompBuffer, recompSize, recompLen);
+        #ifdef debug
+        std::cout<<"   trying segments, window "<<+t.window<<", memlevel "<<+t.memlvl<<", "<<(blockStart.size()-1)<<" blocks, the first "<<reach<<" bytes match"<<std::endl;
+        #endif // debug
+        while ((reach<so.streamLength)&&(t.segmentPoints.size()<max_segments)&&(!outOfBudget)){
+            //the block that the mismatch is in
+            uint64_t b=std::upper_bound(blockStart.begin(), blockStart.end()-1, reach)-blockStart.begin();
+            b=(b>0)?(b-1):0;
+            uint64_t lastPoint=t.segmentPoints.empty()?0:t.segmentPoints.back();
+            uint8_t lastParams=t.segmentPoints.empty()?(t.clevel|(t.strategy<<4)):t.segmentParams.back();
+            uint64_t stepReach=reach;
+            int stepKind=-1;
+            uint8_t stepParams=0;
+            //kind 0: other parameters for the current segment, 1: a new segment at block b, 2: at block b+1, 3: other parameters and a new segment at b+1
+            for (int kind=0; (kind<4)&&(!outOfBudget); kind++){
+                uint64_t c=(kind==1)?b:(b+1);
+                if ((kind>0)&&((c>=st.blockOut.size())||(st.blockOut[c]<=lastPoint)||(st.blockOut[c]>=so.inflatedLength))){
+                    continue;
+                }
+                uint64_t need=blockStart[(kind==2)?(c+1):(b+1)];//the block has to come out right
+                for (uint64_t k=0; (k<candidates.size())&&(!outOfBudget); k++){
+                    uint8_t params=candidates[k];
+                    if (params==lastParams) continue;
+                    if (!budget.allowAttempt(attempts, streamStart)){
+                        outOfBudget=true;
+                        break;
+                    }
+                    attempts++;
+                    setSegmentStep(t, kind, st.blockOut[c], params);
+                    uint64_t r=deflateAttempt(t, orig, decomp, recompBuffer, recompSize, recompLen);
+                    undoSegmentStep(t, kind, lastParams);
+                    if ((r>stepReach)&&(r>=need)){
+                        stepReach=r;
+                        stepKind=kind;
+                        stepParams=params;
+                    }
+                }
+            }
+            if (stepKind<0){
+                break;
+            }
+            setSegmentStep(t, stepKind, st.blockOut[(stepKind==1)?b:(b+1)], stepParams);
+            reach=stepReach;
+            #ifdef debug
+            std::cout<<"   block "<<b<<": kind "<<stepKind<<", clevel "<<(stepParams&15)<<", strategy "<<(stepParams>>4)<<", the first "<<reach<<" bytes match"<<std::endl;
+            #endif // debug
+        }
+        if ((!t.segmentPoints.empty())&&(reach>bestReach)){
+            bestReach=reach;
+            best.clevel=t.clevel;
+            best.window=t.window;
+            best.memlvl=t.memlvl;
+            best.strategy=t.strategy;
+            best.dict=t.dict;
+            best.dictLength=t.dictLength;
+            best.flushPoints.swap(t.flushPoints);
+            best.fullFlush=t.fullFlush;
+            best.segmentPoints.swap(t.segmentPoints);
+            best.segmentParams.swap(t.segmentParams);
+        }
+    }
+    if (outOfBudget){
+        budget.numCut++;
+        so.cut=true;
+    }
+    if (best.segmentPoints.empty()){
+        return;
+    }
+    uint64_t recompLen;
+    deflateAttempt(best, orig, decomp, recompBuffer, recompSize, recompLen);
+    if (abs(static_cast<int_fast64_t>(recompLen)-static_cast<int_fast64_t>(so.streamLength))>diffLimit){
+        return;
+    }
+    best.collectDiff(recompBuffer, recompLen, orig);
+    if ((so.identBytes>0)&&(best.diffSize()>=so.diffSize())){
+        return;
+    }
+    so.identBytes=so.streamLength-best.diffByteVal.size();
+    so.clevel=best.clevel;
+    so.window=best.window;
+    so.memlvl=best.memlvl;
+    so.strategy=best.strategy;
+    so.encoder=encoder_zlib;
+    so.segmentPoints.swap(best.segmentPoints);
+    so.segmentParams.swap(best.segmentParams);
+    so.diffRunGap.swap(best.diffRunGap);
+    so.diffRunLen.swap(best.diffRunLen);
+    so.diffByteVal.swap(best.diffByteVal);
+    so.diffEnd=best.diffEnd;
+    #ifdef debug
+    std::cout<<"   "<<so.segmentPoints.size()<<" segments, "<<so.diffRunLen.size()<<" diff runs, "<<so.diffSize()<<" bytes"<<std::endl;
+    #endif // debug
+}
+
+//phase 3 for a single stream: find the zlib parameters that reproduce the stream best, the results go into so
+//orig points to the compressed stream
+void searchStream(streamOffset& so, const unsigned char* orig, searchBudget& budget, const costModel& model, int sizediffTresh, bool slowmode){
+    using std::cout;
+    using std::endl;
+    z_stream strm;
+    z_stream strm1;
+    int ret;
+    int_fast64_t identicalBytes;
+    int memlevel=9;
+    int clevel=9;
+    int window=15;
+    bool fullmatch=false;
+    bool outOfBudget=false;
+    uint64_t attempts=0;
+    std::chrono::steady_clock::time_point streamStart=std::chrono::steady_clock::now();
+    if ((so.offsetType>fdict_types)&&(so.dict==0)){//the dictionary was not found this time(a resumed run without -dict), it goes to the residue
+        #ifdef debug
+        cout<<"stream at "<<so.offset<<" has no dictionary, skipping"<<endl;
+        #endif // debug
+        return;
+    }
+    {//stored streams are recognized from their block headers and skip the parameter search entirely
+        uint64_t storedLength;
+        if (parseStoredStream(orig, so.streamLength, so.storedBlockLen, storedLength)&&(storedLength==so.inflatedLength)){
+            #ifdef debug
+            cout<<"stream at "<<so.offset<<" is stored, "<<so.storedBlockLen.size()<<" blocks"<<endl;
+            numStored++;
+            #endif // debug
+            so.clevel=0;
+            so.zlibHeader=(orig[0]<<8)|orig[1];
+            so.identBytes=so.streamLength;
+            return;
+        }
+        so.storedBlockLen.clear();
+    }
+    if (budget.fileExhausted()){//no budget left for this stream, it goes to the residue
+        #ifdef debug
+        cout<<"stream at "<<so.offset<<" skipped, the file budget is used up"<<endl;
+        #endif // debug
+        so.skipped=true;
+        budget.numSkipped++;
+        return;
+    }
+    //reset the Zlib stream to do decompression
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    fullmatch=false;
+    memlevel=9;
+    window=15;
+    //initialize the stream for decompression and check for error
+    strm.avail_in=0;
+    strm.next_in=Z_NULL;
+    if (so.dict!=0){//like inflateDictStream, raw mode so that zlib takes the dictionary
+        ret=inflateInit2(&strm, -15);
+    } else {
+        ret=inflateInit(&strm);
+    }
+    if (ret != Z_OK)
+    {
+        cout<<"inflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
+        pause();
+        abort();
+    }
+    //a buffer needs to be created to hold the resulting decompressed data
+    //since we have already deompressed the data before, we know exactly how large of a buffer we need to allocate
+    unsigned char* decompBuffer= new unsigned char[so.inflatedLength];
+    uint64_t inUsed;
+    uint64_t recompLen;
+    if (so.dict!=0){
+        inflateSetDictionary(&strm, so.dict, so.dictLength);
+        ret=zlibPump(strm, false, orig+6, so.streamLength-6, decompBuffer, so.inflatedLength, inUsed, recompLen);
+    } else {
+        ret=zlibPump(strm, false, orig, so.streamLength, decompBuffer, so.inflatedLength, inUsed, recompLen);
+    }
+    //check the return value
+    switch (ret){
+        case Z_STREAM_END: //decompression was succesful
+        {
+            #ifdef debug
+            cout<<endl;
+            cout<<"stream at "<<so.offset<<" ready for recompression trials"<<endl;
+            /*if(so.offset!=9887540){//debug code!!!! DISABLE IT UNLESS NEEDED
+                window=10;
+                clevel=1;
+                memlevel=1;
+            }*/
+            #endif // debug
+            if (slowmode){
+                #ifdef debug
+                /*cout<<"   entering slow mode"<<endl;
+                cout<<"   stream type: "<<so.offsetType<<endl;
+                pause();*/
+                #endif // debug
+                //the cost model says how far off a match can be and still be worth it, streams that cannot pay off are not searched at all
+                model.measure(so, orig, decompBuffer);
+                int64_t diffLimit=std::min(static_cast<int64_t>(sizediffTresh), model.maxDiff(so));
+                if (diffLimit<0){
+                    #ifdef debug
+                    cout<<"   not worth recompressing even with a full match, skipping the search"<<endl;
+                    #endif // debug
+                } else {
+                    //a recompressed stream that does not fit this buffer differs in size by more than diffLimit bytes,
+                    //so it cannot be used anyway and deflate() stops right there
+                    uint64_t recompSize=so.streamLength+diffLimit+1;
+                    unsigned char* recompBuffer=new unsigned char[recompSize];
+                    std::vector<searchPass> passes;
+                    int blockHint;
+                    planSearch(orig, so, passes, blockHint);
+                    bool otherFirst=(blockHint==1);
+                    if (blockHint<0){
+                        otherFirst=probeEncoders(so, orig, decompBuffer, recompBuffer, recompSize, budget, attempts, streamStart);
+                    }
+                    if (otherFirst){
+                        fullmatch=searchEncoders(so, orig, decompBuffer, recompBuffer, recompSize, diffLimit, budget, attempts, streamStart, outOfBudget);
+                    }
+                    for (uint64_t p=0; (p<passes.size())&&(!fullmatch)&&(!outOfBudget); p++){
+                        int strategy=passes[p].strategy;
+                        window=passes[p].windowHi;
+                        #ifdef debug
+                        cout<<"   strategy "<<strategy<<", window "<<passes[p].windowHi<<"-"<<passes[p].windowLo<<", clevel "<<passes[p].clevelHi<<"-"<<passes[p].clevelLo<<endl;
+                        #endif // debug
+                        do{
+                            memlevel=9;
+                            do {
+                                clevel=passes[p].clevelHi;
+                                do {
+                                    if (!budget.allowAttempt(attempts, streamStart)){//keep the best match found so far
+                                        #ifdef debug
+                                        cout<<"   out of budget after "<<attempts<<" attempts"<<endl;
+                                        #endif // debug
+                                        outOfBudget=true;
+                                        budget.numCut++;
+                                        so.cut=true;
+                                        break;
+                                    }
+                                    attempts++;
+                                    //resetting the variables
+                                    strm1.zalloc = Z_NULL;
+                                    strm1.zfree = Z_NULL;
+                                    strm1.opaque = Z_NULL;
+                                    #ifdef debug
+                                    /*cout<<"-------------------------"<<endl;
+                                    cout<<"   memlevel:"<<memlevel<<endl;
+                                    cout<<"   clevel:"<<clevel<<endl;
+                                    cout<<"   window:"<<window<<endl;*/
+                                    #endif // debug
+                                    //the strategy comes from the pass, the rest are the parameters being searched
+                                    ret = deflateInit2(&strm1, clevel, Z_DEFLATED, window, memlevel, strategy);
+                                    if (ret != Z_OK)
+                                    {
+                                        cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
+                                        pause();
+                                        abort();
+                                    }
+                                    if (so.dict!=0){
+                                        deflateSetDictionary(&strm1, so.dict, so.dictLength);
+                                    }
+                                    #ifdef debug
+                                    //cout<<"   deflate stream init done"<<endl;
+                                    #endif // debug
+    
+                                    ret=deflateFlushed(strm1, decompBuffer, so.inflatedLength, so, recompBuffer, recompSize, inUsed, recompLen);
+                                    //check the return value to see if everything went well, Z_BUF_ERROR means the stream got too long
+                                    if ((ret!=Z_STREAM_END)&&(ret!=Z_BUF_ERROR)){
+                                        cout<<"recompression failed with exit code:"<<ret<<endl;
+                                        pause();
+                                        abort();
+                                    }
+                                    #ifdef debug
+                                    //cout<<"   deflate done"<<endl;
+                                    #endif // debug
+    
+                                    //test if the recompressed stream matches the input data
+                                    if (recompLen!=so.streamLength){
+                                        identicalBytes=0;
+                                        //cout<<"   size difference: "<<(recompLen-static_cast<int64_t>(so.streamLength))<<endl;
+                                        if (abs(static_cast<int_fast64_t>(recompLen)-static_cast<int_fast64_t>(so.streamLength))>diffLimit){
+                                            #ifdef debug
+                                            cout<<"   size difference is greater than "<<diffLimit<<" bytes, not comparing"<<endl;
+                                            #endif // debug
+                                        } else {
+                                            if (recompLen<so.streamLength){
+                                                identicalBytes=countIdentical(recompBuffer, orig, recompLen);
+                                            } else {
+                                                identicalBytes=countIdentical(recompBuffer, orig, so.streamLength);
+                                            }
+                                            #ifdef debug
+                                            cout<<"   "<<identicalBytes<<" bytes out of "<<so.streamLength<<" identical"<<endl;
+                                            #endif // debug
+                                            if (identicalBytes>so.identBytes){//if this recompressed stream has more matching bytes than the previous best
+                                                so.identBytes=identicalBytes;
+                                                so.clevel=clevel;
+                                                so.memlvl=memlevel;
+                                                so.encoder=encoder_zlib;
+                                                so.window=window;
+                                                so.strategy=strategy;
+                                                so.collectDiff(recompBuffer, recompLen, orig);
+                                                #ifdef debug
+                                                cout<<"   "<<so.diffRunLen.size()<<" diff runs, "<<so.diffSize()<<" bytes"<<endl;
+                                                #endif // debug
+                                            }
+                                        }
+                                        clevel--;
+                                    } else {
+                                        #ifdef debug
+                                        cout<<"   stream sizes match, comparing"<<endl;
+                                        #endif // debug
+                                        identicalBytes=countIdentical(recompBuffer, orig, recompLen);
+                                        if (static_cast<uint64_t>(identicalBytes)==so.streamLength){
+                                            #ifdef debug
+                                            cout<<"   recompression succesful, full match"<<endl;
+                                            numFullmatch++;
+                                            #endif // debug
+                                            fullmatch=true;
+                                            so.identBytes=identicalBytes;
+                                            so.clevel=clevel;
+                                            so.memlvl=memlevel;
+                                            so.encoder=encoder_zlib;
+                                            so.window=window;
+                                            so.strategy=strategy;
+                                            so.clearDiff();
+                                        } else {
+                                            #ifdef debug
+                                            cout<<"   partial match, "<<identicalBytes<<" bytes out of "<<so.streamLength<<" identical"<<endl;
+                                            #endif // debug
+                                            if (((so.streamLength-identicalBytes)==2)&&((recompBuffer[0]-orig[0])!=0)&&((recompBuffer[1]-orig[1])!=0)){
+                                                #ifdef debug
+                                                cout<<"   2 byte header mismatch, accepting"<<endl;
+                                                numFullmatch++;
+                                                #endif // debug
+                                                fullmatch=true;
+                                            }
+                                            if (((so.streamLength-identicalBytes)==1)&&(((recompBuffer[0]-orig[0])!=0)||((recompBuffer[1]-orig[1])!=0))){
+                                                #ifdef debug
+                                                cout<<"   1 byte header mismatch, accepting"<<endl;
+                                                numFullmatch++;
+                                                #endif // debug
+                                                fullmatch=true;
+                                            }
+                                            if ((identicalBytes>so.identBytes)||fullmatch){
+                                                so.identBytes=identicalBytes;
+                                                so.clevel=clevel;
+                                                so.memlvl=memlevel;
+                                                so.encoder=encoder_zlib;
+                                                so.window=window;
+                                                so.strategy=strategy;
+                                                so.collectDiff(recompBuffer, recompLen, orig);
+                                                #ifdef debug
+                                                cout<<"   "<<so.diffRunLen.size()<<" diff runs, "<<so.diffSize()<<" bytes"<<endl;
+                                                #endif // debug
+                                            }
+                                            clevel--;
+                                        }
+                                    }
+    
+                                    //deallocate the Zlib stream and check if it went well
+                                    //Z_DATA_ERROR only means that the stream was stopped before the end because it got too long
+                                    ret=deflateEnd(&strm1);
+                                    if ((ret!=Z_OK)&&(ret!=Z_DATA_ERROR))
+                                    {
+                                        cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
+                                        pause();
+                                        abort();
+                                    }
+                                    #ifdef debug
+                                    cout<<"   deflate stream end done"<<endl;
+                                    #endif // debug
+                                } while ((!fullmatch)&&(clevel>=passes[p].clevelLo));
+                                memlevel--;
+                            } while ((!fullmatch)&&(!outOfBudget)&&(memlevel>=1));
+                            window--;
+                        } while ((!fullmatch)&&(!outOfBudget)&&(window>=passes[p].windowLo));
+                    }
+                    if ((!fullmatch)&&(!outOfBudget)&&(!otherFirst)){
+                        fullmatch=searchEncoders(so, orig, decompBuffer, recompBuffer, recompSize, diffLimit, budget, attempts, streamStart, outOfBudget);
+                    }
+                    if ((!fullmatch)&&(!outOfBudget)){
+                        segmentStream(so, orig, decompBuffer, recompBuffer, recompSize, diffLimit, budget, attempts, streamStart);
+                    }
+                    delete [] recompBuffer;
+                }
+            } else {
+            #ifdef debug
+            cout<<"   entering optimized mode"<<endl;
+            #endif // debug
+            /*switch (so.offsetType){
+                case 1:{
+                    #ifdef debug
+                    cout<<"   stream type: 1"<<endl;
+                    #endif // debug
+                    do {
+                        //resetting the variables
+                        strm1.zalloc = Z_NULL;
+                        strm1.zfree = Z_NULL;
+                        strm1.opaque = Z_NULL;
+                        strm1.next_in=decompBuffer;
+                        #ifdef debug
+                        cout<<"   memlevel:"<<memlevel<<endl;
+                        #endif // debug
+                        //use all default settings except clevel and memlevel
+                        ret = deflateInit2(&strm1, 1, Z_DEFLATED, 15, memlevel, Z_DEFAULT_STRATEGY); //only try clevel 1, 0 would be no compression, would be pointless
+                        if (ret != Z_OK)
+                        {
+                            cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
+                            pause();
+                            abort();
+                        }
+                        #ifdef debug
+                        cout<<"   deflate stream init done"<<endl;
+                        #endif // debug
+
+                        //prepare for compressing in one pass
+                        strm1.avail_in=so.inflatedLength;
+                        unsigned char* recompBuffer=new unsigned char[deflateBound(&strm1, so.inflatedLength)]; //allocate output for worst case
+                        strm1.avail_out=deflateBound(&strm1, so.inflatedLength);
+                        strm1.next_out=recompBuffer;
+                        ret=deflate(&strm1, Z_FINISH);//do the actual compression
+                        //check the return value to see if everything went well
+                        if (ret != Z_STREAM_END){
+                            cout<<"recompression failed with exit code:"<<ret<<endl;
+                            pause();
+                            abort();
+                        }
+                        #ifdef debug
+                        //cout<<"   deflate done"<<endl;
+                        #endif // debug
+
+                        //test if the recompressed stream matches the input data
+                        if (strm1.total_out!=so.streamLength){
+                            cout<<"   recompression failed, size difference"<<endl;
+                            memlevel--;
+                        } else {
+                            #ifdef debug
+                            cout<<"   stream sizes match, comparing"<<endl;
+                            #endif // debug
+                            identicalBytes=0;
+                            for (i=0; i<strm1.total_out;i++){
+                                if ((recompBuffer[i]-orig[i])==0){
+                                    identicalBytes++;
+                                }
+                            }
+                            if (identicalBytes==so.streamLength){
+                                #ifdef debug
+                                cout<<"   recompression succesful, full match"<<endl;
+                                #endif // debug
+                                fullmatch=true;
+                                numFullmatch++;
+                            } else {
+                                #ifdef debug
+                                cout<<"   partial match, "<<identicalBytes<<" bytes out of "<<so.streamLength<<" identical"<<endl;
+                                pause();
+                                #endif // debug
+                                memlevel--;
+                            }
+                        }
+
+                        //deallocate the Zlib stream and check if it went well
+                        ret=deflateEnd(&strm1);
+                        if (ret != Z_OK)
+                        {
+                            cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
+                            pause();
+                            abort();
+                        }
+                        delete [] recompBuffer;
+                        #ifdef debug
+                        cout<<"   deflate stream end done"<<endl;
+                        #endif // debug
+                    } while ((!fullmatch)&&(memlevel>=1));
+                    break;
+                }
+                case 4:{
+                    #ifdef debug
+                    cout<<"   stream type: 4"<<endl;
+                    #endif // debug
+                    do {
+                        clevel=9;
+                        do {
+                            //resetting the variables
+                            strm1.zalloc = Z_NULL;
+                            strm1.zfree = Z_NULL;
+                            strm1.opaque = Z_NULL;
+                            strm1.next_in=decompBuffer;
+                            #ifdef debug
+                            cout<<"   memlevel:"<<memlevel<<endl;
+                            cout<<"   clevel:"<<clevel<<endl;
+                            #endif // debug
+                            //use all default settings except clevel and memlevel
+                            ret = deflateInit2(&strm1, clevel, Z_DEFLATED, 15, memlevel, Z_DEFAULT_STRATEGY);
+                            if (ret != Z_OK)
+                            {
+                                cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
+                                pause();
+                                abort();
+                            }
+                            #ifdef debug
+                            cout<<"   deflate stream init done"<<endl;
+                            #endif // debug
+
+                            //prepare for compressing in one pass
+                            strm1.avail_in=so.inflatedLength;
+                            unsigned char* recompBuffer=new unsigned char[deflateBound(&strm1, so.inflatedLength)]; //allocate output for worst case
+                            strm1.avail_out=deflateBound(&strm1, so.inflatedLength);
+                            strm1.next_out=recompBuffer;
+                            ret=deflate(&strm1, Z_FINISH);//do the actual compression
+                            //check the return value to see if everything went well
+                            if (ret != Z_STREAM_END){
+                                cout<<"recompression failed with exit code:"<<ret<<endl;
+                                pause();
+                                abort();
+                            }
+                            #ifdef debug
+                            //cout<<"   deflate done"<<endl;
+                            #endif // debug
+
+                            //test if the recompressed stream matches the input data
+                            if (strm1.total_out!=so.streamLength){
+                                #ifdef debug
+                                cout<<"   recompression failed, size difference"<<endl;
+                                #endif // debug
+                                clevel--;
+                            } else {
+                                #ifdef debug
+                                cout<<"   stream sizes match, comparing"<<endl;
+                                #endif // debug
+                                identicalBytes=0;
+                                for (i=0; i<strm1.total_out;i++){
+                                    if ((recompBuffer[i]-orig[i])==0){
+                                        identicalBytes++;
+                                    }
+                                }
+                                if (identicalBytes==so.streamLength){
+                                    #ifdef debug
+                                    cout<<"   recompression succesful, full match"<<endl;
+                                    #endif // debug
+                                    fullmatch=true;
+                                    numFullmatch++;
+                                } else {
+                                    #ifdef debug
+                                    cout<<"   partial match, "<<identicalBytes<<" bytes out of "<<so.streamLength<<" identical"<<endl;
+                                    pause();
+                                    #endif // debug
+                                    clevel--;
+                                }
+                            }
+
+                            //deallocate the Zlib stream and check if it went well
+                            ret=deflateEnd(&strm1);
+                            if (ret != Z_OK)
+                            {
+                                cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
+                                pause();
+                                abort();
+                            }
+                            delete [] recompBuffer;
+                            #ifdef debug
+                            cout<<"   deflate stream end done"<<endl;
+                            #endif // debug
+                        } while ((!fullmatch)&&(clevel>=7));
+                        memlevel--;
+                    } while ((!fullmatch)&&(memlevel>=1));
+                    break;
+                }
+            }*/
+            }
+            break;
+        }
+        case Z_DATA_ERROR: //the compressed data was invalid, the phase 2 inflate backend accepted something that zlib does not
+        {
+            #ifdef debug
+            cout<<"stream at "<<so.offset<<" cannot be inflated by zlib, leaving it in the residue"<<endl;
+            #endif // debug
+            break;
+        }
+        case Z_BUF_ERROR: //this should not happen since the decompressed lengths are known
+        {
+            cout<<"inflate() failed with memory error"<<endl;
+            pause();
+            abort();
+        }
+        default: //shit hit the fan, should never happen normally
+        {
+            cout<<"inflate() failed with exit code:"<<ret<<endl;
+            pause();
+            abort();
+        }
+    }
+    //deallocate the zlib stream, check for errors and deallocate the decompression buffer
+    ret=inflateEnd(&strm);
+    if (ret!=Z_OK)
+    {
+        cout<<"inflateEnd() failed with exit code:"<<ret<<endl;//should never happen normally
+        pause();
+        abort();
+    }
+    delete [] decompBuffer;
+}
+
+//a validated stream waiting for the parameter search
+//the search works on its own copy of the compressed stream while the input buffer can still move, see searchWorker
+class searchJob{
+public:
+    searchJob(): so(0, -1, 0, 0){
+        index=0;
+        memory=0;
+    }
+    searchJob(uint64_t j, const streamTable& t): so(t.get(j)){
+        index=j;
+        memory=0;
+    }
+    uint64_t index;
+    streamOffset so;//the search result goes here, and then to the stream table
+    std::vector<unsigned char> data;
+    uint64_t memory;//what is reserved for the search in the memory budget, the worker releases it
+};
+
+//the memory the search of a stream takes besides the stream itself: the inflated data and the buffer for the recompressed data
+uint64_t searchMemory(const streamOffset& so, int sizediffTresh, bool slowmode){
+    uint64_t recompSize=so.streamLength+sizediffTresh+1;
+    if (!slowmode){
+        recompSize=so.inflatedLength+(so.inflatedLength>>10)+64;//about deflateBound()
+    }
+    return so.inflatedLength+recompSize+search_overhead;
+}
+
+//reserve the memory for the search of a job, copy is set if the job gets its own copy of the stream
+//jobs that are queued while the input is being read are reserved before they are queued, this is what holds back the scanner when the workers are busy
+//returns false if the search can never fit the budget, the stream goes to the residue then
+bool reserveSearch(searchJob& job, memoryBudget& memory, int sizediffTresh, bool slowmode, bool copy){
+    job.memory=searchMemory(job.so, sizediffTresh, slowmode)+(copy?job.so.streamLength:0);
+    if (!memory.fits(job.memory)){
+        #ifdef debug
+        std::cout<<"stream at "<<job.so.offset<<" skipped, its search does not fit the memory limit"<<std::endl;
+        #endif // debug
+        memory.numTooLarge++;
+        job.memory=0;
+        return false;
+    }
+    memory.reserve(job.memory);
+    return true;
+}
+
+//the search queue hands out the stream with the largest inflated length first, since that is where the most can be gained
+bool operator<(const searchJob& a, const searchJob& b){
+    return a.so.inflatedLength<b.so.inflatedLength;
+}
+
+//the search journal, a sidecar file(<input>.journal) that keeps the results of phase 2 and 3 so that a killed run can be resumed
+//  "ATZJ" 4, input size(8 bytes), crc32 and adler32 of the input(4 bytes each), length of the search settings(varint), the settings(see journalSettings)
+//  then records: record type(1 byte), length(varint), data, crc32 of the type and the data(4 bytes)
+//  records are only appended and flushed one by one, an incomplete record at the end is ignored, a damaged one drops the journal
+//phase 2 finds the same streams in the same order every time, so stream #n of the journal is stream #n of the rerun
+#define journal_stream 1//a stream found by phase 2: offset, streamLength, inflatedLength(varint each), offsetType(1 byte)
+#define journal_result 2//the search result of one stream: stream number(varint), clevel(1 byte), identBytes(varint),
+                        //  streamEntropy and payloadEntropy(varint each)
+                        //  clevel 0 (stored): zlib header(2 bytes), number of blocks(varint), block lengths(varint each)
+                        //  otherwise: window(1 byte, the strategy in bits 4-6), memlvl(1 byte), the encoder if memlvl is 0(see putEncoder), number of diff runs(varint),
+                        //  gap and length of the runs(varint each), diff values, flush points(see putFlushPoints),
+                        //  segments(see putSegments)
+#define journal_streams_done 3//phase 2 is complete, a rerun can skip it, no data
+
+//the settings that change the search results, a journal made with other settings is not used:
+//stream and file budget(varint each), flags(1 byte: 1 stream budget in ms, 2 file budget in ms, 4 slowmode), sizediffTresh(varint),
+//then the cost model(see costModel::putSettings)
+std::vector<unsigned char> journalSettings(const searchBudget& budget, const costModel& model, int sizediffTresh, bool slowmode){
+    std::vector<unsigned char> buf;
+    putVarint(buf, budget.streamLimit);
+    putVarint(buf, budget.fileLimit);
+    buf.push_back((budget.streamMs?1:0)|(budget.fileMs?2:0)|(slowmode?4:0));
+    putVarint(buf, sizediffTresh);
+    model.putSettings(buf);
+    return buf;
+}
+
+void putJournalResult(std::vector<unsigned char>& buf, uint64_t index, const streamOffset& so){
+    putVarint(buf, index);
+    buf.push_back(so.clevel);
+    putVarint(buf, so.identBytes);
+    putVarint(buf, so.streamEntropy);
+    putVarint(buf, so.payloadEntropy);
+    if (so.clevel==0){
+        buf.push_back(so.zlibHeader>>8);
+        buf.push_back(so.zlibHeader&255);
+        putVarint(buf, so.storedBlockLen.size());
+        for (uint64_t k=0; k<so.storedBlockLen.size(); k++){
+            putVarint(buf, so.storedBlockLen[k]);
+        }
+    } else {
+        buf.push_back(so.window|(so.strategy<<4));
+        buf.push_back(so.memlvl);
+        if (so.memlvl==0){
+            putEncoder(buf, so);
+        }
+        putVarint(buf, so.diffRunLen.size());
+        for (uint64_t k=0; k<so.diffRunLen.size(); k++){
+            putVarint(buf, so.diffRunGap[k]);
+            putVarint(buf, so.diffRunLen[k]);
+        }
+        buf.insert(buf.end(), so.diffByteVal.begin(), so.diffByteVal.end());
+        putFlushPoints(buf, so);
+        putSegments(buf, so);
+    }
+}
+
+//the journal of the current run, written by the main thread and the search workers
+//the key is only known once all the input has been read, records made before that are kept in memory until then
+class searchJournal{
+public:
+    searchJournal(){
+        enabled=false;
+        started=false;
+        resume=false;
+        streamsInFile=0;
+    }
+    bool enabled;
+    bool started;
+    bool resume;//append to the journal of an earlier run instead of starting a new one
+    uint64_t streamsInFile;//streams that are already in the journal of the earlier run
+    std::ofstream f;
+    std::string name;
+    std::vector<unsigned char> settings;//see journalSettings
+    std::vector<unsigned char> pending;
+    std::mutex lock;
+    void addRecord(uint8_t type, const std::vector<unsigned char>& data){
+        if (!enabled) return;
+        std::lock_guard<std::mutex> l(lock);
+        uint32_t crc=crcBytes(crcBytes(0, &type, 1), data.data(), data.size());
+        if (!started){
+            pending.push_back(type);
+            putVarint(pending, data.size());
+            pending.insert(pending.end(), data.begin(), data.end());
+            putCrc(pending, crc);
+            return;
+        }
+        f.write(reinterpret_cast<const char*>(&type), 1);
+        writeVarint(f, data.size());
+        f.write(reinterpret_cast<const char*>(data.data()), data.size());
+        f.write(reinterpret_cast<const char*>(&crc), 4);
+        f.flush();
+        if (!f){
+            std::cout<<"error: writing the journal failed"<<std::endl;
+            abort();
+        }
+    }
+    //open the journal once the key is known and write out what has been kept in memory
+    void start(uint64_t size, uint32_t crc, uint32_t adler){
+        if (!enabled) return;
+        std::lock_guard<std::mutex> l(lock);
+        if (resume){
+            f.open(name.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+        } else {
+            f.open(name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        }
+        if (!f.is_open()){
+            std::cout<<"error: open journal for output failed!"<<std::endl;
+            pause();
+            abort();
+        }
+        if (!resume){
+            unsigned char head[5]={65, 84, 90, 74, 4};
+            f.write(reinterpret_cast<char*>(head), 5);
+            f.write(reinterpret_cast<char*>(&size), 8);
+            f.write(reinterpret_cast<char*>(&crc), 4);
+            f.write(reinterpret_cast<char*>(&adler), 4);
+            writeVarint(f, settings.size());
+            f.write(reinterpret_cast<char*>(settings.data()), settings.size());
+        }
+        f.write(reinterpret_cast<char*>(pending.data()), pending.size());
+        f.flush();
+        pending.clear();
+        started=true;
+    }
+    //start the journal if the reader is done
+    void startWhenRead(inputBuffer& in){
+        if ((!enabled)||started) return;
+        {
+            std::lock_guard<std::mutex> l(in.lock);
+            if (!in.done) return;
+        }
+        start(in.data.size(), in.crc, in.adler);
+    }
+    void addStream(uint64_t index, const streamTable& t){
+        if (index<streamsInFile) return;
+        std::vector<unsigned char> rec;
+        putVarint(rec, t.offset[index]);
+        putVarint(rec, t.streamLength[index]);
+        putVarint(rec, t.inflatedLength[index]);
+        rec.push_back(t.offsetType[index]);
+        addRecord(journal_stream, rec);
+    }
+    void addResult(uint64_t index, const streamOffset& so){
+        std::vector<unsigned char> rec;
+        putJournalResult(rec, index, so);
+        addRecord(journal_result, rec);
+    }
+};
+
+//load the journal left by an earlier run on an input of the given size, returns false if there is no usable journal
+//a damaged record makes the whole journal unusable, the run starts over then, and so does a journal made with other settings
+//list gets the streams with their search results, the model decides again which ones are recompressed
+//searched marks the ones that have a result, streamsDone is set if the earlier run got through phase 2
+bool loadJournal(const char* name, uint64_t size, const std::vector<unsigned char>& settings, uint32_t& crc, uint32_t& adler, const costModel& model,
+                 streamTable& list, std::vector<bool>& searched, bool& streamsDone){
+    std::ifstream f(name, std::ios::in | std::ios::binary);
+    if (!f.is_open()) return false;
+    std::vector<unsigned char> buf((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    uint64_t jsize;
+    if ((buf.size()<21)||(buf[0]!=65)||(buf[1]!=84)||(buf[2]!=90)||(buf[3]!=74)||(buf[4]!=4)) return false;
+    memcpy(&jsize, &buf[5], 8);
+    memcpy(&crc, &buf[13], 4);
+    memcpy(&adler, &buf[17], 4);
+    if (jsize!=size) return false;
+    uint64_t pos=21;
+    uint64_t settingsLen;
+    if ((!readVarint(buf.data(), pos, buf.size(), settingsLen))||(settingsLen>(buf.size()-pos))) return false;
+    if ((settingsLen!=settings.size())||(memcmp(buf.data()+pos, settings.data(), settingsLen)!=0)){
+        std::cout<<name<<" was made with other search settings, starting over"<<std::endl;
+        return false;
+    }
+    pos=pos+settingsLen;
+    streamsDone=false;
+    while (pos<buf.size()){
+        uint8_t type=buf[pos];
+        pos++;
+        //an incomplete record at the end is what a killed run leaves behind, it is simply dropped
+        uint64_t len=0;
+        int shift=0;
+        while ((pos<buf.size())&&(shift<63)&&(buf[pos]&128)){
+            len=len|(static_cast<uint64_t>(buf[pos]&127)<<shift);
+            shift=shift+7;
+            pos++;
+        }
+        if ((pos>=buf.size())||(buf[pos]&128)) break;
+        len=len|(static_cast<uint64_t>(buf[pos])<<shift);
+        pos++;
+        if ((len>buf.size())||((pos+len+4)>buf.size())) break;
+        uint64_t end=pos+len;
+        uint32_t recordCrc;
+        memcpy(&recordCrc, &buf[end], 4);
+        if (crcBytes(crcBytes(0, &type, 1), buf.data()+pos, len)!=recordCrc) return false;
+        if (type==journal_stream){
+            uint64_t offset;
+            uint64_t streamLength;
+            uint64_t inflatedLength;
+            if ((!readVarint(buf.data(), pos, end, offset))||(!readVarint(buf.data(), pos, end, streamLength))||
+                (!readVarint(buf.data(), pos, end, inflatedLength))||(pos>=end)) return false;
+            if ((offset>size)||(streamLength>(size-offset))) return false;
+            list.add(offset, buf[pos], streamLength, inflatedLength);
+            searched.push_back(false);
+        }
+        if (type==journal_result){
+            uint64_t index;
+            if ((!readVarint(buf.data(), pos, end, index))||(index>=list.size())||(pos>=end)) return false;
+            streamOffset so=list.get(index);
+            so.clevel=buf[pos];
+            pos++;
+            uint64_t identBytes;
+            if ((!readVarint(buf.data(), pos, end, identBytes))||(!readVarint(buf.data(), pos, end, so.streamEntropy))||
+                (!readVarint(buf.data(), pos, end, so.payloadEntropy))) return false;
+            so.identBytes=identBytes;
+            so.clearDiff();
+            so.storedBlockLen.clear();
+            if (so.clevel==0){
+                if ((pos+2)>end) return false;
+                so.zlibHeader=(buf[pos]<<8)|buf[pos+1];
+                pos=pos+2;
+                uint64_t nblocks;
+                if ((!readVarint(buf.data(), pos, end, nblocks))||(nblocks>(end-pos))) return false;
+                for (uint64_t k=0; k<nblocks; k++){
+                    uint64_t blockLen;
+                    if ((!readVarint(buf.data(), pos, end, blockLen))||(blockLen>65535)) return false;
+                    so.storedBlockLen.push_back(blockLen);
+                }
+            } else {
+                if ((pos+2)>end) return false;
+                so.window=buf[pos]&15;
+                so.strategy=buf[pos]>>4;
+                so.memlvl=buf[pos+1];
+                pos=pos+2;
+                if (so.memlvl==0){//a stream made by another encoder is searched again if this build does not have the same one
+                    if (!readEncoder(buf.data(), pos, end, so)) return false;
+                    const deflateEncoder* e=encoderById(so.encoder);
+                    if ((e==0)||(e->version()!=so.encoderVersion)){
+                        pos=end+4;
+                        continue;
+                    }
+                }
+                uint64_t nruns;
+                if ((!readVarint(buf.data(), pos, end, nruns))||(nruns>((end-pos)/2))) return false;//every run takes at least 2 bytes
+                std::vector<uint64_t> gap(nruns);
+                std::vector<uint64_t> runlen(nruns);
+                uint64_t nvals=0;
+                for (uint64_t k=0; k<nruns; k++){
+                    if ((!readVarint(buf.data(), pos, end, gap[k]))||(!readVarint(buf.data(), pos, end, runlen[k]))) return false;
+                    if (runlen[k]>(end-pos)) return false;
+                    nvals=nvals+runlen[k];
+                }
+                if (nvals>(end-pos)) return false;
+                uint64_t runpos=0;
+                for (uint64_t k=0; k<nruns; k++){
+                    runpos=runpos+gap[k];
+                    so.addDiffRun(runpos, buf.data()+pos, runlen[k]);
+                    pos=pos+runlen[k];
+                    runpos=runpos+runlen[k];
+                }
+                if ((pos<end)&&(!readFlushPoints(buf.data(), pos, end, so))) return false;//journals from before the flush points end here
+                if ((pos<end)&&(!readSegments(buf.data(), pos, end, so))) return false;//and journals from before the segments here
+            }
+            so.recomp=model.recompress(so);
+            list.store(index, so);
+            searched[index]=true;
+        }
+        if (type==journal_streams_done){
+            streamsDone=true;
+        }
+        pos=end+4;
+    }
+    return true;
+}
+
+//hand a stream to the search workers while the input is being read, with its own copy of the stream
+//waits until the memory budget has room for its search(see reserveSearch), a search that can never fit is not queued at all
+void queueSearch(boundedQueue<searchJob>& jobs, searchJob& job, inputBuffer& in, memoryBudget& memory, int sizediffTresh, bool slowmode){
+    if (!reserveSearch(job, memory, sizediffTresh, slowmode, true)) return;
+    {
+        std::lock_guard<std::mutex> l(in.lock);
+        job.data.assign(in.data.begin()+job.so.offset, in.data.begin()+job.so.offset+job.so.streamLength);
+    }
+    jobs.push(job);
+}
+
+//search stage: run phase 3 on the streams coming from the scanner until the queue is closed
+//source is the input if it does not move any more, the jobs have no copy of their stream then and are reserved(see reserveSearch) here
+void searchWorker(boundedQueue<searchJob>* jobs, streamTable* table, const unsigned char* source, searchBudget* budget, memoryBudget* memory,
+                  const costModel* model, searchJournal* journal, int sizediffTresh, bool slowmode){
+    searchJob job;
+    while (jobs->pop(job)){
+        const unsigned char* orig=job.data.data();
+        if (source!=0){
+            if (!reserveSearch(job, *memory, sizediffTresh, slowmode, false)) continue;
+            orig=source+job.so.offset;
+        }
+        searchStream(job.so, orig, *budget, *model, sizediffTresh, slowmode);
+        job.so.recomp=(!job.so.skipped)&&model->recompress(job.so);
+        table->store(job.index, job.so);
+        if ((!job.so.skipped)&&(!job.so.cut)){//streams skipped or cut short by the budget are searched again in the next run
+            journal->addResult(job.index, job.so);
+        }
+        std::vector<unsigned char>().swap(job.data);
+        memory->release(job.memory);
+    }
+}
+
+//estimate mode(-estimate [n]): phase 1 and 2 run on the whole file, phase 3 only on a sample of about n streams,
+//and the totals of the whole file are extrapolated from the sample
+//the sample is stratified by stream length, since the gain of a stream grows with its size:
+//the streams are put in size classes(under 1KB, then each class 4 times the one before), and every class gets a share of the sample
+//in proportion to its total stream length, with at least 2 streams so that its variance can be estimated
+class sampleStratum{
+public:
+    std::vector<uint64_t> members;
+    std::vector<uint64_t> sample;
+};
+
+std::vector<sampleStratum> pickSample(const streamTable& list, uint64_t n){
+    std::vector<sampleStratum> strata;
+    uint64_t totalLength=0;
+    for (uint64_t j=0; j<list.size(); j++){
+        uint64_t sizeClass=0;
+        for (uint64_t len=list.streamLength[j]; len>=1024; len=len/4){
+            sizeClass++;
+        }
+        if (sizeClass>=strata.size()){
+            strata.resize(sizeClass+1);
+        }
+        strata[sizeClass].members.push_back(j);
+        totalLength=totalLength+list.streamLength[j];
+    }
+    std::mt19937_64 rng(estimate_seed);//a fixed seed, so that the same file always gives the same estimate
+    std::vector<uint64_t> sizes(strata.size(), 0);//the sample size of every stratum
+    uint64_t given=0;
+    for (uint64_t h=0; h<strata.size(); h++){
+        std::vector<uint64_t>& m=strata[h].members;
+        if (m.empty()) continue;
+        uint64_t stratumLength=0;
+        for (uint64_t k=0; k<m.size(); k++){
+            stratumLength=stratumLength+list.streamLength[m[k]];
+        }
+        sizes[h]=static_cast<uint64_t>(std::ceil(static_cast<double>(n)*stratumLength/totalLength));
+        sizes[h]=std::min(std::max(sizes[h], static_cast<uint64_t>(2)), static_cast<uint64_t>(m.size()));
+        if (n>=list.size()){//the sample is the whole file
+            sizes[h]=m.size();
+        }
+        given=given+sizes[h];
+    }
+    //the small strata can have fewer members than their share, what they leave goes to the strata that still have unsampled members,
+    //one stream at a time, largest streams first
+    bool room=true;
+    while ((given<n)&&room){
+        room=false;
+        for (uint64_t h=strata.size(); (h>0)&&(given<n); h--){
+            if (sizes[h-1]<strata[h-1].members.size()){
+                sizes[h-1]++;
+                given++;
+                room=true;
+            }
+        }
+    }
+    for (uint64_t h=0; h<strata.size(); h++){
+        //partial Fisher-Yates shuffle, the first sizes[h] members are the sample
+        std::vector<uint64_t> order(strata[h].members);
+        for (uint64_t k=0; k<sizes[h]; k++){
+            std::swap(order[k], order[k+rng()%(order.size()-k)]);
+        }
+        strata[h].sample.assign(order.begin(), order.begin()+sizes[h]);
+        std::sort(strata[h].sample.begin(), strata[h].sample.end());
+    }
+    return strata;
+}
+
+//stratified estimate of the total of y over all the streams, y is only looked at for the sampled streams
+//halfWidth is the half width of the 95% confidence interval
+void estimateTotal(const std::vector<sampleStratum>& strata, const std::vector<double>& y, double& total, double& halfWidth){
+    double variance=0;
+    total=0;
+    for (uint64_t h=0; h<strata.size(); h++){
+        double nh=strata[h].sample.size();
+        double Nh=strata[h].members.size();
+        if (nh==0) continue;
+        double mean=0;
+        for (uint64_t k=0; k<strata[h].sample.size(); k++){
+            mean=mean+y[strata[h].sample[k]];
+        }
+        mean=mean/nh;
+        total=total+Nh*mean;
+        if (nh<Nh){//a stratum that was searched completely is known exactly
+            double s2=0;
+            for (uint64_t k=0; k<strata[h].sample.size(); k++){
+                s2=s2+(y[strata[h].sample[k]]-mean)*(y[strata[h].sample[k]]-mean);
+            }
+            s2=s2/(nh-1);
+            variance=variance+Nh*Nh*(1-nh/Nh)*s2/nh;
+        }
+    }
+    halfWidth=1.96*std::sqrt(variance);
+}
+
+//the inflated data of a recompressed stream, out has room for inflatedLength bytes
+void inflatePayload(inflateBackend& backend, const streamOffset& so, const unsigned char* rBuffer, unsigned char* out){
+    if (so.clevel==0){//stored stream, the inflated data is just the contents of the blocks, no need to inflate
+        uint64_t blockos=so.offset+2;
+        uint64_t pos=0;
+        for (uint64_t i=0; i<so.storedBlockLen.size(); i++){
+            memcpy(out+pos, rBuffer+blockos+5, so.storedBlockLen[i]);
+            pos=pos+so.storedBlockLen[i];
+            blockos=blockos+5+so.storedBlockLen[i];
+        }
+        return;
+    }
+    int ret;
+    if (so.dict!=0){
+        ret=inflateDictStream(rBuffer+so.offset, so.streamLength, so.dict, so.dictLength, out, so.inflatedLength);
+    } else {
+        ret=backend.inflateWhole(rBuffer+so.offset, so.streamLength, out, so.inflatedLength);
+    }
+    if (ret!=Z_STREAM_END){//shit hit the fan, should never happen normally
+        std::cout<<"inflating the stream at "<<so.offset<<" failed with exit code:"<<ret<<std::endl;
+        pause();
+        abort();
+    }
+}
+
+//the payload group(payload_*) of a recompressed stream, picked from the first payload_sample bytes of its inflated data
+//nested is set if the payload is a nested ATZ image(see -depth)
+int payloadGroup(const streamOffset& so, const unsigned char* rBuffer, bool nested){
+    if (nested) return payload_nested;
+    std::vector<unsigned char> sample(std::min(so.inflatedLength, static_cast<uint64_t>(payload_sample)));
+    if (so.clevel==0){//stored stream, the sample is in the blocks
+        uint64_t blockos=so.offset+2;
+        uint64_t pos=0;
+        for (uint64_t i=0; (i<so.storedBlockLen.size())&&(pos<sample.size()); i++){
+            uint64_t n=std::min(static_cast<uint64_t>(so.storedBlockLen[i]), sample.size()-pos);
+            memcpy(sample.data()+pos, rBuffer+blockos+5, n);
+            pos=pos+n;
+            blockos=blockos+5+so.storedBlockLen[i];
+        }
+    } else {//inflate just the start, raw like inflateDictStream so that the dictionary can be set without a check
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        strm.avail_in=0;
+        strm.next_in=Z_NULL;
+        int ret=inflateInit2(&strm, -15);
+        if (ret != Z_OK)
+        {
+            std::cout<<"inflateInit2() failed with exit code:"<<ret<<std::endl;
+            pause();
+            abort();
+        }
+        uint64_t header=2;
+        if (so.dict!=0){
+            inflateSetDictionary(&strm, so.dict, so.dictLength);
+            header=6;
+        }
+        uint64_t inUsed;
+        uint64_t outUsed;
+        zlibPump(strm, false, rBuffer+so.offset+header, so.streamLength-header, sample.data(), sample.size(), inUsed, outUsed);
+        inflateEnd(&strm);
+        sample.resize(outUsed);
+    }
+    if (sample.empty()) return payload_binary;
+    uint64_t text=0;
+    for (uint64_t k=0; k<sample.size(); k++){
+        if (((sample[k]>=32)&&(sample[k]<127))||(sample[k]==9)||(sample[k]==10)||(sample[k]==13)) text++;
+    }
+    if ((text*10)>=(sample.size()*9)) return payload_text;
+    if ((entropyBytes(sample.data(), sample.size())*8)>(sample.size()*payload_dense_bits)) return payload_dense;
+    return payload_binary;
+}
+
+//the content key of a compressed stream, archives(see -archive) use it to find the streams they already have
+uint64_t streamKey(const unsigned char* buf, uint64_t len){
+    uint64_t crc=crc32(0, Z_NULL, 0);
+    for (uint64_t pos=0; pos<len; pos=pos+zlib_chunk){
+        crc=crc32(crc, buf+pos, std::min(len-pos, static_cast<uint64_t>(zlib_chunk)));
+    }
+    return (crc<<32)|adler32Simd(1, buf, len);
+}
+
+//what an archive member has besides the ATZ2 data, one entry per stream of the member
+class archiveMember{
+public:
+    std::vector<uint64_t> keys;//see streamKey
+    std::vector<uint64_t> sharedPos;//where the payload is in the archive if an earlier member has it, 0 if not
+    std::vector<uint64_t> sharedNested;//the nestedLength of a shared payload
+};
+
+//the inflated data of a recompressed stream that does not fit the memory budget, payload_chunk bytes at a time
+//every piece goes to out as a payload of its own, crc gets the crc32 of the whole payload
+void inflatePieces(const streamOffset& so, const unsigned char* rBuffer, memoryBudget* memory, uint32_t& crc, boundedQueue<std::vector<unsigned char> >* out){
+    crc=0;
+    if (so.clevel==0){//stored stream, the pieces are put together from the blocks
+        uint64_t blockos=so.offset+2;
+        uint64_t i=0;
+        uint64_t inBlock=0;//what is taken from block i already
+        for (uint64_t pos=0; pos<so.inflatedLength; ){
+            uint64_t len=std::min(so.inflatedLength-pos, static_cast<uint64_t>(payload_chunk));
+            memory->reserve(len);
+            std::vector<unsigned char> piece(len);
+            for (uint64_t done=0; done<len; ){
+                uint64_t n=std::min(static_cast<uint64_t>(so.storedBlockLen[i])-inBlock, len-done);
+                memcpy(piece.data()+done, rBuffer+blockos+5+inBlock, n);
+                done=done+n;
+                inBlock=inBlock+n;
+                if (inBlock==so.storedBlockLen[i]){
+                    blockos=blockos+5+so.storedBlockLen[i];
+                    i++;
+                    inBlock=0;
+                }
+            }
+            crc=crcBytes(crc, piece.data(), len);
+            pos=pos+len;
+            out->push(piece);
+        }
+        return;
+    }
+    //raw like inflateDictStream, so that the dictionary can be set without a check
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.avail_in=0;
+    strm.next_in=Z_NULL;
+    int ret=inflateInit2(&strm, -15);
+    if (ret != Z_OK)
+    {
+        std::cout<<"inflateInit2() failed with exit code:"<<ret<<std::endl;
+        pause();
+        abort();
+    }
+    uint64_t inPos=2;
+    if (so.dict!=0){
+        inflateSetDictionary(&strm, so.dict, so.dictLength);
+        inPos=6;
+    }
+    for (uint64_t pos=0; pos<so.inflatedLength; ){
+        uint64_t len=std::min(so.inflatedLength-pos, static_cast<uint64_t>(payload_chunk));
+        memory->reserve(len);
+        std::vector<unsigned char> piece(len);
+        uint64_t inUsed;
+        uint64_t outUsed;
+        ret=zlibPump(strm, false, rBuffer+so.offset+inPos, so.streamLength-inPos, piece.data(), len, inUsed, outUsed);
+        if (((ret!=Z_STREAM_END)&&(ret!=Z_BUF_ERROR))||(outUsed!=len)){//should never happen, phase 2 inflated it already
+            std::cout<<"inflating the stream at "<<so.offset<<" failed with exit code:"<<ret<<std::endl;
+            pause();
+            abort();
+        }
+        inPos=inPos+inUsed;
+        crc=crcBytes(crc, piece.data(), len);
+        pos=pos+len;
+        out->push(piece);
+    }
+    inflateEnd(&strm);
+}
+
+//writer stage helper: inflate the payloads of the recompressed streams group by group, in stream order within a group, the main thread writes them out
+//group has the payload group of every stream(see atzsec_groups), the streams with a nested ATZ image get the image instead,
+//and the shared payloads of an archive member are left out, crc gets the crc32 of every payload(see atzsec_checksums)
+//every payload is reserved in memory before it is made, the writer releases it once it is written
+void inflatePayloads(const streamTable* list, const unsigned char* rBuffer, const std::vector<std::vector<unsigned char> >* nested, const archiveMember* member,
+                     const std::vector<unsigned char>* group, memoryBudget* memory, std::vector<uint32_t>* crc, boundedQueue<std::vector<unsigned char> >* out){
+    inflateBackend backend;
+    for (int g=0; g<payload_groups; g++){
+        for (uint64_t j=0; j<list->size(); j++){
+            if ((!list->recomp(j))||((*group)[j]!=g)) continue;
+            if ((member!=0)&&(member->sharedPos[j]>0)) continue;
+            #ifdef debug
+            std::cout<<"recompressing stream #"<<j<<std::endl;
+            #endif // debug
+            if ((j<nested->size())&&(!(*nested)[j].empty())){
+                memory->reserve((*nested)[j].size());
+                std::vector<unsigned char> image((*nested)[j]);
+                (*crc)[j]=crcBytes(0, image.data(), image.size());
+                out->push(image);
+                continue;
+            }
+            streamOffset so=list->get(j);
+            if (!memory->fits(so.inflatedLength)){
+                inflatePieces(so, rBuffer, memory, (*crc)[j], out);
+                continue;
+            }
+            memory->reserve(so.inflatedLength);
+            std::vector<unsigned char> payload(so.inflatedLength);
+            inflatePayload(backend, so, rBuffer, payload.data());
+            (*crc)[j]=crcBytes(0, payload.data(), payload.size());
+            out->push(payload);
+        }
+    }
+    out->close();
+}
+
+//write len bytes of the residue and add them to the crc32 of their pieces(see atzsec_checksums)
+//pos is where buf goes in the residue section, starts has the position of every piece in it
+void writeResidue(std::ostream& atzout, const unsigned char* buf, uint64_t len, uint64_t& pos, const std::vector<uint64_t>& starts, std::vector<uint32_t>& crc){
+    atzout.write(reinterpret_cast<const char*>(buf), len);
+    while (len>0){
+        uint64_t piece=(std::upper_bound(starts.begin(), starts.end(), pos)-starts.begin())-1;
+        uint64_t n=len;
+        if ((piece+1)<starts.size()){
+            n=std::min(n, starts[piece+1]-pos);
+        }
+        crc[piece]=crcBytes(crc[piece], buf, n);
+        buf=buf+n;
+        pos=pos+n;
+        len=len-n;
+    }
+}
+
+//PHASE 4: write the ATZ file(see the ATZ2 layout at the top) of the data in rBuffer, with the search results in streams
+//nested has the nested ATZ images of the payloads(see -depth), it is empty or has an entry for every stream, empty for the ones without an image
+//member is set for archive members, 0 otherwise, the payloads are inflated within memory(see memoryBudget)
+//returns the length of the ATZ file
+uint64_t writeAtz(std::ostream& atzout, const streamTable& streams, const unsigned char* rBuffer, uint64_t infileSize, const std::vector<std::vector<unsigned char> >& nested,
+                  const archiveMember* member, memoryBudget& memory){
+    uint64_t lastos=0;
+    uint64_t lastlen=0;
+    uint64_t atzlen;
+    std::vector<uint64_t> checkpoints;//the index is built along with the stream table, but it is written after the residue
+    std::vector<unsigned char> streamGroup(streams.size(), 0);//the payload group of every stream, for the inflater
+    std::vector<unsigned char> checksumSec;//the records are checksummed along with the table, the rest is filled in as it is written
+    std::vector<uint64_t> payloadCrcPos(streams.size(), 0);//where the crc32 of the payload of every stream goes in checksumSec
+    std::vector<uint32_t> payloadCrc(streams.size(), 0);
+    std::vector<uint64_t> residueStarts;
+    std::vector<uint32_t> residueCrc;
+    uint64_t residuePos=0;
+    uint32_t sectionCrc[4]={0, 0, 0, 0};//the index, dicts, groups and keys sections
+    boundedQueue<std::vector<unsigned char> > payloads(payload_queue_len);
+    {
+        //the metadata is small, so the sections are built in memory and written in one go
+        std::vector<unsigned char> tableSec;
+        std::vector<unsigned char> diffRunSec;
+        std::vector<unsigned char> diffValSec;
+        std::vector<uint64_t> keySec;
+        std::vector<unsigned char> dictSec;
+        std::map<const unsigned char*, uint64_t> dictNumber;//the dictionaries that are used, numbered in the order of their first stream
+        std::vector<unsigned char> groupSec;//the group of every recompressed stream, the rest of the section is added at the end
+        std::vector<uint64_t> groupCheckpoints;//the payloads of every group before each checkpoint
+        uint64_t groupLen[payload_groups]={0};
+        uint64_t payloadLen=0;
+        uint64_t residueLen=infileSize;
+        uint64_t nrecomp=0;
+        for(uint64_t j=0;j<streams.size();j++){
+            if (streams.recomp(j)){
+                streamOffset so=streams.get(j);
+                if (j<nested.size()){
+                    so.nestedLength=nested[j].size();
+                }
+                if (member!=0){
+                    so.sharedPos=member->sharedPos[j];
+                    if (so.sharedPos>0){
+                        so.nestedLength=member->sharedNested[j];
+                    }
+                    keySec.push_back(member->keys[j]);
+                }
+                if ((nrecomp%atz_index_interval)==0){//index checkpoint, see atzsec_index
+                    checkpoints.push_back(lastos+lastlen);
+                    checkpoints.push_back(tableSec.size());
+                    checkpoints.push_back(diffRunSec.size());
+                    checkpoints.push_back(diffValSec.size());
+                    checkpoints.push_back(payloadLen);
+                    checkpoints.push_back((lastos+lastlen)-(infileSize-residueLen));
+                    groupCheckpoints.insert(groupCheckpoints.end(), groupLen, groupLen+payload_groups);
+                }
+                nrecomp++;
+                uint64_t recordStart[3]={tableSec.size(), diffRunSec.size(), diffValSec.size()};
+                putVarint(tableSec, so.offset-(lastos+lastlen));
+                putVarint(tableSec, so.streamLength);
+                putVarint(tableSec, zigzag(so.inflatedLength-so.streamLength));
+                tableSec.push_back(so.clevel|((so.nestedLength>0)?atz_nested:0)|((so.sharedPos>0)?atz_shared:0)|((so.dict!=0)?atz_dict:0)|(so.flushPoints.empty()?0:atz_flush));
+                if (so.clevel==0){//stored stream
+                    tableSec.push_back(so.zlibHeader>>8);
+                    tableSec.push_back(so.zlibHeader&255);
+                    putVarint(tableSec, so.storedBlockLen.size());
+                    for (uint64_t i=0; i<so.storedBlockLen.size(); i++){
+                        putVarint(tableSec, so.storedBlockLen[i]);
+                    }
+                } else {
+                    tableSec.push_back(so.window|(so.strategy<<4)|(so.segmentPoints.empty()?0:atz_segments));
+                    tableSec.push_back(so.memlvl);
+                    if (so.memlvl==0){
+                        putEncoder(tableSec, so);
+                    }
+                    putVarint(tableSec, so.diffRunLen.size());
+                    for (uint64_t i=0; i<so.diffRunLen.size(); i++){
+                        putVarint(diffRunSec, so.diffRunGap[i]);
+                        putVarint(diffRunSec, so.diffRunLen[i]);
+                    }
+                    diffValSec.insert(diffValSec.end(), so.diffByteVal.begin(), so.diffByteVal.end());
+                    if (so.dict!=0){
+                        if (dictNumber.count(so.dict)==0){
+                            uint64_t n=dictNumber.size();
+                            dictNumber[so.dict]=n;
+                            putVarint(dictSec, so.dictLength);
+                            dictSec.insert(dictSec.end(), so.dict, so.dict+so.dictLength);
+                        }
+                        putVarint(tableSec, dictNumber[so.dict]);
+                    }
+                    if (!so.flushPoints.empty()){
+                        putFlushPoints(tableSec, so);
+                    }
+                    if (!so.segmentPoints.empty()){
+                        putSegments(tableSec, so);
+                    }
+                }
+                if (so.nestedLength>0){
+                    putVarint(tableSec, so.nestedLength);
+                }
+                if (so.sharedPos>0){
+                    putVarint(tableSec, so.sharedPos);
+                    groupSec.push_back(0);
+                } else {
+                    payloadLen=payloadLen+so.payloadLength();
+                    groupSec.push_back(payloadGroup(so, rBuffer, so.nestedLength>0));
+                    groupLen[groupSec.back()]=groupLen[groupSec.back()]+so.payloadLength();
+                }
+                streamGroup[j]=groupSec.back();
+                putVarint(checksumSec, tableSec.size()-recordStart[0]);
+                putVarint(checksumSec, diffRunSec.size()-recordStart[1]);
+                putVarint(checksumSec, diffValSec.size()-recordStart[2]);
+                uint32_t crc=crcBytes(0, tableSec.data()+recordStart[0], tableSec.size()-recordStart[0]);
+                crc=crcBytes(crc, diffRunSec.data()+recordStart[1], diffRunSec.size()-recordStart[1]);
+                crc=crcBytes(crc, diffValSec.data()+recordStart[2], diffValSec.size()-recordStart[2]);
+                putCrc(checksumSec, crc);
+                payloadCrcPos[j]=checksumSec.size();
+                putCrc(checksumSec, 0);
+                residueLen=residueLen-so.streamLength;
+                lastos=so.offset;
+                lastlen=so.streamLength;
+            }
+        }
+        lastos=0;
+        lastlen=0;
+        if (!dictNumber.empty()){
+            std::vector<unsigned char> count;
+            putVarint(count, dictNumber.size());
+            dictSec.insert(dictSec.begin(), count.begin(), count.end());
+        }
+        int usedGroups=0;
+        uint64_t groupStart[payload_groups];
+        for (int g=0; g<payload_groups; g++){
+            groupStart[g]=(g==0)?0:(groupStart[g-1]+groupLen[g-1]);
+            if (groupLen[g]>0) usedGroups++;
+        }
+        if (usedGroups>1){
+            std::vector<unsigned char> count;
+            putVarint(count, payload_groups);
+            groupSec.insert(groupSec.begin(), count.begin(), count.end());
+            for (uint64_t i=0; i<groupCheckpoints.size(); i++){
+                uint64_t pos=groupStart[i%payload_groups]+groupCheckpoints[i];
+                groupSec.insert(groupSec.end(), reinterpret_cast<unsigned char*>(&pos), reinterpret_cast<unsigned char*>(&pos)+8);
+            }
+        } else {//a single group is just stream order
+            groupSec.clear();
+        }
+        #ifdef debug
+        std::cout<<"stream table: "<<tableSec.size()<<" bytes"<<std::endl;
+        std::cout<<"diff runs: "<<diffRunSec.size()<<" bytes"<<std::endl;
+        std::cout<<"diff values: "<<diffValSec.size()<<" bytes"<<std::endl;
+        for (int g=0; g<payload_groups; g++){
+            std::cout<<"payload group "<<g<<": "<<groupLen[g]<<" bytes"<<std::endl;
+        }
+        #endif // debug
+
+        //the whole layout is known at this point, so atzlen can be written up front and the output never has to seek
+        atzlen=12+varintLength(infileSize)+varintLength(nrecomp)+sectionLength(tableSec.size())+sectionLength(diffRunSec.size())+sectionLength(diffValSec.size());
+        atzlen=atzlen+sectionLength(payloadLen)+sectionLength(residueLen)+sectionLength(varintLength(atz_index_interval)+checkpoints.size()*8);
+        if (member!=0){
+            atzlen=atzlen+sectionLength(keySec.size()*8);
+        }
+        if (!dictSec.empty()){
+            atzlen=atzlen+sectionLength(dictSec.size());
+        }
+        if (!groupSec.empty()){
+            atzlen=atzlen+sectionLength(groupSec.size());
+            sectionCrc[2]=crcBytes(0, groupSec.data(), groupSec.size());
+        }
+        if (!dictSec.empty()){
+            sectionCrc[1]=crcBytes(0, dictSec.data(), dictSec.size());
+        }
+        if (member!=0){
+            sectionCrc[3]=crcBytes(0, reinterpret_cast<unsigned char*>(keySec.data()), keySec.size()*8);
+        }
+        //the residue is checksummed in pieces from one index checkpoint to the next
+        residueStarts.push_back(0);
+        for (uint64_t k=1; k<(checkpoints.size()/6); k++){
+            residueStarts.push_back(checkpoints[k*6+5]);
+        }
+        residueCrc.resize(residueStarts.size(), 0);
+        atzlen=atzlen+sectionLength(checksumSec.size()+residueCrc.size()*4+5*4);
+        //write file header and version
+        unsigned char atz2[4]={65, 84, 90, 2};
+        atzout.write(reinterpret_cast<char*>(atz2), 4);
+        atzout.write(reinterpret_cast<char*>(&atzlen), 8);
+        writeVarint(atzout, infileSize);//the length of the original file
+        writeVarint(atzout, nrecomp);//number of recompressed streams
+        writeSectionHeader(atzout, atzsec_table, tableSec.size());
+        atzout.write(reinterpret_cast<char*>(tableSec.data()), tableSec.size());
+        writeSectionHeader(atzout, atzsec_diffruns, diffRunSec.size());
+        atzout.write(reinterpret_cast<char*>(diffRunSec.data()), diffRunSec.size());
+        writeSectionHeader(atzout, atzsec_diffvalues, diffValSec.size());
+        atzout.write(reinterpret_cast<char*>(diffValSec.data()), diffValSec.size());
+        if (!dictSec.empty()){
+            writeSectionHeader(atzout, atzsec_dicts, dictSec.size());
+            atzout.write(reinterpret_cast<char*>(dictSec.data()), dictSec.size());
+        }
+        if (!groupSec.empty()){
+            writeSectionHeader(atzout, atzsec_groups, groupSec.size());
+            atzout.write(reinterpret_cast<char*>(groupSec.data()), groupSec.size());
+        }
+        writeSectionHeader(atzout, atzsec_payload, payloadLen);
+        //the payloads are inflated on another thread while this one writes them
+        std::thread inflater(inflatePayloads, &streams, rBuffer, &nested, member, &streamGroup, &memory, &payloadCrc, &payloads);
+        std::vector<unsigned char> payload;
+        while (payloads.pop(payload)){
+            atzout.write(reinterpret_cast<char*>(payload.data()), payload.size());
+            memory.release(payload.size());
+            std::vector<unsigned char>().swap(payload);
+        }
+        inflater.join();
+        if (member!=0){
+            writeSectionHeader(atzout, atzsec_keys, keySec.size()*8);
+            atzout.write(reinterpret_cast<char*>(keySec.data()), keySec.size()*8);
+        }
+        writeSectionHeader(atzout, atzsec_residue, residueLen);
+    }
+
+    for(uint64_t j=0;j<streams.size();j++){//write the gaps before streams and non-recompressed streams to disk as the residue
+        if ((lastos+lastlen)==streams.offset[j]){
+            #ifdef debug
+            std::cout<<"no gap before stream #"<<j<<std::endl;
+            #endif // debug
+            if (!streams.recomp(j)){
+                #ifdef debug
+                std::cout<<"copying stream #"<<j<<std::endl;
+                #endif // debug
+                writeResidue(atzout, rBuffer+streams.offset[j], streams.streamLength[j], residuePos, residueStarts, residueCrc);
+            }
+        }else{
+            #ifdef debug
+            std::cout<<"gap of "<<(streams.offset[j]-(lastos+lastlen))<<" bytes before stream #"<<j<<std::endl;
+            #endif // debug
+            writeResidue(atzout, rBuffer+lastos+lastlen, streams.offset[j]-(lastos+lastlen), residuePos, residueStarts, residueCrc);
+            if (!streams.recomp(j)){
+                #ifdef debug
+                std::cout<<"copying stream #"<<j<<std::endl;
+                #endif // debug
+                writeResidue(atzout, rBuffer+streams.offset[j], streams.streamLength[j], residuePos, residueStarts, residueCrc);
+            }
+        }
+        lastos=streams.offset[j];
+        lastlen=streams.streamLength[j];
+    }
+    if((lastos+lastlen)<infileSize){//if there is stuff after the last stream, write that to disk too
+        #ifdef debug
+        std::cout<<(infileSize-(lastos+lastlen))<<" bytes copied from the end of the file"<<std::endl;
+        #endif // debug
+        writeResidue(atzout, rBuffer+lastos+lastlen, infileSize-(lastos+lastlen), residuePos, residueStarts, residueCrc);
+    }
+    //the index goes to the end, after the residue
+    std::vector<unsigned char> interval;
+    putVarint(interval, atz_index_interval);
+    writeSectionHeader(atzout, atzsec_index, interval.size()+checkpoints.size()*8);
+    atzout.write(reinterpret_cast<char*>(interval.data()), interval.size());
+    atzout.write(reinterpret_cast<char*>(checkpoints.data()), checkpoints.size()*8);
+    sectionCrc[0]=crcBytes(crcBytes(0, interval.data(), interval.size()), reinterpret_cast<unsigned char*>(checkpoints.data()), checkpoints.size()*8);
+    //and the checksums after it, now that the payloads and the residue are through
+    for (uint64_t j=0; j<streams.size(); j++){
+        if (payloadCrcPos[j]>0){
+            memcpy(checksumSec.data()+payloadCrcPos[j], &payloadCrc[j], 4);
+        }
+    }
+    for (uint64_t k=0; k<residueCrc.size(); k++){
+        putCrc(checksumSec, residueCrc[k]);
+    }
+    for (int k=0; k<4; k++){
+        putCrc(checksumSec, sectionCrc[k]);
+    }
+    putCrc(checksumSec, crcBytes(0, checksumSec.data(), checksumSec.size()));
+    writeSectionHeader(atzout, atzsec_checksums, checksumSec.size());
+    atzout.write(reinterpret_cast<char*>(checksumSec.data()), checksumSec.size());
+    return atzlen;
+}
+
+//the headers phase 1 looks for, in the order of their offset types(type 1 is 78 01)
+//the 512 and 256 byte window headers came after the others, so their types are at the end
+const unsigned char zlibHeaders[32][2]={{0x78, 0x01}, {0x78, 0x5E}, {0x78, 0x9C}, {0x78, 0xDA},
+                                        {0x68, 0xDE}, {0x68, 0x81}, {0x68, 0x43}, {0x68, 0x05},
+                                        {0x58, 0xC3}, {0x58, 0x85}, {0x58, 0x47}, {0x58, 0x09},
+                                        {0x48, 0xC7}, {0x48, 0x89}, {0x48, 0x4B}, {0x48, 0x0D},
+                                        {0x38, 0xCB}, {0x38, 0x8D}, {0x38, 0x4F}, {0x38, 0x11},
+                                        {0x28, 0xCF}, {0x28, 0x91}, {0x28, 0x53}, {0x28, 0x15},
+                                        {0x18, 0x19}, {0x18, 0x57}, {0x18, 0x95}, {0x18, 0xD3},
+                                        {0x08, 0x1D}, {0x08, 0x5B}, {0x08, 0x99}, {0x08, 0xD7}};
+
+//the offset type of a zlib header, 0 if phase 1 does not look for it
+int headerType(unsigned char cmf, unsigned char flg){
+    if (((cmf&15)!=8)||(cmf>0x78)) return 0;
+    int first=(7-(cmf>>4))*4;
+    for (int k=first; k<(first+4); k++){
+        if (zlibHeaders[k][1]==flg) return k+1;
+    }
+    return 0;
+}
+
+//the offset type of a zlib header with a preset dictionary, 0 if it is not one
+//the types come after fdict_types in the order of zlibHeaders, one for every window and flevel since two of them have two valid check values
+int fdictType(unsigned char cmf, unsigned char flg){
+    if (((cmf&15)!=8)||(cmf>0x78)||((flg&0x20)==0)||((((cmf<<8)|flg)%31)!=0)) return 0;
+    return fdict_types+(7-(cmf>>4))*4+(flg>>6)+1;
+}
+
+//finds the preset dictionaries of the streams with the FDICT flag, a dictionary is known by its adler32, which is the dictionary id after the header
+//they come from the files given with -dict, and from the inflated data of earlier streams in the input:
+//the trailer of a zlib stream is the adler32 of its inflated data, so every stream phase 2 finds is a candidate,
+//and it is only inflated again once a header asks for it
+#define dict_max_length 65536//a longer dictionary from a stream is cut to the 32K zlib uses, its id in the header then goes to the diff
+class dictionaryFinder{
+public:
+    std::deque<std::vector<unsigned char> > dicts;//the stream table points to these, so they must not move
+    std::map<uint32_t, uint64_t> known;//dictionary id -> dicts
+    std::map<uint32_t, uint64_t> candidates;//adler32 of the inflated data -> the first stream with it
+    void addFile(const char* name){
+        std::ifstream f(name, std::ios::in | std::ios::binary);
+        if (!f.is_open()){
+            std::cout<<"error: open dictionary "<<name<<" failed!"<<std::endl;
+            pause();
+            abort();
+        }
+        std::vector<unsigned char> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        uint32_t id=adler32Simd(1, data.data(), data.size());
+        if (known.count(id)>0) return;
+        dicts.push_back(data);
+        known[id]=dicts.size()-1;
+        std::cout<<"dictionary "<<name<<": "<<data.size()<<" bytes"<<std::endl;
+    }
+    //stream #j of the table has been validated, the dictionary streams do not count since they could not be inflated on their own
+    void addStream(uint64_t j, const streamTable& table, inputBuffer& in){
+        if (table.offsetType[j]>fdict_types) return;
+        std::lock_guard<std::mutex> l(in.lock);
+        const unsigned char* t=in.data.data()+table.offset[j]+table.streamLength[j]-4;
+        candidates.insert(std::make_pair((static_cast<uint32_t>(t[0])<<24)|(t[1]<<16)|(t[2]<<8)|t[3], j));
+    }
+    //the dictionary of the stream with a preset dictionary at offset, 0 if it is not known
+    const std::vector<unsigned char>* find(inputBuffer& in, uint64_t offset, const streamTable& table, inflateBackend& backend){
+        if (in.waitFor(offset+6)<(offset+6)){
+            return 0;
+        }
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> l(in.lock);
+            const unsigned char* h=in.data.data()+offset;
+            id=(static_cast<uint32_t>(h[2])<<24)|(h[3]<<16)|(h[4]<<8)|h[5];
+        }
+        std::map<uint32_t, uint64_t>::iterator it=known.find(id);
+        if (it!=known.end()){
+            return &dicts[it->second];
+        }
+        it=candidates.find(id);
+        if (it==candidates.end()){
+            return 0;
+        }
+        uint64_t j=it->second;
+        std::vector<unsigned char> data(table.inflatedLength[j]);
+        int ret;
+        {
+            std::lock_guard<std::mutex> l(in.lock);
+            ret=backend.inflateWhole(in.data.data()+table.offset[j], table.streamLength[j], data.data(), data.size());
+        }
+        if (ret!=Z_STREAM_END){
+            return 0;
+        }
+        if (data.size()>dict_max_length){
+            data.erase(data.begin(), data.end()-32768);
+        }
+        #ifdef debug
+        std::cout<<"stream #"<<j<<" is the dictionary of the stream at "<<offset<<std::endl;
+        #endif // debug
+        dicts.push_back(data);
+        known[id]=dicts.size()-1;
+        return &dicts.back();
+    }
+};
+
+//the recompressed streams of an archive(see -archive) by content key, so that a stream that is already in it is neither searched nor stored again
+//reading a payload needs the archive file, which the batch that is being appended keeps open
+class archiveStream{
+public:
+    archiveStream(const streamOffset& s, uint64_t pos): so(s){
+        payloadPos=pos;
+    }
+    streamOffset so;//the table record, with nestedLength
+    uint64_t payloadPos;//where its payload is in the archive
+};
+
+class archiveIndex{
+public:
+    archiveIndex(std::fstream& f): file(f){
+        numShared=0;
+    }
+    std::fstream& file;
+    std::map<uint64_t, archiveStream> streams;
+    uint64_t numShared;//streams of the current batch that were found in the archive
+    //add the recompressed streams of a member, list and keys in stream order, payloadPos has the position of every payload in the archive
+    void add(const std::vector<streamOffset>& list, const std::vector<uint64_t>& payloadPos, const unsigned char* keys){
+        for (uint64_t k=0; k<list.size(); k++){
+            uint64_t key;
+            memcpy(&key, keys+k*8, 8);
+            streams.insert(std::make_pair(key, archiveStream(list[k], payloadPos[k])));
+        }
+    }
+    //add the member at pos, which is in the file already
+    void addMember(uint64_t pos){
+        atzLayout l;
+        readAtzLayout(file, l, pos);
+        if ((l.version!=2)||(l.keyslen!=l.nstrms*8)){
+            std::cout<<"corrupt archive: member at "<<pos<<" is not an ATZ2 file with keys"<<std::endl;
+            pause();
+            abort();
+        }
+        std::vector<unsigned char> table(l.tablelen);
+        std::vector<unsigned char> diffruns(l.diffrunlen);
+        std::vector<unsigned char> diffvals(l.diffvallen);
+        std::vector<unsigned char> keys(l.keyslen);
+        readAtzBytes(file, l.tableos, table.size(), table.data());
+        readAtzBytes(file, l.diffrunos, diffruns.size(), diffruns.data());
+        readAtzBytes(file, l.diffvalos, diffvals.size(), diffvals.data());
+        readAtzBytes(file, l.keysos, keys.size(), keys.data());
+        atzCursor cur;
+        cur.table=table.data();
+        cur.tableend=table.size();
+        cur.diffruns=diffruns.data();
+        cur.diffrunend=diffruns.size();
+        cur.diffvals=diffvals.data();
+        cur.diffvalend=diffvals.size();
+        std::vector<streamOffset> list;
+        std::vector<uint64_t> payloadPos;
+        std::vector<unsigned char> group;
+        std::vector<uint64_t> next(1, 0);
+        readPayloadGroups(file, l, 0, l.nstrms, group, next);
+        for (uint64_t k=0; k<l.nstrms; k++){
+            readStreamRecord(cur, list);
+            if (list.back().sharedPos>0){
+                payloadPos.push_back(list.back().sharedPos);
+            } else {
+                payloadPos.push_back(l.payloados+nextPayload(l, list.back(), k, group[k], next));
+            }
+        }
+        add(list, payloadPos, keys.data());
+    }
+    //if the compressed stream at buf is in the archive, copy its record to so and return true
+    //the key only says where to look, the stream is rebuilt from the archive and compared to make sure
+    bool find(const unsigned char* buf, uint64_t streamLength, uint64_t inflatedLength, uint64_t key, streamOffset& so, uint64_t& payloadPos){
+        std::map<uint64_t, archiveStream>::iterator it=streams.find(key);
+        if ((it==streams.end())||(it->second.so.streamLength!=streamLength)||(it->second.so.inflatedLength!=inflatedLength)){
+            return false;
+        }
+        streamOffset s=it->second.so;
+        std::vector<unsigned char> payload(s.payloadLength());
+        std::vector<unsigned char> unpacked;
+        std::vector<unsigned char> rebuilt(streamLength+32768);
+        readAtzBytes(file, it->second.payloadPos, payload.size(), payload.data());
+        s.atzInfos=payload.data();
+        unpackNested(s, unpacked);
+        rebuildStream(s, rebuilt.data());
+        if (memcmp(rebuilt.data(), buf, streamLength)!=0){
+            return false;
+        }
+        so=it->second.so;
+        so.recomp=true;
+        so.skipped=false;
+        so.cut=false;
+        payloadPos=it->second.payloadPos;
+        numShared++;
+        return true;
+    }
+};
+
+//phase 1 to 4 on data that is all in memory, the result is an ATZ image of it
+//used for nested precompression(-depth n), where buf is an inflated payload, and for the files of an archive(-archive)
+//the streams are searched by a pool of search workers, and with depth>1 their payloads are precompressed again
+//archive and member are set for an archive member, the streams that are in archive already are taken from there instead of being searched
+//returns the number of recompressed streams, the image is only written if that is not 0, or for an archive member
+//the caller accounts for buf, the copy of it that is made here and the image in memory(see memoryBudget), the searches and the payloads are accounted here
+uint64_t precompressMemory(const unsigned char* buf, uint64_t len, int depth, searchBudget& budget, memoryBudget& memory, const costModel& model, int sizediffTresh, bool slowmode,
+                           archiveIndex* archive, archiveMember* member, std::vector<unsigned char>& image){
+    inputBuffer in;
+    in.data.assign(buf, buf+len);
+    in.done=true;
+    inflateBackend backend;
+    streamTable streams;
+    boundedQueue<searchJob> jobs(static_cast<size_t>(-1), true);
+    uint64_t end=0;//the end of the last good stream, the offsets before it are inside of it
+    //PHASE 1 and 2
+    for (uint64_t pos=0; (pos+1)<len; pos++){
+        int type=headerType(buf[pos], buf[pos+1]);
+        if ((type==0)||(pos<end)) continue;
+        uint64_t streamLength;
+        uint64_t inflatedLength;
+        if ((validateStream(in, backend, pos, streamLength, inflatedLength)==Z_STREAM_END)&&(streamLength>=16)){
+            uint64_t index=streams.add(pos, type, streamLength, inflatedLength);
+            end=pos+streamLength;
+            if (member!=0){
+                streamOffset so(pos, type, streamLength, inflatedLength);
+                uint64_t payloadPos;
+                member->keys.push_back(streamKey(buf+pos, streamLength));
+                member->sharedPos.push_back(0);
+                member->sharedNested.push_back(0);
+                if (archive->find(buf+pos, streamLength, inflatedLength, member->keys[index], so, payloadPos)){
+                    streams.store(index, so);
+                    member->sharedPos[index]=payloadPos;
+                    member->sharedNested[index]=so.nestedLength;
+                    continue;
+                }
+            }
+            searchJob job(index, streams);//buf does not move, the workers search it in place
+            jobs.push(job);
+        }
+    }
+    if ((streams.size()==0)&&(member==0)) return 0;
+    //PHASE 3
+    searchJournal journal;//disabled, only the files given on the command line have a journal
+    std::vector<std::thread> workers;
+    unsigned nthreads=std::thread::hardware_concurrency();
+    if (nthreads==0) nthreads=1;
+    #ifdef debug
+    nthreads=1;
+    #endif // debug
+    for (unsigned k=0; k<nthreads; k++){
+        workers.push_back(std::thread(searchWorker, &jobs, &streams, buf, &budget, &memory, &model, &journal, sizediffTresh, slowmode));
+    }
+    jobs.close();
+    for (unsigned k=0; k<workers.size(); k++){
+        workers[k].join();
+    }
+    uint64_t nrecomp=0;
+    std::vector<std::vector<unsigned char> > nested;
+    uint64_t nestedPinned=0;
+    for (uint64_t j=0; j<streams.size(); j++){
+        if (!streams.recomp(j)) continue;
+        nrecomp++;
+        if ((depth>1)&&((member==0)||(member->sharedPos[j]==0))){
+            nested.resize(streams.size());
+            streamOffset so=streams.get(j);
+            //the payload, the copy of it and its image, a payload without room for them is not nested
+            if (!memory.tryPin(so.inflatedLength*3)) continue;
+            std::vector<unsigned char> payload(so.inflatedLength);
+            inflatePayload(backend, so, buf, payload.data());
+            precompressMemory(payload.data(), so.inflatedLength, depth-1, budget, memory, model, sizediffTresh, slowmode, 0, 0, nested[j]);
+            memory.unpin(so.inflatedLength*3);
+            if (!memory.tryPin(nested[j].size())){//the image stays in memory until it is written
+                std::vector<unsigned char>().swap(nested[j]);
+            }
+            nestedPinned=nestedPinned+nested[j].size();
+        }
+    }
+    if ((nrecomp==0)&&(member==0)) return 0;
+    #ifdef debug
+    std::cout<<"data of "<<len<<" bytes in memory: "<<nrecomp<<"/"<<streams.size()<<" streams recompressed"<<std::endl;
+    #endif // debug
+    //PHASE 4
+    std::ostringstream atz(std::ios::out|std::ios::binary);
+    uint64_t atzlen=writeAtz(atz, streams, buf, len, nested, member, memory);
+    memory.unpin(nestedPinned);
+    std::string data=atz.str();
+    if ((!atz)||(data.size()!=atzlen)){
+        std::cout<<"error: writing an ATZ image in memory failed"<<std::endl;
+        pause();
+        abort();
+    }
+    image.assign(data.begin(), data.end());
+    return nrecomp;
+}
+
+//ATZ archives(-archive <archive> <file>...): many files in one file, with the streams they have in common stored once
+//  "ATZA" 1, then batches of files, a batch is appended to the end without rewriting anything that is in the archive already:
+//  the ATZ2 image of every file of the batch(a member, with an atzsec_keys section), then the directory of the batch:
+//  "ATZD", the position of the directory of the previous batch(8 bytes, 0 for the first batch), the number of files(varint),
+//  and for every file: the length of the name(varint), the name, the length of the file, the position and the length of its member(varint each)
+//  and the crc32 of the file(4 bytes), then the position of the directory(8 bytes), the last 8 bytes of the archive always point to the last directory
+//a stream that an earlier member has already keeps its table record in the new member, but takes the payload of the earlier one(atz_shared)
+class archiveEntry{
+public:
+    std::string name;
+    uint64_t length;
+    uint64_t memberPos;
+    uint64_t memberLength;
+    uint32_t crc;
+};
+
+//read the directory at dir and the ones of the batches before it, newest batch first, returns false if one of them is not a complete directory
+//that ends with its own position before limit(the next directory), end gets the position right after the directory at dir
+bool readDirectoryChain(std::istream& f, uint64_t dir, uint64_t limit, std::vector<std::vector<archiveEntry> >& batches, uint64_t& end){
+    batches.clear();
+    end=0;
+    while (dir>0){
+        unsigned char magic[4];
+        uint64_t prev;
+        uint64_t n;
+        if ((dir<5)||(dir>=limit)) return false;
+        f.clear();
+        f.seekg(dir);
+        f.read(reinterpret_cast<char*>(magic), 4);
+        f.read(reinterpret_cast<char*>(&prev), 8);
+        if ((!f)||(memcmp(magic, "ATZD", 4)!=0)||(prev>=dir)||(!readVarint(f, n))||(n>(limit-dir))) return false;
+        batches.push_back(std::vector<archiveEntry>(n));
+        for (uint64_t k=0; k<n; k++){
+            archiveEntry& e=batches.back()[k];
+            uint64_t namelen;
+            if ((!readVarint(f, namelen))||(namelen>(limit-dir))) return false;
+            e.name.resize(namelen);
+            f.read(&e.name[0], namelen);
+            if ((!readVarint(f, e.length))||(!readVarint(f, e.memberPos))||(!readVarint(f, e.memberLength))) return false;
+            f.read(reinterpret_cast<char*>(&e.crc), 4);
+            if ((!f)||(e.memberPos<5)||(e.memberPos>dir)||(e.memberLength>(dir-e.memberPos))) return false;
+        }
+        uint64_t self;
+        f.read(reinterpret_cast<char*>(&self), 8);
+        if ((!f)||(self!=dir)||(static_cast<uint64_t>(f.tellg())>limit)) return false;
+        if (end==0){
+            end=f.tellg();
+        }
+        limit=dir;
+        dir=prev;
+    }
+    return true;
+}
+
+//read all the directories of an archive of size bytes, oldest batch first, lastDir gets the position of the last directory
+//and archiveEnd the end of it, which is the end of the archive unless an append was cut off:
+//the last 8 bytes do not point to a directory then, and the archive ends with the last directory that checks out, what follows is ignored
+void readArchiveDirectory(std::istream& f, uint64_t size, std::vector<archiveEntry>& entries, uint64_t& lastDir, uint64_t& archiveEnd){
+    unsigned char head[5];
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(head), 5);
+    if ((!f)||(memcmp(head, "ATZA", 4)!=0)||(head[4]!=1)){
+        std::cout<<"ATZ archive header not found"<<std::endl;
+        pause();
+        abort();
+    }
+    entries.clear();
+    lastDir=0;
+    archiveEnd=5;
+    if (size==5){//no batches yet
+        return;
+    }
+    std::vector<std::vector<archiveEntry> > batches;
+    uint64_t dir=0;
+    uint64_t end=0;
+    if (size>=13){
+        f.seekg(size-8);
+        f.read(reinterpret_cast<char*>(&dir), 8);
+    }
+    if ((!f)||(dir==0)||(!readDirectoryChain(f, dir, size, batches, end))||(end!=size)){
+        //look for the last directory from the end, a block at a time, the blocks overlap by 3 bytes so that no "ATZD" is cut in two
+        dir=0;
+        std::vector<char> block;
+        for (uint64_t blockEnd=size; (blockEnd>5)&&(dir==0); blockEnd=(blockEnd>(5+read_chunk))?(blockEnd-read_chunk):5){
+            uint64_t blockStart=(blockEnd>(5+read_chunk))?(blockEnd-read_chunk):5;
+            uint64_t blockLen=std::min(blockEnd+3, size)-blockStart;
+            block.resize(blockLen);
+            f.clear();
+            f.seekg(blockStart);
+            f.read(block.data(), blockLen);
+            for (uint64_t k=blockLen; (k>=4)&&(dir==0); k--){
+                if ((memcmp(block.data()+k-4, "ATZD", 4)==0)&&readDirectoryChain(f, blockStart+k-4, size, batches, end)){
+                    dir=blockStart+k-4;
+                }
+            }
+        }
+        if (dir==0){
+            batches.clear();
+            end=5;
+        }
+        std::cout<<"the archive has "<<(size-end)<<" bytes after its last complete directory, left by an append that did not finish, they are ignored"<<std::endl;
+    }
+    lastDir=dir;
+    archiveEnd=end;
+    for (uint64_t b=batches.size(); b>0; b--){
+        entries.insert(entries.end(), batches[b-1].begin(), batches[b-1].end());
+    }
+}
+
+//add files to an archive as a new batch, the archive is created if it does not exist
+//every file goes through phase 1 to 4 in memory(see precompressMemory), depth is the -depth of nested precompression
+void archiveFiles(const char* name, const std::vector<const char*>& files, int depth, searchBudget& budget, memoryBudget& memory, const costModel& model,
+                  int sizediffTresh, bool slowmode){
+    struct stat st;
+    uint64_t size=0;
+    for (uint64_t k=0; k<files.size(); k++){//a file and the copy precompressMemory makes of it, checked before the archive is touched
+        if ((stat(files[k], &st)==0)&&(!memory.fits(static_cast<uint64_t>(st.st_size)*2))){
+            std::cout<<"error: "<<files[k]<<" does not fit the memory limit(see -mem-limit), it takes twice its size"<<std::endl;
+            pause();
+            abort();
+        }
+    }
+    if (stat(name, &st)==0){
+        size=st.st_size;
+    }
+    if (size==0){
+        std::ofstream create(name, std::ios::out | std::ios::binary | std::ios::trunc);
+        unsigned char head[5]={65, 84, 90, 65, 1};
+        create.write(reinterpret_cast<char*>(head), 5);
+        if (!create){
+            std::cout<<"error: creating "<<name<<" failed"<<std::endl;
+            pause();
+            abort();
+        }
+        size=5;
+        std::cout<<"creating archive "<<name<<std::endl;
+    }
+    std::fstream f(name, std::ios::in | std::ios::out | std::ios::binary);
+    if (!f.is_open()){
+        std::cout<<"error: open archive failed!"<<std::endl;
+        pause();
+        abort();
+    }
+    archiveIndex index(f);
+    std::vector<archiveEntry> entries;
+    uint64_t lastDir;
+    uint64_t archiveEnd;
+    readArchiveDirectory(f, size, entries, lastDir, archiveEnd);
+    if (archiveEnd<size){//the new batch goes where the one that was cut off started
+        f.close();
+        #ifdef _WIN32
+        int fd=_open(name, _O_RDWR | _O_BINARY);
+        bool truncated=(fd>=0)&&(_chsize_s(fd, archiveEnd)==0);
+        if (fd>=0) _close(fd);
+        #else
+        bool truncated=(truncate(name, archiveEnd)==0);
+        #endif
+        if (!truncated){
+            std::cout<<"error: truncating "<<name<<" failed"<<std::endl;
+            pause();
+            abort();
+        }
+        size=archiveEnd;
+        f.open(name, std::ios::in | std::ios::out | std::ios::binary);
+        if (!f.is_open()){
+            std::cout<<"error: open archive failed!"<<std::endl;
+            pause();
+            abort();
+        }
+    }
+    for (uint64_t k=0; k<entries.size(); k++){
+        index.addMember(entries[k].memberPos);
+    }
+    if (entries.size()>0){
+        std::cout<<"appending to "<<entries.size()<<" files, "<<index.streams.size()<<" streams in the archive"<<std::endl;
+    }
+    uint64_t end=size;
+    std::vector<archiveEntry> batch;
+    for (uint64_t k=0; k<files.size(); k++){
+        std::ifstream in(files[k], std::ios::in | std::ios::binary);
+        if (!in.is_open()){
+            std::cout<<"error: open "<<files[k]<<" for input failed!"<<std::endl;
+            pause();
+            abort();
+        }
+        inputBuffer data;
+        data.hashing=true;
+        struct stat fileStat;
+        if (stat(files[k], &fileStat)==0){//so that the buffer does not grow past the file
+            data.data.reserve(fileStat.st_size);
+        }
+        readInput(&in, &data, &memory);
+        archiveMember member;
+        std::vector<unsigned char> image;
+        uint64_t shared=index.numShared;
+        memory.pin(data.data.size());//the copy precompressMemory makes
+        uint64_t nrecomp=precompressMemory(data.data.data(), data.data.size(), depth+1, budget, memory, model, sizediffTresh, slowmode, &index, &member, image);
+        memory.unpin(data.data.size()+data.data.capacity());
+        f.seekp(end);
+        f.write(reinterpret_cast<char*>(image.data()), image.size());
+        f.flush();
+        //the streams of this file can be shared by the next ones
+        memoryStreamBuf imageBuf(image.data(), image.size());
+        std::istream imageStream(&imageBuf);
+        atzLayout l;
+        readAtzLayout(imageStream, l, 0);
+        std::vector<streamOffset> list;
+        std::vector<uint64_t> payloadPos;
+        readStreamList(image.data(), l, list);
+        for (uint64_t n=0; n<list.size(); n++){
+            payloadPos.push_back((list[n].sharedPos>0)?list[n].sharedPos:(end+(list[n].atzInfos-image.data())));
+        }
+        index.add(list, payloadPos, image.data()+l.keysos);
+        archiveEntry e;
+        e.name=files[k];
+        e.length=data.data.size();
+        e.memberPos=end;
+        e.memberLength=image.size();
+        e.crc=data.crc;
+        batch.push_back(e);
+        std::cout<<files[k]<<": "<<e.length<<" -> "<<e.memberLength<<" bytes, recompressed "<<nrecomp<<"/"<<member.keys.size();
+        std::cout<<", "<<(index.numShared-shared)<<" of them shared with earlier files"<<std::endl;
+        end=end+image.size();
+    }
+    std::vector<unsigned char> dir;
+    dir.insert(dir.end(), "ATZD", "ATZD"+4);
+    for (int b=0; b<8; b++){
+        dir.push_back((lastDir>>(8*b))&255);
+    }
+    putVarint(dir, batch.size());
+    for (uint64_t k=0; k<batch.size(); k++){
+        putVarint(dir, batch[k].name.size());
+        dir.insert(dir.end(), batch[k].name.begin(), batch[k].name.end());
+        putVarint(dir, batch[k].length);
+        putVarint(dir, batch[k].memberPos);
+        putVarint(dir, batch[k].memberLength);
+        for (int b=0; b<4; b++){
+            dir.push_back((batch[k].crc>>(8*b))&255);
+        }
+    }
+    for (int b=0; b<8; b++){
+        dir.push_back((end>>(8*b))&255);
+    }
+    f.seekp(end);
+    f.write(reinterpret_cast<char*>(dir.data()), dir.size());
+    f.flush();
+    if (!f){
+        std::cout<<"error: writing the archive failed"<<std::endl;
+        pause();
+        abort();
+    }
+    std::cout<<"added "<<batch.size()<<" files, "<<index.numShared<<" streams shared, archive size: "<<(end+dir.size())<<std::endl;
+}
+
+//rebuild every file of an archive, file names get .rec appended like with -r, and the crc32 of every file is checked
+void unpackArchive(const char* name){
+    std::ifstream f(name, std::ios::in | std::ios::binary);
+    if (!f.is_open()){
+        std::cout<<"error: open archive failed!"<<std::endl;
+        pause();
+        abort();
+    }
+    inputBuffer archive;
+    readInput(&f, &archive, 0);//the members share payloads, so the whole archive is kept in memory
+    memoryStreamBuf archiveBuf(archive.data.data(), archive.data.size());
+    std::istream archiveStream(&archiveBuf);
+    std::vector<archiveEntry> entries;
+    uint64_t lastDir;
+    uint64_t archiveEnd;
+    readArchiveDirectory(archiveStream, archive.data.size(), entries, lastDir, archiveEnd);
+    for (uint64_t k=0; k<entries.size(); k++){
+        std::vector<unsigned char> out(entries[k].length);
+        rebuildImage(archive.data.data()+entries[k].memberPos, entries[k].memberLength, out.data(), out.size(), archive.data.data(), archive.data.size());
+        uint64_t crc=crc32(0, Z_NULL, 0);
+        for (uint64_t pos=0; pos<out.size(); pos=pos+zlib_chunk){
+            crc=crc32(crc, out.data()+pos, std::min(out.size()-pos, static_cast<uint64_t>(zlib_chunk)));
+        }
+        if (crc!=entries[k].crc){
+            std::cout<<"error: "<<entries[k].name<<" does not match its crc32"<<std::endl;
+            pause();
+            abort();
+        }
+        std::string recname=entries[k].name+".rec";
+        std::ofstream rec(recname.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        rec.write(reinterpret_cast<char*>(out.data()), out.size());
+        rec.close();
+        if (!rec){
+            std::cout<<"error: writing "<<recname<<" failed"<<std::endl;
+            pause();
+            abort();
+        }
+        std::cout<<recname<<": "<<out.size()<<" bytes"<<std::endl;
+    }
+    std::cout<<"unpacked "<<entries.size()<<" files"<<std::endl;
+}
+
+//-scrub: check an ATZ file or every member of an archive against the checksums, returns the number of damaged parts
+uint64_t scrubFile(const char* name, unsigned threads){
+    std::ifstream f(name, std::ios::in | std::ios::binary);
+    if (!f.is_open()){
+        std::cout<<"error: open ATZ file for input failed!"<<std::endl;
+        pause();
+        abort();
+    }
+    if (isXzFile(f)){//see -lzma
+        #ifdef use_lzma
+        //the ATZ data is decompressed as it is read and checked in memory, nothing goes to disk
+        std::cout<<"the ATZ file is compressed with xz, decompressing it"<<std::endl;
+        lzmaInputBuf xzBuf(f, threads);
+        std::istream xzIn(&xzBuf);
+        inputBuffer atz;
+        readInput(&xzIn, &atz, 0);
+        memoryStreamBuf atzBuf(atz.data.data(), atz.data.size());
+        std::istream atzStream(&atzBuf);
+        atzLayout l;
+        readAtzLayout(atzStream, l, 0);
+        if (l.version<2){
+            std::cout<<"ATZ1 files have no checksums"<<std::endl;
+            return 0;
+        }
+        return scrubAtz(0, atz.data.data(), atz.data.size(), l, threads);
+        #else
+        std::cout<<"error: the ATZ file is compressed with xz, decompress it with xz -d or use a build with liblzma(-Duse_lzma)"<<std::endl;
+        pause();
+        abort();
+        #endif // use_lzma
+    }
+    unsigned char head[4]={0, 0, 0, 0};
+    f.read(reinterpret_cast<char*>(head), 4);
+    f.clear();
+    uint64_t damaged=0;
+    if (memcmp(head, "ATZA", 4)==0){
+        struct stat st;
+        if (stat(name, &st)!=0){
+            std::cout<<"Error determining file size."<<std::endl;
+            pause();
+            abort();
+        }
+        std::vector<archiveEntry> entries;
+        uint64_t lastDir;
+        uint64_t archiveEnd;
+        readArchiveDirectory(f, st.st_size, entries, lastDir, archiveEnd);
+        if (archiveEnd<static_cast<uint64_t>(st.st_size)){//the rest of a cut off append counts as one damaged part
+            damaged++;
+        }
+        for (uint64_t k=0; k<entries.size(); k++){
+            std::cout<<"member "<<entries[k].name<<":"<<std::endl;
+            atzLayout l;
+            readAtzLayout(f, l, entries[k].memberPos);
+            damaged=damaged+scrubAtz(name, 0, 0, l, threads);
+        }
+    } else {
+        atzLayout l;
+        readAtzLayout(f, l, 0);
+        if (l.version<2){
+            std::cout<<"ATZ1 files have no checksums"<<std::endl;
+            return 0;
+        }
+        damaged=scrubAtz(name, 0, 0, l, threads);
+    }
+    return damaged;
+}
+
+//microbenchmark of the comparison kernels against the byte-by-byte loops they replaced, run with -bench
+void runBenchmark(){
+    using std::cout;
+    using std::endl;
+    const uint64_t len=1<<20;
+    const int rounds=500;
+    unsigned char* orig=new unsigned char[len];
+    unsigned char* recomp=new unsigned char[len];
+    srand(1);
+    for (uint64_t k=0; k<len; k++){
+        orig[k]=rand()&255;
+    }
+    memcpy(recomp, orig, len);
+    //a typical partial match: a few short runs of mismatching bytes scattered over the stream
+    for (int k=0; k<64; k++){
+        uint64_t pos=rand()%(len-16);
+        int runlen=1+rand()%8;
+        for (int r=0; r<runlen; r++){
+            recomp[pos+r]=recomp[pos+r]^0x5A;
+        }
+    }
+    //the buffers are read through volatile pointers, so that the compiler cannot hoist the work out of the timing loops
+    const unsigned char* volatile origv=orig;
+    const unsigned char* volatile recompv=recomp;
+    streamOffset ref(0, -1, len, len);
+    streamOffset fast(0, -1, len, len);
+    uint64_t identRef=0;
+    uint64_t identFast=0;
+    #if defined(__AVX2__)
+    cout<<"comparison kernels: AVX2"<<endl;
+    #elif defined(__SSE2__)
+    cout<<"comparison kernels: SSE2"<<endl;
+    #else
+    cout<<"comparison kernels: scalar"<<endl;
+    #endif
+    cout<<rounds<<" rounds over "<<len<<" bytes"<<endl;
+
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++){
+        uint64_t identical=0;
+        const unsigned char* o=origv;
+        const unsigned char* rc=recompv;
+        for (uint64_t k=0; k<len; k++){
+            if (rc[k]==o[k]){
+                identical++;
+            }
+        }
+        identRef=identRef+identical;
+    }
+    double tRef=secondsSince(start);
+    start=std::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++){
+        identFast=identFast+countIdentical(recompv, origv, len);
+    }
+    double tFast=secondsSince(start);
+    cout<<"count identical, byte loop: "<<(len*rounds/tRef/1048576)<<" MB/s"<<endl;
+    cout<<"count identical, kernel:    "<<(len*rounds/tFast/1048576)<<" MB/s"<<endl;
+
+    start=std::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++){
+        ref.clearDiff();
+        const unsigned char* o=origv;
+        const unsigned char* rc=recompv;
+        for (uint64_t k=0; k<len; k++){
+            if (rc[k]!=o[k]){
+                ref.addDiffByte(k, o[k]);
+            }
+        }
+    }
+    tRef=secondsSince(start);
+    start=std::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++){
+        fast.collectDiff(recompv, len, origv);
+    }
+    tFast=secondsSince(start);
+    cout<<"collect diff, byte loop: "<<(len*rounds/tRef/1048576)<<" MB/s"<<endl;
+    cout<<"collect diff, kernel:    "<<(len*rounds/tFast/1048576)<<" MB/s"<<endl;
+    if ((identRef!=identFast)||(ref.diffRunGap!=fast.diffRunGap)||(ref.diffRunLen!=fast.diffRunLen)||(ref.diffByteVal!=fast.diffByteVal)){
+        cout<<"error: the kernels do not match the byte loops"<<endl;
+        abort();
+    }
+    cout<<"results match, "<<fast.diffRunLen.size()<<" diff runs"<<endl;
+
+    //the phase 2 trailer check against zlib's adler32(), on odd lengths and offsets too so that the tail loop gets checked
+    uint32_t adlerRef=0;
+    uint32_t adlerFast=0;
+    start=std::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++){
+        adlerRef=adlerRef^adler32(r, origv+(r&15), len-r);
+    }
+    tRef=secondsSince(start);
+    start=std::chrono::steady_clock::now();
+    for (int r=0; r<rounds; r++){
+        adlerFast=adlerFast^adler32Simd(r, origv+(r&15), len-r);
+    }
+    tFast=secondsSince(start);
+    cout<<"adler32, zlib:   "<<(len*rounds/tRef/1048576)<<" MB/s"<<endl;
+    cout<<"adler32, kernel: "<<(len*rounds/tFast/1048576)<<" MB/s"<<endl;
+    memset(recomp, 255, len);//the largest byte values come closest to overflowing the sums
+    if ((adlerRef!=adlerFast)||(adler32(1, recomp, len)!=adler32Simd(1, recomp, len))){
+        cout<<"error: adler32Simd does not match zlib"<<endl;
+        abort();
+    }
+    cout<<"results match"<<endl;
+    delete [] orig;
+    delete [] recomp;
+
+    //the inflate backend against zlib on phase 2 work: zlib streams between random bytes, validated at every offset that could be a header
+    cout<<"inflate backend: "<<inflate_backend<<endl;
+    {
+        const char* words[8]={"stream ", "offset ", "deflate ", "window ", "level ", "the ", "of ", "zlib "};
+        inputBuffer mix;
+        for (int k=0; k<200; k++){
+            for (int r=rand()%4096; r>0; r--){
+                mix.data.push_back(rand()&255);
+            }
+            std::string text;
+            for (int w=(1+rand()%64)*1024; w>0; w--){
+                text=text+words[rand()&7];
+            }
+            uLongf compLen=compressBound(text.size());
+            std::vector<unsigned char> comp(compLen);
+            compress2(comp.data(), &compLen, reinterpret_cast<const unsigned char*>(text.data()), text.size(), 1+k%9);
+            mix.data.insert(mix.data.end(), comp.begin(), comp.begin()+compLen);
+        }
+        mix.done=true;
+        std::vector<uint64_t> candidates;
+        for (uint64_t k=0; (k+1)<mix.data.size(); k++){
+            if (((mix.data[k]&15)==8)&&((mix.data[k]>>4)<8)&&((((mix.data[k]<<8)|mix.data[k+1])%31)==0)){
+                candidates.push_back(k);
+            }
+        }
+        std::vector<uint64_t> refLen(candidates.size()*2);
+        std::vector<int> refRet(candidates.size());
+        uint64_t inflatedTotal=0;
+        start=std::chrono::steady_clock::now();
+        for (uint64_t k=0; k<candidates.size(); k++){
+            refRet[k]=validateZlib(mix, candidates[k], refLen[2*k], refLen[2*k+1], 0);
+            if (refRet[k]==Z_STREAM_END){
+                inflatedTotal=inflatedTotal+refLen[2*k+1];
+            }
+        }
+        tRef=secondsSince(start);
+        inflateBackend backend;
+        uint64_t mismatches=0;
+        start=std::chrono::steady_clock::now();
+        for (uint64_t k=0; k<candidates.size(); k++){
+            uint64_t streamLength;
+            uint64_t inflatedLength;
+            int ret=validateStream(mix, backend, candidates[k], streamLength, inflatedLength);
+            //zlib tells a stream cut off by the end of the input(Z_BUF_ERROR) from bad data, phase 2 does not
+            if (((ret==Z_STREAM_END)!=(refRet[k]==Z_STREAM_END))||((ret==Z_STREAM_END)&&((streamLength!=refLen[2*k])||(inflatedLength!=refLen[2*k+1])))){
+                mismatches++;
+            }
+        }
+        tFast=secondsSince(start);
+        cout<<candidates.size()<<" candidate offsets in "<<mix.data.size()<<" bytes, "<<inflatedTotal<<" bytes inflated"<<endl;
+        cout<<"validate, zlib:    "<<(inflatedTotal/tRef/1048576)<<" MB/s"<<endl;
+        cout<<"validate, backend: "<<(inflatedTotal/tFast/1048576)<<" MB/s"<<endl;
+        if (mismatches>0){
+            cout<<"error: the inflate backend disagrees with zlib on "<<mismatches<<" offsets"<<endl;
+            abort();
+        }
+        cout<<"results match"<<endl;
+    }
+
+    //a single stream over 4GB, zlib only takes 32 bit lengths so this checks that every call site works in pieces
+    //the data repeats within the window, so the compressed stream stays small and only the inflated data needs 4GB of memory
+    const uint64_t bigLen=(static_cast<uint64_t>(1)<<32)+(static_cast<uint64_t>(1)<<26);
+    unsigned char* big=new (std::nothrow) unsigned char[bigLen];
+    if (big==0){
+        cout<<"not enough memory for the 4GB stream, skipping it"<<endl;
+        return;
+    }
+    for (uint64_t k=0; k<4093; k++){
+        big[k]=rand()&255;
+    }
+    for (uint64_t k=4093; k<bigLen; k++){
+        big[k]=big[k-4093];
+    }
+    streamOffset so(0, -1, 0, bigLen);
+    so.clevel=1;
+    so.window=15;
+    so.memlvl=8;
+    so.atzInfos=big;
+    uint64_t compSize=(static_cast<uint64_t>(1)<<26);
+    unsigned char* comp=new unsigned char[compSize+32768];
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    deflateInit2(&strm, so.clevel, Z_DEFLATED, so.window, so.memlvl, so.strategy);
+    uint64_t inUsed;
+    start=std::chrono::steady_clock::now();
+    int ret=zlibPump(strm, true, big, bigLen, comp, compSize, inUsed, so.streamLength);
+    double tDeflate=secondsSince(start);
+    deflateEnd(&strm);
+    if ((ret!=Z_STREAM_END)||(inUsed!=bigLen)){
+        cout<<"error: deflating the 4GB stream failed with exit code:"<<ret<<endl;
+        abort();
+    }
+    inputBuffer in;
+    in.data.assign(comp, comp+so.streamLength);
+    in.done=true;
+    uint64_t streamLength;
+    uint64_t inflatedLength;
+    start=std::chrono::steady_clock::now();
+    ret=validateZlib(in, 0, streamLength, inflatedLength, 0);
+    double tValidate=secondsSince(start);
+    if ((ret!=Z_STREAM_END)||(streamLength!=so.streamLength)||(inflatedLength!=bigLen)){
+        cout<<"error: validating the 4GB stream gave "<<streamLength<<" -> "<<inflatedLength<<" bytes"<<endl;
+        abort();
+    }
+    unsigned char* rebuilt=new unsigned char[so.streamLength+32768];
+    start=std::chrono::steady_clock::now();
+    rebuildStream(so, rebuilt);
+    double tRebuild=secondsSince(start);
+    if (memcmp(rebuilt, comp, so.streamLength)!=0){
+        cout<<"error: the rebuilt 4GB stream does not match"<<endl;
+        abort();
+    }
+    cout<<"stream of "<<bigLen<<" bytes, compressed to "<<so.streamLength<<" bytes"<<endl;
+    cout<<"   deflate:  "<<(bigLen/tDeflate/1048576)<<" MB/s"<<endl;
+    cout<<"   validate: "<<(bigLen/tValidate/1048576)<<" MB/s"<<endl;
+    cout<<"   rebuild:  "<<(bigLen/tRebuild/1048576)<<" MB/s"<<endl;
+    cout<<"lengths and rebuilt stream match"<<endl;
+    delete [] big;
+    delete [] comp;
+    delete [] rebuilt;
+}
+
+int main(int argc, char* argv[]) {
+	using std::cout;
+	using std::endl;
+	using std::cin;
+	using std::vector;
+	uint64_t lastos=0;
+    uint64_t lastlen=0;
+    uint64_t atzlen=0;//placeholder for the length of the atz file
+    uint64_t filelen=0;//what phase 4 wrote, less than atzlen if the ATZ data is compressed(see -lzma)
+    int lzmaPreset=-1;//-lzma: the xz preset of the ATZ file, -1 if it is not compressed
+    std::ofstream outfile;
+    std::ostream stdoutData(0);//the data written to stdout in stdin/stdout mode, cout goes to stderr then
+    std::ostream* atzout=&outfile;
+    int_fast64_t j=0;
+    uint64_t recomp=0;
+
+    //streams are only recompressed if the diff of the best match takes up <= recompTresh bytes in the ATZ file
+    //256 bytes is what 128 scattered mismatching bytes cost, contiguous mismatches are much cheaper than that
+    int recompTresh=256;
+    int sizediffTresh=128;//streams are only compared when the size difference is <= sizediffTresh
+    costModel* model;//see costModel
+    bool entropyCost=false;
+    double costCpu=0;
+    //DO NOT turn off slowmode, the alternative code (optimized mode) does not work at all
+    bool slowmode=true;//slowmode bruteforces the zlib parameters, optimized mode only tries probable parameters based on the 2-byte header
+    int_fast64_t concentrate=-404;//only try to recompress the stream# givel here, -1 disables this and runs on all streams
+
+    int_fast64_t lastGoodOffset=0;
+    int_fast64_t lastStreamLength=0;
+	int_fast64_t numOffsets=0;
+	int_fast64_t numChecked=0;//the offsets before this one have been through phase 2
+	uint64_t scanpos=0;//phase 1 has scanned everything before this position
+	bool scanning=true;
+	int ret=-9;
+	vector<streamOffset> streamOffsetList;
+	//pipeline state, see the description of the stages above boundedQueue
+	inputBuffer in;
+	streamTable streams;//validated streams and their search results
+	inflateBackend fastInflate;//phase 2 decoder, see inflateBackend
+	dictionaryFinder dictionaries;//preset dictionaries, see -dict
+	boundedQueue<searchJob> jobs(search_queue_len, true);//largest stream first
+	searchBudget budget;
+	memoryBudget memory;//see -mem-limit
+	searchJournal journal;
+	uint64_t estimateSample=0;//estimate mode if not 0, see pickSample
+	bool estimateOnly=false;//-estimate was given
+	std::vector<sampleStratum> strata;
+	streamTable journalStreams;//the streams found by an earlier run
+	std::vector<bool> searched;//the ones of them that have a search result in the journal
+	bool journalStreamsDone=false;
+	uint32_t journalCrc=0;
+	uint32_t journalAdler=0;
+	int nestDepth=0;//-depth n: precompress the payloads again, up to n levels deep
+	bool archiveMode=false;
+	vector<vector<unsigned char> > nested;//the nested ATZ images of the payloads, see precompressMemory
+	uint64_t nestedPinned=0;//the memory of the nested images, they stay in memory until phase 4 has written them
+	std::thread reader;
+	vector<std::thread> workers;
+	unsigned nthreads=std::thread::hardware_concurrency();
+	if (nthreads==0) nthreads=1;
+	#ifdef debug
+	nthreads=1;//keep the debug output in order
+	#endif // debug
+    #ifdef debug
+	int_fast64_t dataErrors=0;
+    int_fast64_t numDecomp32k=0;
+    int_fast64_t numDecomp16k=0;
+    int_fast64_t numDecomp8k=0;
+    int_fast64_t numDecomp4k=0;
+    int_fast64_t numDecomp2k=0;
+    int_fast64_t numDecomp1k=0;
+    int_fast64_t numDecomp512=0;
+    int_fast64_t numDecomp256=0;
+    int_fast64_t numDecompDict=0;
+    uint_fast64_t type1=0;
+    uint_fast64_t type2=0;
+    uint_fast64_t type3=0;
+    uint_fast64_t type4=0;
+    #endif // debug
+
+    #ifdef debug
+	uint_fast64_t nMatch1=0;
+	uint_fast64_t nMatch2=0;
+	uint_fast64_t nMatch3=0;
+	uint_fast64_t nMatch4=0;
+	uint_fast64_t nMatch5=0;
+	uint_fast64_t nMatch6=0;
+	uint_fast64_t nMatch7=0;
+	uint_fast64_t nMatch8=0;
+	uint_fast64_t nMatchDict=0;
+	#endif
+	//offsetList stores memory offsets where potential headers can be found, and the type of the offset
+	vector<fileOffset> offsetList;
+	int_fast64_t i;
+	unsigned char* rBuffer;
+	std::ifstream infile;
+	std::istream* input=&infile;
+
+	//PHASE 0
+	//opening file
+	/*for (int i = 0; i < argc; ++i) {
+        std::cout << argv[i] << std::endl;
+    }*/
+	uint64_t infileSize;
+	char* infile_name=0;
+	char* reconfile_name=0;
+	char* atzfile_name=0;
+	if ((argc>=2)&&(strcmp(argv[1], "-bench")==0)){//run the microbenchmarks instead of processing a file
+        runBenchmark();
+        return 0;
+	}
+	for (int a=2; a<(argc-1); a++){//-mem-limit <bytes>[K|M|G]: the memory budget of the run, see memoryBudget
+        if (strcmp(argv[a], "-mem-limit")==0){
+            memory.limit=parseSize(argv[a+1]);
+        }
+	}
+	for (int a=2; a<argc; a++){
+        if (strcmp(argv[a], "-estimate")==0){//nothing is written in estimate mode, the sample size is read with the other options
+            estimateOnly=true;
+        }
+	}
+	if ((argc>=2)&&(strcmp(argv[1], "-")==0)){//stdin/stdout mode: read the data from stdin and write the result to stdout, without verification
+        pipeMode=true;
+        std::ios::sync_with_stdio(false);
+        #ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+        #endif
+        stdoutData.rdbuf(cout.rdbuf());//the data goes to the real stdout
+        cout.rdbuf(std::cerr.rdbuf());//and the messages go to stderr
+        infile_name=argv[1];
+        atzfile_name=argv[1];
+        reconfile_name=argv[1];
+        if ((argc>=3)&&(strcmp(argv[2], "-r")==0)){//- -r: read an ATZ file from stdin and write the reconstructed file to stdout
+            goto PHASE5;
+        }
+        cout<<"precompressing from stdin to stdout"<<endl;
+	}else if ((argc>=4)&&(strcmp(argv[1], "-archive")==0)){//-archive <archive> <file>...: add the files to an archive, see archiveFiles
+        archiveMode=true;
+	}else if (argc>=2){// if we get at least one string use it as input file name
+        cout<<"Input file: "<<argv[1]<<endl;
+        if (argc>=3){//if we get at least two strings use the second as a parameter
+            if (((strcmp(argv[2], "-x")==0)&&(argc>=5))||((strcmp(argv[2], "-s")==0)&&(argc>=4))){
+                //-x <offset> <length>: rebuild only a byte range of the original file from the ATZ file
+                //-s <n>: rebuild only the n-th recompressed stream
+                //both use the index of the ATZ file and write the result to <input>.part
+                {//a file without an index is refused before the part file is made
+                    std::ifstream check;
+                    atzLayout l;
+                    openIndexedAtz(argv[1], check, l);
+                }
+                char* partfile_name= new char[strlen(argv[1])+6];
+                memset(partfile_name, 0, (strlen(argv[1])+6));//null out the entire string
+                strcpy(partfile_name, argv[1]);
+                partfile_name=strcat(partfile_name, ".part");
+                cout<<"overwriting "<<partfile_name<<" if present"<<endl;
+                std::ofstream partfile(partfile_name, std::ios::out | std::ios::binary | std::ios::trunc);
+                if (!partfile.is_open()) {
+                    cout << "error: open file for output failed!" << endl;
+                    pause();
+                    abort();
+                }
+                if (strcmp(argv[2], "-x")==0){
+                    extractRange(argv[1], strtoull(argv[3], 0, 10), strtoull(argv[4], 0, 10), partfile);
+                } else {
+                    extractStream(argv[1], strtoull(argv[3], 0, 10), partfile);
+                }
+                cout<<"Total bytes written: "<<partfile.tellp()<<endl;
+                partfile.close();
+                delete [] partfile_name;
+                return 0;
+            }
+            if (strcmp(argv[2], "-unpack")==0){//treat the file as an archive and rebuild all the files in it
+                unpackArchive(argv[1]);
+                return 0;
+            }
+            if (strcmp(argv[2], "-scrub")==0){//check an ATZ file or an archive against its checksums, nothing is written
+                uint64_t damaged=scrubFile(argv[1], nthreads);
+                if (damaged>0){
+                    cout<<damaged<<" damaged parts found"<<endl;
+                    return 1;
+                }
+                cout<<"no damage found in the parts that have checksums"<<endl;
+                return 0;
+            }
+            if (strcmp(argv[2], "-r")==0){//if we get -r, treat the file as an ATZ file and skip to reconstruction
+                atzfile_name=argv[1];
+
+                reconfile_name= new char[strlen(argv[1])+5];
+                memset(reconfile_name, 0, (strlen(argv[1])+5));//null out the entire string
+                strcpy(reconfile_name, argv[1]);
+                reconfile_name=strcat(reconfile_name, ".rec");
+                cout<<"assuming input file is an ATZ file, attempting to reconstruct"<<endl;
+                cout<<"overwriting "<<reconfile_name<<" if present"<<endl;
+                goto PHASE5;
+            }else{//if the third stig is not a valid parameter then ignore it
+                infile_name=argv[1];
+                atzfile_name= new char[strlen(argv[1])+5];
+                memset(atzfile_name, 0, (strlen(argv[1])+5));//null out the entire string
+                strcpy(atzfile_name, argv[1]);
+                atzfile_name=strcat(atzfile_name, ".atz");
+
+                reconfile_name= new char[strlen(argv[1])+5];
+                memset(reconfile_name, 0, (strlen(argv[1])+5));//null out the entire string
+                strcpy(reconfile_name, argv[1]);
+                reconfile_name=strcat(reconfile_name, ".rec");
+                if (!estimateOnly){
+                    cout<<"overwriting "<<atzfile_name<<" and "<<reconfile_name<<" if present"<<endl;
+                }
+            }
+        }else{//if we get only the filename go forward to creating an ATZ file from it
+            infile_name=argv[1];
+            atzfile_name= new char[strlen(argv[1])+5];
+            memset(atzfile_name, 0, (strlen(argv[1])+5));//null out the entire string
+            strcpy(atzfile_name, argv[1]);
+            atzfile_name=strcat(atzfile_name, ".atz");
+
+            reconfile_name= new char[strlen(argv[1])+5];
+            memset(reconfile_name, 0, (strlen(argv[1])+5));//null out the entire string
+            strcpy(reconfile_name, argv[1]);
+            reconfile_name=strcat(reconfile_name, ".rec");
+            if (!estimateOnly){
+                cout<<"overwriting "<<atzfile_name<<" and "<<reconfile_name<<" if present"<<endl;
+            }
+        }
+	}else{//if we get nothing from the CLI
+        cout<<"no input specified, trying to open test.bin"<<endl;
+        infile_name= new char[9];
+        infile_name=default_infile;
+        cout<<"overwriting atztest.atz and recon.bin if present"<<endl;
+        atzfile_name= new char[12];
+        atzfile_name=default_atzfile;
+        reconfile_name= new char[10];
+        reconfile_name=default_reconfile;
+	}
+
+	for (int a=2; a<(argc-1); a++){//search budgets, see searchBudget
+        if (strcmp(argv[a], "-stream-budget")==0){
+            parseBudget(argv[a+1], budget.streamLimit, budget.streamMs);
+        }
+        if (strcmp(argv[a], "-file-budget")==0){
+            parseBudget(argv[a+1], budget.fileLimit, budget.fileMs);
+        }
+        if ((strcmp(argv[a], "-cost")==0)&&(strcmp(argv[a+1], "entropy")==0)){
+            entropyCost=true;
+        }
+        if (strcmp(argv[a], "-cost-cpu")==0){
+            costCpu=strtod(argv[a+1], 0);
+        }
+        if (strcmp(argv[a], "-depth")==0){
+            nestDepth=atoi(argv[a+1]);
+        }
+        if (strcmp(argv[a], "-dict")==0){//a preset dictionary for the streams that need one, can be given more than once
+            dictionaries.addFile(argv[a+1]);
+        }
+	}
+	if (entropyCost){
+        cout<<"using the entropy cost model"<<endl;
+        model=new entropyCostModel(cost_backend_ratio, costCpu);
+	} else {
+        model=new thresholdCostModel(recompTresh);
+	}
+	cout<<"deflate encoders besides zlib: "<<encoderList()<<endl;
+	for (int a=2; a<argc; a++){
+        if (strcmp(argv[a], "-estimate")==0){
+            estimateSample=estimate_sample;
+            if (((a+1)<argc)&&(argv[a+1][0]>='0')&&(argv[a+1][0]<='9')){
+                estimateSample=std::max(strtoull(argv[a+1], 0, 10), 1ULL);
+            }
+            cout<<"estimate mode, searching a sample of about "<<estimateSample<<" streams"<<endl;
+        }
+        if (strcmp(argv[a], "-lzma")==0){
+            #ifdef use_lzma
+            lzmaPreset=6;
+            if (((a+1)<argc)&&(argv[a+1][0]>='0')&&(argv[a+1][0]<='9')){
+                lzmaPreset=std::min(atoi(argv[a+1]), 9);
             }
-            case 72://hex 48
-            {
-                switch(rBuffer[i+1]){
-                    case 199:{//hex 48 C7
-                        #ifdef debug
-                        nMatch4++;
-                        cout<<"Found zlib header(48 C7) with 4K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 13));
-                        break;
-                    }
-                    case 137:{//hex 48 89
-                        #ifdef debug
-                        nMatch4++;
-                        cout<<"Found zlib header(48 89) with 4K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 14));
-                        break;
-                    }
-                    case 75:{//hex 48 4B
-                        #ifdef debug
-                        nMatch4++;
-                        cout<<"Found zlib header(48 4B) with 4K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 15));;
-                        break;
-                    }
-                    case 13:{//hex 48 0D
-                        #ifdef debug
-                        nMatch4++;
-                        cout<<"Found zlib header(48 0D) with 4K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 16));
-                        break;
-                    }
-                }
-                break;
+            cout<<"compressing the ATZ file with xz, preset "<<lzmaPreset<<endl;
+            if (!memory.fits(lzmaOutputBuf::memoryUsage(lzmaPreset, 1))){
+                cout<<"error: the xz encoder takes "<<lzmaOutputBuf::memoryUsage(lzmaPreset, 1)<<" bytes with this preset, more than the memory limit(see -mem-limit)"<<endl;
+                pause();
+                abort();
             }
-            case 56://hex 38
-            {
-                switch(rBuffer[i+1]){
-                    case 203:{
-                        #ifdef debug
-                        nMatch5++;
-                        cout<<"Found zlib header(38 CB) with 2K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 17));
-                        break;
-                    }
-                    case 141:{
-                        #ifdef debug
-                        nMatch5++;
-                        cout<<"Found zlib header(38 8D) with 2K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 18));
-                        break;
-                    }
-                    case 79:{
-                        #ifdef debug
-                        nMatch5++;
-                        cout<<"Found zlib header(38 4F) with 2K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 19));
-                        break;
-                    }
-                    case 17:{
-                        #ifdef debug
-                        nMatch5++;
-                        cout<<"Found zlib header(38 11) with 2K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 20));
-                        break;
-                    }
+            #else
+            cout<<"error: -lzma needs a build with liblzma(-Duse_lzma, link with -llzma)"<<endl;
+            pause();
+            abort();
+            #endif // use_lzma
+        }
+	}
+	if (archiveMode){//the file names go up to the first option
+        if (lzmaPreset>=0){
+            cout<<"error: -lzma does not work with archives, they are read with random access"<<endl;
+            pause();
+            abort();
+        }
+        vector<const char*> files;
+        for (int a=3; (a<argc)&&(argv[a][0]!='-'); a++){
+            files.push_back(argv[a]);
+        }
+        archiveFiles(argv[2], files, nestDepth, budget, memory, *model, sizediffTresh, slowmode);
+        return 0;
+	}
+	if (budget.fileLimit>0){
+        //with a file budget the search waits for phase 2 to finish, so that every stream is in the queue
+        //and the file budget is spent on the streams with the most to gain, no matter where they are in the file
+        jobs.capacity=static_cast<size_t>(-1);
+	}
+
+	struct stat statresults;
+	if (pipeMode){
+        input=&std::cin;
+	}else{
+        infile.open(infile_name, std::ios::in | std::ios::binary);
+        if (!infile.is_open()) {
+           cout << "error: open file for input failed!" << endl;
+           pause();
+           abort();
+        }
+        //getting the size of the file
+        if (stat(infile_name, &statresults) == 0){
+            cout<<"Input size:"<<statresults.st_size<<endl;
+        }
+        else{
+            cout<<"Error determining file size."<<endl;
+            pause();
+            abort();
+        }
+        in.data.reserve(statresults.st_size);//the buffer never has to move if the size is known
+        journal.enabled=(estimateSample==0);//an estimate is cheap to redo
+        journal.name=std::string(infile_name)+".journal";
+        journal.settings=journalSettings(budget, *model, sizediffTresh, slowmode);
+        in.hashing=journal.enabled;
+	}
+	//start the reader and the search workers, the main thread does phase 1 and 2 on the data as it arrives
+	reader=std::thread(readInput, input, &in, &memory);
+	if ((budget.fileLimit==0)&&(estimateSample==0)){
+        for (unsigned k=0; k<nthreads; k++){
+            workers.push_back(std::thread(searchWorker, &jobs, &streams, static_cast<const unsigned char*>(0), &budget, &memory, model, &journal, sizediffTresh, slowmode));
+        }
+	}
+	if (journal.enabled&&loadJournal(journal.name.c_str(), statresults.st_size, journal.settings, journalCrc, journalAdler, *model, journalStreams, searched, journalStreamsDone)){
+        //the journal is only used if the whole input still matches its key
+        in.waitFor(statresults.st_size+1);
+        if ((in.data.size()==static_cast<uint64_t>(statresults.st_size))&&(in.crc==journalCrc)&&(in.adler==journalAdler)){
+            j=0;
+            for (i=0; i<static_cast<int_fast64_t>(journalStreams.size()); i++){
+                if (searched[i]){
+                    j++;
                 }
-                break;
             }
-            case 40://hex 28
-            {
-                switch(rBuffer[i+1]){
-                    case 207:{
-                        #ifdef debug
-                        nMatch6++;
-                        cout<<"Found zlib header(28 CF) with 1K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 21));
-                        break;
-                    }
-                    case 145:{
-                        #ifdef debug
-                        nMatch6++;
-                        cout<<"Found zlib header(28 91) with 1K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 22));
-                        break;
-                    }
-                    case 83:{
-                        #ifdef debug
-                        nMatch6++;
-                        cout<<"Found zlib header(28 53) with 1K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 23));
-                        break;
+            cout<<"resuming from "<<journal.name<<", "<<j<<" of "<<journalStreams.size()<<" streams already searched"<<endl;
+            journal.resume=true;
+            journal.streamsInFile=journalStreams.size();
+            journal.start(in.data.size(), in.crc, in.adler);
+            if (journalStreamsDone){
+                //phase 1 and 2 are skipped, the stream list comes from the journal and only the streams without a result are searched
+                scanpos=in.data.size();
+                streams.swap(journalStreams);
+                for (i=0; i<static_cast<int_fast64_t>(streams.size()); i++){//the dictionaries are found again like phase 2 finds them
+                    if (streams.offsetType[i]>fdict_types){
+                        const std::vector<unsigned char>* dict=dictionaries.find(in, streams.offset[i], streams, fastInflate);
+                        if (dict!=0){
+                            streams.setDictionary(i, dict);
+                        }
+                    } else {
+                        dictionaries.addStream(i, streams, in);
                     }
-                    case 21:{
-                        #ifdef debug
-                        nMatch6++;
-                        cout<<"Found zlib header(28 15) with 1K window at offset: "<<i<<endl;
-                        #endif // debug
-                        offsetList.push_back(fileOffset(i, 24));
-                        break;
+                }
+                for (i=0; i<static_cast<int_fast64_t>(streams.size()); i++){
+                    if ((!searched[i])&&((concentrate<0)||(i==concentrate))){
+                        searchJob job(i, streams);
+                        if (budget.fileLimit>0){//the workers start after phase 2 and search the input in place
+                            jobs.push(job);
+                        } else {
+                            queueSearch(jobs, job, in, memory, sizediffTresh, slowmode);
+                        }
                     }
                 }
-                break;
             }
+            //otherwise phase 2 runs again and takes the results of the streams that are in the journal
+        } else {
+            cout<<journal.name<<" does not match the input, starting over"<<endl;
+            journalStreams.clear();
+            searched.clear();
         }
-    }
-    #ifdef debug
-    cout<<endl;
-	cout<<"32K full header matches:"<<nMatch1<<endl;
-	cout<<"16K full header matches:"<<nMatch2<<endl;
-	cout<<"8K full header matches:"<<nMatch3<<endl;
-	cout<<"4K full header matches:"<<nMatch4<<endl;
-	cout<<"2K full header matches:"<<nMatch5<<endl;
-	cout<<"1K full header matches:"<<nMatch6<<endl;
-	cout<<"Total header matches:"<<(nMatch1+nMatch2+nMatch3+nMatch4+nMatch5+nMatch6)<<endl;
-	cout<<"Number of collected offsets:"<<offsetList.size()<<endl;
-	//sanity check, the number of offsets in the vector should always be the sum of found offsets
-	if ((nMatch1+nMatch2+nMatch3+nMatch4+nMatch5+nMatch6)!=offsetList.size()){
-        cout<<"search error"<<endl;
-        pause();
-        abort();
+	} else {//a damaged journal can leave some of its streams behind
+        journalStreams.clear();
+        searched.clear();
 	}
-    pause();
-    #endif // debug
 
+    //PHASE 1 and 2 run together as the scanner/validator stage of the pipeline
+    //every round scans the newly read data for headers, then validates the new offsets and passes the good streams on to the search
+    //PHASE 1
+	//search the file for zlib headers, count them and create an offset list
+
+	//try to guess the number of potential zlib headers in the file from the file size
+	//this value is purely empirical, may need tweaking
+	offsetList.reserve(static_cast<int_fast64_t>(in.data.capacity()/1912));
+	#ifdef debug
+	cout<<"Offset list initial capacity:"<<offsetList.capacity()<<endl;
+	pause();
+	#endif
+	cout<<endl;
     //PHASE 2
     //start trying to decompress at the collected offsets
     /*
 		objects created:
-			streamOffsetList: vector holding offsets proven to be good
-			streamType: vector holding the types of proven offsets. Index-coupled to streamOffsetList.
-			streamLength: vector holding the lengths of proven offsets. Index-coupled to streamOffsetList.
-			inflatedLength: vector holding the inflated lengths of proven offsets. Index-coupled to streamOffsetList.
-			strm: zlib stream holding decompressed data
+			streams: table holding offsets proven to be good, with their types, lengths and inflated lengths
 		objects destroyed:
             none
 		objects created, but not provided or destroyed:
@@ -499,13 +6247,12 @@ int main(int argc, char* argv[]) {
 		variables declared:
 			lastGoodOffset: while iterating through the potential offsets, this keeps track of the previous good offset. Used for skipping offsets.
 			lastStreamLength: while iterating through the potential offsets, this keeps track of the length of the previous good stream. Used for skipping offsets.
-			memScale: used for dynamically scaling the decompression buffer if it proves to be too small
 			j: another general purpose iterator, to be used in nested for loops etc.
 			numOffsets: used to store the number of potential offsets. This is used to eliminate the need for a function call every time the loop need this number. Should improve speed slightly.
 			ret: used to store the return values of zlib functions
 		debug variables declared:
 			dataErrors:the number of improper offsets, that are not really zlib streams
-			numDecomp32k..1k: number of offsets with 32k..1k window that are valid
+			numDecomp32k..256: number of offsets with 32k..256 byte window that are valid
 		required:
             offsetList
             offsetType
@@ -517,1044 +6264,1079 @@ int main(int argc, char* argv[]) {
 			streamLength
 			inflatedLength
 			j
-			strm
 			ret
 	*/
 
-    numOffsets=offsetList.size();
-    for (i=0; i<numOffsets; i++)
-    {
-        if ((lastGoodOffset+lastStreamLength)<=offsetList[i].offset)
-        {
-            /*
-            local variables and objects:
-                decompBuffer: used to hold the data resulting from the decompression
-            */
-            //create a new Zlib stream to do decompression
-            strm.zalloc = Z_NULL;
-            strm.zfree = Z_NULL;
-            strm.opaque = Z_NULL;
-            //since we have no idea about the lenght of the zlib stream, take the worst case, i.e. everything after the header belongs to the stream
-            strm.avail_in= infileSize-offsetList[i].offset;
-            strm.next_in=rBuffer+offsetList[i].offset;//this is effectively adding an integer to a pointer, resulting in a pointer
-            //initialize the stream for decompression and check for error
-            ret=inflateInit(&strm);
-            if (ret != Z_OK)
-            {
-                cout<<"inflateInit() failed with exit code:"<<ret<<endl;
-                pause();
-                abort();
-            }
-            //a buffer needs to be created to hold the resulting decompressed data
-            //this is a big problem since the zlib header does not contain the length of the decompressed data
-            //the best we can do is to take a guess, and see if it was big enough, if not then scale it up
-            unsigned char* decompBuffer= new unsigned char[(memScale*5*(infileSize-offsetList[i].offset))]; //just a wild guess, corresponds to a compression ratio of 20%
-            strm.next_out=decompBuffer;
-            strm.avail_out=memScale*5*(infileSize-offsetList[i].offset);
-            ret=inflate(&strm, Z_FINISH);//try to do the actual decompression in one pass
-            //check the return value
-            switch (ret)
-            {
-                case Z_DATA_ERROR://the compressed data was invalid, most likely it was not a good offset
-                {
+    do {
+        //PHASE 1 on the data that has arrived since the last round, at most read_chunk bytes at a time
+        infileSize=in.waitFor(scanpos+2);//a header is 2 bytes
+        if (infileSize<(scanpos+2)){
+            scanning=false;//the input has ended and everything has been scanned
+        } else {
+            uint64_t scanend=std::min(infileSize-1, scanpos+read_chunk);
+            std::lock_guard<std::mutex> l(in.lock);//the reader must not move the buffer during the scan
+            rBuffer=in.data.data();
+            for(i=scanpos;i<scanend;i++){
+                int t=fdictType(rBuffer[i], rBuffer[i+1]);
+                if (t>0){//a header with a preset dictionary, none of the headers below has the FDICT bit
                     #ifdef debug
-                    dataErrors++;
+                    nMatchDict++;
+                    cout<<"Found zlib header with a preset dictionary at offset: "<<i<<endl;
                     #endif // debug
-                    break;
+                    offsetList.push_back(fileOffset(i, t));
+                    continue;
                 }
-                case Z_STREAM_END://decompression was succesful
-                {
-                    #ifdef debug
-                    switch(offsetList[i].offsetType){
-                        //32K window streams
-                        case 1:{//78 01
-                            cout<<"Stream #"<<i<<"(78 01) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp32k++;
-                            type1++;
-                            break;
-                        }
-                        case 2:{//78 5E
-                            cout<<"Stream #"<<i<<"(78 5E) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp32k++;
-                            type2++;
-                            break;
-                        }
-                        case 3:{//78 9C
-                            cout<<"Stream #"<<i<<"(78 9C) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp32k++;
-                            type3++;
-                            break;
-                        }
-                        case 4:{//78 DA
-                            cout<<"Stream #"<<i<<"(78 DA) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp32k++;
-                            type4++;
-                            break;
-                        }
-                        //16K window streams
-                        case 5:{//68 DE
-                            cout<<"Stream #"<<i<<"(68 DE) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp16k++;
-                            break;
-                        }
-                        case 6:{//68 81
-                            cout<<"Stream #"<<i<<"(68 81) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp16k++;
-                            break;
-                        }
-                        case 7:{//68 43
-                            cout<<"Stream #"<<i<<"(68 43) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp16k++;
-                            break;
-                        }
-                        case 8:{//68 05
-                            cout<<"Stream #"<<i<<"(68 05) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp16k++;
-                            break;
-                        }
-                        //8K window streams
-                        case 9:{//58 C3
-                            cout<<"Stream #"<<i<<"(58 C3) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp8k++;
-                            break;
-                        }
-                        case 10:{//58 85
-                            cout<<"Stream #"<<i<<"(58 85) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp8k++;
-                            break;
-                        }
-                        case 11:{//58 47
-                            cout<<"Stream #"<<i<<"(58 47) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp8k++;
-                            break;
-                        }
-                        case 12:{//58 09
-                            cout<<"Stream #"<<i<<"(58 09) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp8k++;
-                            break;
-                        }
-                        //4K window streams
-                        case 13:{
-                            cout<<"Stream #"<<i<<"(48 C7) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp4k++;
-                            break;
-                        }
-                        case 14:{
-                            cout<<"Stream #"<<i<<"(48 89) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp4k++;
-                            break;
-                        }
-                        case 15:{
-                            cout<<"Stream #"<<i<<"(48 4B) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp4k++;
-                            break;
-                        }
-                        case 16:{
-                            cout<<"Stream #"<<i<<"(48 0D) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp4k++;
-                            break;
-                        }
-                        //2K window streams
-                        case 17:{
-                            cout<<"Stream #"<<i<<"(38 CB) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp2k++;
-                            break;
-                        }
-                        case 18:{
-                            cout<<"Stream #"<<i<<"(38 8D) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp2k++;
-                            break;
-                        }
-                        case 19:{
-                            cout<<"Stream #"<<i<<"(38 4F) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp2k++;
-                            break;
-                        }
-                        case 20:{
-                            cout<<"Stream #"<<i<<"(38 11) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp2k++;
-                            break;
-                        }
-                        //1K window streams
-                        case 21:{
-                            cout<<"Stream #"<<i<<"(28 CF) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp1k++;
-                            break;
-                        }
-                        case 22:{
-                            cout<<"Stream #"<<i<<"(28 91) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp1k++;
-                            break;
-                        }
-                        case 23:{
-                            cout<<"Stream #"<<i<<"(28 53) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp1k++;
-                            break;
-                        }
-                        case 24:{
-                            cout<<"Stream #"<<i<<"(28 15) decompressed, "<<strm.total_in<<" bytes to "<<strm.total_out<<" bytes"<<endl;
-                            numDecomp1k++;
-                            break;
+                switch(rBuffer[i]){
+                    case 120://hex 78
+                    {
+                        switch(rBuffer[i+1]){
+                            case 1:{//hex 78 01
+                                #ifdef debug
+                                nMatch1++;
+                                cout<<"Found zlib header(78 01) with 32K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 1));
+                                break;
+                            }
+                            case 94:{//hex 78 5E
+                                #ifdef debug
+                                nMatch1++;
+                                cout<<"Found zlib header(78 5E) with 32K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 2));
+                                break;
+                            }
+                            case 156:{//hex 78 9C
+                                #ifdef debug
+                                nMatch1++;
+                                cout<<"Found zlib header(78 9C) with 32K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 3));
+                                break;
+                            }
+                            case 218:{//hex 78 DA
+                                #ifdef debug
+                                nMatch1++;
+                                cout<<"Found zlib header(78 DA) with 32K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 4));
+                                break;
+                            }
                         }
+                        break;
                     }
-                    #endif // debug
-                    if (strm.total_in>=16){
-                        lastGoodOffset=offsetList[i].offset;
-                        lastStreamLength=strm.total_in;
-                        streamOffsetList.push_back(streamOffset(offsetList[i].offset, offsetList[i].offsetType, strm.total_in, strm.total_out));
-                    } else{
-                        #ifdef debug
-                        dataErrors++;
-                        cout<<"   stream is under 16 bytes, ignoring"<<endl;
-                        #endif // debug
-                    }
-                    break;
-                }
-                case Z_BUF_ERROR:
-                {
-                    #ifdef debug
-                    cout<<"decompression buffer was too short"<<endl;
-                    #endif // debug
-                    memScale++;//increase buffer size for the next iteration
-                    i--;//make sure that we are retrying at this offset until the buffer is finally large enough
-                    break;
-                }
-                default://shit hit the fan, should never happen normally
-                {
-                    cout<<"inflate() failed with exit code:"<<ret<<endl;
-                    pause();
-                    abort();
-                }
-            }
-            //deallocate the zlib stream, check for errors and deallocate the decompression buffer
-            ret=inflateEnd(&strm);
-            if (ret!=Z_OK)
-            {
-                cout<<"inflateEnd() failed with exit code:"<<ret<<endl;//should never happen normally
-                pause();
-                return ret;
-            }
-            delete [] decompBuffer;
-        }
-        #ifdef debug
-        else
-        {
-            cout<<"skipping offset #"<<i<<" ("<<offsetList[i].offset<<") because it cannot be a header"<<endl;
-        }
-        #endif // debug
-    }
-    #ifdef debug
-    cout<<endl;
-    cout<<"Decompressed 32K streams: "<<numDecomp32k<<endl;
-    cout<<"type1: "<<type1<<endl;
-    cout<<"type2: "<<type2<<endl;
-    cout<<"type3: "<<type3<<endl;
-    cout<<"type4: "<<type4<<endl;
-    cout<<"Decompressed 16K streams: "<<numDecomp16k<<endl;
-    cout<<"Decompressed 8K streams: "<<numDecomp8k<<endl;
-    cout<<"Decompressed 4K streams: "<<numDecomp4k<<endl;
-    cout<<"Decompressed 2K streams: "<<numDecomp2k<<endl;
-    cout<<"Decompressed 1K streams: "<<numDecomp1k<<endl;
-    cout<<"data errors: "<<dataErrors<<endl;
-    cout<<"Total decompressed streams: "<<(numDecomp32k+numDecomp16k+numDecomp8k+numDecomp4k+numDecomp2k+numDecomp1k)<<endl;
-    #endif // debug
-    cout<<"Good offsets: "<<streamOffsetList.size()<<endl;
-    offsetList.clear();
-    offsetList.shrink_to_fit();
-    #ifdef debug
-    pause();
-    #endif // debug
-    //PHASE 3
-    //start trying to find the parameters to use for recompression
-
-    numGoodOffsets=streamOffsetList.size();
-    cout<<endl;
-    for (j=0; j<numGoodOffsets; j++){
-        if ((concentrate>=0)&&(j==0)) {
-            j=concentrate;
-            numGoodOffsets=concentrate;
-        }
-        //reset the Zlib stream to do decompression
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
-        fullmatch=false;
-        memlevel=9;
-        window=15;
-        //the lengths of the zlib streams have been saved by the previous phase
-        strm.avail_in = streamOffsetList[j].streamLength;
-        strm.next_in=rBuffer+streamOffsetList[j].offset;//this is effectively adding an integer to a pointer, resulting in a pointer
-        //initialize the stream for decompression and check for error
-        ret=inflateInit(&strm);
-        if (ret != Z_OK)
-        {
-            cout<<"inflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
-            pause();
-            abort();
-        }
-        //a buffer needs to be created to hold the resulting decompressed data
-        //since we have already deompressed the data before, we know exactly how large of a buffer we need to allocate
-        unsigned char* decompBuffer= new unsigned char[streamOffsetList[j].inflatedLength];
-        strm.next_out=decompBuffer;
-        strm.avail_out=streamOffsetList[j].inflatedLength;
-        ret=inflate(&strm, Z_FINISH);//try to do the actual decompression in one pass
-        //check the return value
-        switch (ret){
-            case Z_STREAM_END: //decompression was succesful
-            {
-                #ifdef debug
-                cout<<endl;
-                cout<<"stream #"<<j<<"("<<streamOffsetList[j].offset<<")"<<" ready for recompression trials"<<endl;
-                /*if(streamOffsetList[j].offset!=9887540){//debug code!!!! DISABLE IT UNLESS NEEDED
-                    window=10;
-                    clevel=1;
-                    memlevel=1;
-                }*/
-                #endif // debug
-                if (slowmode){
-                    #ifdef debug
-                    /*cout<<"   entering slow mode"<<endl;
-                    cout<<"   stream type: "<<streamOffsetList[j].offsetType<<endl;
-                    pause();*/
-                    #endif // debug
-                    do{
-                        memlevel=9;
-                        do {
-                            clevel=9;
-                            do {
-                                //resetting the variables
-                                strm1.zalloc = Z_NULL;
-                                strm1.zfree = Z_NULL;
-                                strm1.opaque = Z_NULL;
-                                strm1.next_in=decompBuffer;
+                    case 104://hex 68
+                    {
+                        switch(rBuffer[i+1]){
+                            case 222:{//hex 68 DE
+                                #ifdef debug
+                                nMatch2++;
+                                cout<<"Found zlib header(68 DE) with 16K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 5));
+                                break;
+                            }
+                            case 129:{//hex 68 81
+                                #ifdef debug
+                                nMatch2++;
+                                cout<<"Found zlib header(68 81) with 16K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 6));
+                                break;
+                            }
+                            case 67:{//hex 68 43
+                                #ifdef debug
+                                nMatch2++;
+                                cout<<"Found zlib header(68 43) with 16K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 7));
+                                break;
+                            }
+                            case 5:{//hex 68 05
+                                #ifdef debug
+                                nMatch2++;
+                                cout<<"Found zlib header(68 05) with 16K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 8));
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                    case 88://hex 58
+                    {
+                        switch(rBuffer[i+1]){
+                            case 195:{//hex 58 C3
                                 #ifdef debug
-                                /*cout<<"-------------------------"<<endl;
-                                cout<<"   memlevel:"<<memlevel<<endl;
-                                cout<<"   clevel:"<<clevel<<endl;
-                                cout<<"   window:"<<window<<endl;*/
+                                nMatch3++;
+                                cout<<"Found zlib header(58 C3) with 8K window at offset: "<<i<<endl;
                                 #endif // debug
-                                //use all default settings except clevel and memlevel
-                                ret = deflateInit2(&strm1, clevel, Z_DEFLATED, window, memlevel, Z_DEFAULT_STRATEGY);
-                                if (ret != Z_OK)
-                                {
-                                    cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
-                                    pause();
-                                    abort();
-                                }
+                                offsetList.push_back(fileOffset(i, 9));
+                                break;
+                            }
+                            case 133:{//hex 58 85
                                 #ifdef debug
-                                //cout<<"   deflate stream init done"<<endl;
+                                nMatch3++;
+                                cout<<"Found zlib header(58 85) with 8K window at offset: "<<i<<endl;
                                 #endif // debug
-
-                                //prepare for compressing in one pass
-                                strm1.avail_in=streamOffsetList[j].inflatedLength;
-                                unsigned char* recompBuffer=new unsigned char[deflateBound(&strm1, streamOffsetList[j].inflatedLength)]; //allocate output for worst case
-                                strm1.avail_out=deflateBound(&strm1, streamOffsetList[j].inflatedLength);
-                                strm1.next_out=recompBuffer;
-                                ret=deflate(&strm1, Z_FINISH);//do the actual compression
-                                //check the return value to see if everything went well
-                                if (ret != Z_STREAM_END){
-                                    cout<<"recompression failed with exit code:"<<ret<<endl;
-                                    pause();
-                                    abort();
-                                }
+                                offsetList.push_back(fileOffset(i, 10));
+                                break;
+                            }
+                            case 71:{//hex 58 47
                                 #ifdef debug
-                                //cout<<"   deflate done"<<endl;
+                                nMatch3++;
+                                cout<<"Found zlib header(58 47) with 8K window at offset: "<<i<<endl;
                                 #endif // debug
-
-                                //test if the recompressed stream matches the input data
-                                if (strm1.total_out!=streamOffsetList[j].streamLength){
-                                    identicalBytes=0;
-                                    //cout<<"   size difference: "<<(strm1.total_out-static_cast<int64_t>(streamOffsetList[j].streamLength))<<endl;
-                                    if (abs((strm1.total_out-streamOffsetList[j].streamLength))>sizediffTresh){
-                                        #ifdef debug
-                                        cout<<"   size difference is greater than "<<sizediffTresh<<" bytes, not comparing"<<endl;
-                                        #endif // debug
-                                    } else {
-                                        if (strm1.total_out<streamOffsetList[j].streamLength){
-                                            for (i=0; i<strm1.total_out;i++){
-                                                if (recompBuffer[i]==rBuffer[(i+streamOffsetList[j].offset)]){
-                                                    identicalBytes++;
-                                                }
-                                            }
-                                        } else {
-                                            for (i=0; i<streamOffsetList[j].streamLength;i++){
-                                                if (recompBuffer[i]==rBuffer[(i+streamOffsetList[j].offset)]){
-                                                    identicalBytes++;
-                                                }
-                                            }
-                                        }
-                                        #ifdef debug
-                                        cout<<"   "<<identicalBytes<<" bytes out of "<<streamOffsetList[j].streamLength<<" identical"<<endl;
-                                        #endif // debug
-                                        if (identicalBytes>streamOffsetList[j].identBytes){//if this recompressed stream has more matching bytes than the previous best
-                                            streamOffsetList[j].identBytes=identicalBytes;
-                                            streamOffsetList[j].clevel=clevel;
-                                            streamOffsetList[j].memlvl=memlevel;
-                                            streamOffsetList[j].window=window;
-                                            streamOffsetList[j].firstDiffByte=-1;
-                                            streamOffsetList[j].diffByteOffsets.clear();
-                                            streamOffsetList[j].diffByteVal.clear();
-                                            int_fast64_t last_i=0;
-                                            if (strm1.total_out<streamOffsetList[j].streamLength){//the recompressed stream is shorter than the original
-                                                for (i=0; i<strm1.total_out; i++){//compare the streams byte-by-byte
-                                                    if (recompBuffer[i]!=rBuffer[(i+streamOffsetList[j].offset)]){//if a mismatching byte is found
-                                                        if (streamOffsetList[j].firstDiffByte<0){//if the first different byte is negative, then this is the first
-                                                            streamOffsetList[j].firstDiffByte=(i);
-                                                            streamOffsetList[j].diffByteOffsets.push_back(0);
-                                                            streamOffsetList[j].diffByteVal.push_back(rBuffer[(i+streamOffsetList[j].offset)]);
-                                                            #ifdef debug
-                                                            cout<<"   first diff byte:"<<i<<endl;
-                                                            #endif // debug
-                                                            last_i=i;
-                                                        } else {
-                                                            streamOffsetList[j].diffByteOffsets.push_back(i-last_i);
-                                                            streamOffsetList[j].diffByteVal.push_back(rBuffer[(i+streamOffsetList[j].offset)]);
-                                                            //cout<<"   different byte:"<<i<<endl;
-                                                            last_i=i;
-                                                        }
-                                                    }
-                                                }
-                                                for (i=0; i<(streamOffsetList[j].streamLength-strm1.total_out); i++){
-                                                    if ((i==0)&&((last_i+1)<strm1.total_out)){
-                                                        streamOffsetList[j].diffByteOffsets.push_back(strm1.total_out-last_i);
-                                                    } else{
-                                                        streamOffsetList[j].diffByteOffsets.push_back(1);
-                                                    }
-                                                    streamOffsetList[j].diffByteVal.push_back(rBuffer[(i+strm1.total_out+streamOffsetList[j].offset)]);
-                                                    #ifdef debug
-                                                    cout<<"   byte at the end added :"<<+rBuffer[(i+strm1.total_out+streamOffsetList[j].offset)]<<endl;
-                                                    #endif // debug
-                                                }
-                                            } else {//the recompressed stream is longer than the original
-                                                for (i=0; i<streamOffsetList[j].streamLength;i++){
-                                                    if (recompBuffer[i]!=rBuffer[(i+streamOffsetList[j].offset)]){//if a mismatching byte is found
-                                                        if (streamOffsetList[j].firstDiffByte<0){//if the first different byte is negative, then this is the first
-                                                            streamOffsetList[j].firstDiffByte=(i);
-                                                            streamOffsetList[j].diffByteOffsets.push_back(0);
-                                                            streamOffsetList[j].diffByteVal.push_back(rBuffer[(i+streamOffsetList[j].offset)]);
-                                                            #ifdef debug
-                                                            cout<<"   first diff byte:"<<i<<endl;
-                                                            #endif // debug
-                                                            last_i=i;
-                                                        } else {
-                                                            streamOffsetList[j].diffByteOffsets.push_back(i-last_i);
-                                                            streamOffsetList[j].diffByteVal.push_back(rBuffer[(i+streamOffsetList[j].offset)]);
-                                                            //cout<<"   different byte:"<<i<<endl;
-                                                            last_i=i;
-                                                        }
-                                                    }
-                                                }
-                                            }
-                                        }
-                                    }
-                                    clevel--;
-                                } else {
-                                    #ifdef debug
-                                    cout<<"   stream sizes match, comparing"<<endl;
-                                    #endif // debug
-                                    identicalBytes=0;
-                                    for (i=0; i<strm1.total_out;i++){
-                                        if (recompBuffer[i]==rBuffer[(i+streamOffsetList[j].offset)]){
-                                            identicalBytes++;
-                                        }
-                                    }
-                                    if (identicalBytes==streamOffsetList[j].streamLength){
-                                        #ifdef debug
-                                        cout<<"   recompression succesful, full match"<<endl;
-                                        numFullmatch++;
-                                        #endif // debug
-                                        fullmatch=true;
-                                        streamOffsetList[j].identBytes=identicalBytes;
-                                        streamOffsetList[j].clevel=clevel;
-                                        streamOffsetList[j].memlvl=memlevel;
-                                        streamOffsetList[j].window=window;
-                                        streamOffsetList[j].firstDiffByte=-1;
-                                        streamOffsetList[j].diffByteOffsets.clear();
-                                        streamOffsetList[j].diffByteVal.clear();
-                                    } else {
-                                        #ifdef debug
-                                        cout<<"   partial match, "<<identicalBytes<<" bytes out of "<<streamOffsetList[j].streamLength<<" identical"<<endl;
-                                        #endif // debug
-                                        if (((streamOffsetList[j].streamLength-identicalBytes)==2)&&((recompBuffer[0]-rBuffer[streamOffsetList[j].offset])!=0)&&((recompBuffer[1]-rBuffer[(1+streamOffsetList[j].offset)])!=0)){
-                                            #ifdef debug
-                                            cout<<"   2 byte header mismatch, accepting"<<endl;
-                                            numFullmatch++;
-                                            #endif // debug
-                                            fullmatch=true;
-                                            streamOffsetList[j].identBytes=identicalBytes;
-                                            streamOffsetList[j].clevel=clevel;
-                                            streamOffsetList[j].memlvl=memlevel;
-                                            streamOffsetList[j].window=window;
-                                            streamOffsetList[j].firstDiffByte=0;
-                                            streamOffsetList[j].diffByteOffsets.clear();
-                                            streamOffsetList[j].diffByteVal.clear();
-                                            streamOffsetList[j].diffByteOffsets.push_back(0);
-                                            streamOffsetList[j].diffByteOffsets.push_back(1);
-                                            streamOffsetList[j].diffByteVal.push_back(rBuffer[streamOffsetList[j].offset]);
-                                            streamOffsetList[j].diffByteVal.push_back(rBuffer[(1+streamOffsetList[j].offset)]);
-                                        }
-                                        if (((streamOffsetList[j].streamLength-identicalBytes)==1)&&(((recompBuffer[0]-rBuffer[streamOffsetList[j].offset])!=0)||((recompBuffer[1]-rBuffer[(1+streamOffsetList[j].offset)])!=0))){
-                                            #ifdef debug
-                                            cout<<"   1 byte header mismatch, accepting"<<endl;
-                                            numFullmatch++;
-                                            #endif // debug
-                                            fullmatch=true;
-                                            streamOffsetList[j].identBytes=identicalBytes;
-                                            streamOffsetList[j].clevel=clevel;
-                                            streamOffsetList[j].memlvl=memlevel;
-                                            streamOffsetList[j].window=window;
-                                            streamOffsetList[j].diffByteOffsets.clear();
-                                            streamOffsetList[j].diffByteVal.clear();
-                                            if (recompBuffer[0]!=rBuffer[streamOffsetList[j].offset]){
-                                                streamOffsetList[j].firstDiffByte=0;
-                                                streamOffsetList[j].diffByteVal.push_back(rBuffer[streamOffsetList[j].offset]);
-                                            } else {
-                                                streamOffsetList[j].firstDiffByte=1;
-                                                streamOffsetList[j].diffByteVal.push_back(rBuffer[(1+streamOffsetList[j].offset)]);
-                                            }
-                                            streamOffsetList[j].diffByteOffsets.push_back(0);
-                                        }
-                                        if ((identicalBytes>streamOffsetList[j].identBytes)&&!fullmatch){
-                                            streamOffsetList[j].identBytes=identicalBytes;
-                                            streamOffsetList[j].clevel=clevel;
-                                            streamOffsetList[j].memlvl=memlevel;
-                                            streamOffsetList[j].window=window;
-                                            streamOffsetList[j].firstDiffByte=-1;
-                                            streamOffsetList[j].diffByteOffsets.clear();
-                                            streamOffsetList[j].diffByteVal.clear();
-                                            int_fast64_t last_i=0;
-                                            for (i=0; i<strm1.total_out; i++){//compare the streams byte-by-byte
-                                                if (recompBuffer[i]!=rBuffer[(i+streamOffsetList[j].offset)]){//if a mismatching byte is found
-                                                    if (streamOffsetList[j].firstDiffByte<0){//if the first different byte is negative, then this is the first
-                                                        streamOffsetList[j].firstDiffByte=(i);
-                                                        streamOffsetList[j].diffByteOffsets.push_back(0);
-                                                        streamOffsetList[j].diffByteVal.push_back(rBuffer[(i+streamOffsetList[j].offset)]);
-                                                        #ifdef debug
-                                                        cout<<"   first diff byte:"<<i<<endl;
-                                                        #endif // debug
-                                                        last_i=i;
-                                                    } else {
-                                                        streamOffsetList[j].diffByteOffsets.push_back(i-last_i);
-                                                        streamOffsetList[j].diffByteVal.push_back(rBuffer[(i+streamOffsetList[j].offset)]);
-                                                        #ifdef debug
-                                                        //cout<<"   different byte:"<<i<<endl;
-                                                        #endif // debug
-                                                        last_i=i;
-                                                    }
-                                                }
-                                            }
-                                        }
-                                        clevel--;
-                                    }
-                                }
-
-                                //deallocate the Zlib stream and check if it went well
-                                ret=deflateEnd(&strm1);
-                                if (ret != Z_OK)
-                                {
-                                    cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
-                                    pause();
-                                    abort();
-                                }
-                                delete [] recompBuffer;
+                                offsetList.push_back(fileOffset(i, 11));
+                                break;
+                            }
+                            case 9:{//hex 58 09
                                 #ifdef debug
-                                cout<<"   deflate stream end done"<<endl;
+                                nMatch3++;
+                                cout<<"Found zlib header(58 09) with 8K window at offset: "<<i<<endl;
                                 #endif // debug
-                            } while ((!fullmatch)&&(clevel>=1));
-                            memlevel--;
-                        } while ((!fullmatch)&&(memlevel>=1));
-                        window--;
-                    } while ((!fullmatch)&&(window>=10));
-                } else {
-                #ifdef debug
-                cout<<"   entering optimized mode"<<endl;
-                #endif // debug
-                /*switch (streamOffsetList[j].offsetType){
-                    case 1:{
-                        #ifdef debug
-                        cout<<"   stream type: 1"<<endl;
-                        #endif // debug
-                        do {
-                            //resetting the variables
-                            strm1.zalloc = Z_NULL;
-                            strm1.zfree = Z_NULL;
-                            strm1.opaque = Z_NULL;
-                            strm1.next_in=decompBuffer;
-                            #ifdef debug
-                            cout<<"   memlevel:"<<memlevel<<endl;
-                            #endif // debug
-                            //use all default settings except clevel and memlevel
-                            ret = deflateInit2(&strm1, 1, Z_DEFLATED, 15, memlevel, Z_DEFAULT_STRATEGY); //only try clevel 1, 0 would be no compression, would be pointless
-                            if (ret != Z_OK)
-                            {
-                                cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
-                                pause();
-                                abort();
+                                offsetList.push_back(fileOffset(i, 12));
+                                break;
                             }
-                            #ifdef debug
-                            cout<<"   deflate stream init done"<<endl;
-                            #endif // debug
-
-                            //prepare for compressing in one pass
-                            strm1.avail_in=streamOffsetList[j].inflatedLength;
-                            unsigned char* recompBuffer=new unsigned char[deflateBound(&strm1, streamOffsetList[j].inflatedLength)]; //allocate output for worst case
-                            strm1.avail_out=deflateBound(&strm1, streamOffsetList[j].inflatedLength);
-                            strm1.next_out=recompBuffer;
-                            ret=deflate(&strm1, Z_FINISH);//do the actual compression
-                            //check the return value to see if everything went well
-                            if (ret != Z_STREAM_END){
-                                cout<<"recompression failed with exit code:"<<ret<<endl;
-                                pause();
-                                abort();
+                        }
+                        break;
+                    }
+                    case 72://hex 48
+                    {
+                        switch(rBuffer[i+1]){
+                            case 199:{//hex 48 C7
+                                #ifdef debug
+                                nMatch4++;
+                                cout<<"Found zlib header(48 C7) with 4K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 13));
+                                break;
                             }
-                            #ifdef debug
-                            //cout<<"   deflate done"<<endl;
-                            #endif // debug
-
-                            //test if the recompressed stream matches the input data
-                            if (strm1.total_out!=streamOffsetList[j].streamLength){
-                                cout<<"   recompression failed, size difference"<<endl;
-                                memlevel--;
-                            } else {
+                            case 137:{//hex 48 89
                                 #ifdef debug
-                                cout<<"   stream sizes match, comparing"<<endl;
+                                nMatch4++;
+                                cout<<"Found zlib header(48 89) with 4K window at offset: "<<i<<endl;
                                 #endif // debug
-                                identicalBytes=0;
-                                for (i=0; i<strm1.total_out;i++){
-                                    if ((recompBuffer[i]-rBuffer[(i+streamOffsetList[j].offset)])==0){
-                                        identicalBytes++;
-                                    }
-                                }
-                                if (identicalBytes==streamOffsetList[j].streamLength){
-                                    #ifdef debug
-                                    cout<<"   recompression succesful, full match"<<endl;
-                                    #endif // debug
-                                    fullmatch=true;
-                                    numFullmatch++;
-                                } else {
-                                    #ifdef debug
-                                    cout<<"   partial match, "<<identicalBytes<<" bytes out of "<<streamOffsetList[j].streamLength<<" identical"<<endl;
-                                    pause();
-                                    #endif // debug
-                                    memlevel--;
-                                }
+                                offsetList.push_back(fileOffset(i, 14));
+                                break;
                             }
-
-                            //deallocate the Zlib stream and check if it went well
-                            ret=deflateEnd(&strm1);
-                            if (ret != Z_OK)
-                            {
-                                cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
-                                pause();
-                                abort();
+                            case 75:{//hex 48 4B
+                                #ifdef debug
+                                nMatch4++;
+                                cout<<"Found zlib header(48 4B) with 4K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 15));;
+                                break;
                             }
-                            delete [] recompBuffer;
-                            #ifdef debug
-                            cout<<"   deflate stream end done"<<endl;
-                            #endif // debug
-                        } while ((!fullmatch)&&(memlevel>=1));
+                            case 13:{//hex 48 0D
+                                #ifdef debug
+                                nMatch4++;
+                                cout<<"Found zlib header(48 0D) with 4K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 16));
+                                break;
+                            }
+                        }
                         break;
                     }
-                    case 4:{
-                        #ifdef debug
-                        cout<<"   stream type: 4"<<endl;
-                        #endif // debug
-                        do {
-                            clevel=9;
-                            do {
-                                //resetting the variables
-                                strm1.zalloc = Z_NULL;
-                                strm1.zfree = Z_NULL;
-                                strm1.opaque = Z_NULL;
-                                strm1.next_in=decompBuffer;
+                    case 56://hex 38
+                    {
+                        switch(rBuffer[i+1]){
+                            case 203:{
                                 #ifdef debug
-                                cout<<"   memlevel:"<<memlevel<<endl;
-                                cout<<"   clevel:"<<clevel<<endl;
+                                nMatch5++;
+                                cout<<"Found zlib header(38 CB) with 2K window at offset: "<<i<<endl;
                                 #endif // debug
-                                //use all default settings except clevel and memlevel
-                                ret = deflateInit2(&strm1, clevel, Z_DEFLATED, 15, memlevel, Z_DEFAULT_STRATEGY);
-                                if (ret != Z_OK)
-                                {
-                                    cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
-                                    pause();
-                                    abort();
-                                }
+                                offsetList.push_back(fileOffset(i, 17));
+                                break;
+                            }
+                            case 141:{
                                 #ifdef debug
-                                cout<<"   deflate stream init done"<<endl;
+                                nMatch5++;
+                                cout<<"Found zlib header(38 8D) with 2K window at offset: "<<i<<endl;
                                 #endif // debug
-
-                                //prepare for compressing in one pass
-                                strm1.avail_in=streamOffsetList[j].inflatedLength;
-                                unsigned char* recompBuffer=new unsigned char[deflateBound(&strm1, streamOffsetList[j].inflatedLength)]; //allocate output for worst case
-                                strm1.avail_out=deflateBound(&strm1, streamOffsetList[j].inflatedLength);
-                                strm1.next_out=recompBuffer;
-                                ret=deflate(&strm1, Z_FINISH);//do the actual compression
-                                //check the return value to see if everything went well
-                                if (ret != Z_STREAM_END){
-                                    cout<<"recompression failed with exit code:"<<ret<<endl;
-                                    pause();
-                                    abort();
-                                }
+                                offsetList.push_back(fileOffset(i, 18));
+                                break;
+                            }
+                            case 79:{
                                 #ifdef debug
-                                //cout<<"   deflate done"<<endl;
+                                nMatch5++;
+                                cout<<"Found zlib header(38 4F) with 2K window at offset: "<<i<<endl;
                                 #endif // debug
-
-                                //test if the recompressed stream matches the input data
-                                if (strm1.total_out!=streamOffsetList[j].streamLength){
-                                    #ifdef debug
-                                    cout<<"   recompression failed, size difference"<<endl;
-                                    #endif // debug
-                                    clevel--;
+                                offsetList.push_back(fileOffset(i, 19));
+                                break;
+                            }
+                            case 17:{
+                                #ifdef debug
+                                nMatch5++;
+                                cout<<"Found zlib header(38 11) with 2K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 20));
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                    case 40://hex 28
+                    {
+                        switch(rBuffer[i+1]){
+                            case 207:{
+                                #ifdef debug
+                                nMatch6++;
+                                cout<<"Found zlib header(28 CF) with 1K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 21));
+                                break;
+                            }
+                            case 145:{
+                                #ifdef debug
+                                nMatch6++;
+                                cout<<"Found zlib header(28 91) with 1K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 22));
+                                break;
+                            }
+                            case 83:{
+                                #ifdef debug
+                                nMatch6++;
+                                cout<<"Found zlib header(28 53) with 1K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 23));
+                                break;
+                            }
+                            case 21:{
+                                #ifdef debug
+                                nMatch6++;
+                                cout<<"Found zlib header(28 15) with 1K window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 24));
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                    case 24://hex 18
+                    {
+                        switch(rBuffer[i+1]){
+                            case 25:{//hex 18 19
+                                #ifdef debug
+                                nMatch7++;
+                                cout<<"Found zlib header(18 19) with 512 byte window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 25));
+                                break;
+                            }
+                            case 87:{//hex 18 57
+                                #ifdef debug
+                                nMatch7++;
+                                cout<<"Found zlib header(18 57) with 512 byte window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 26));
+                                break;
+                            }
+                            case 149:{//hex 18 95
+                                #ifdef debug
+                                nMatch7++;
+                                cout<<"Found zlib header(18 95) with 512 byte window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 27));
+                                break;
+                            }
+                            case 211:{//hex 18 D3
+                                #ifdef debug
+                                nMatch7++;
+                                cout<<"Found zlib header(18 D3) with 512 byte window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 28));
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                    case 8://hex 08
+                    {
+                        switch(rBuffer[i+1]){
+                            case 29:{//hex 08 1D
+                                #ifdef debug
+                                nMatch8++;
+                                cout<<"Found zlib header(08 1D) with 256 byte window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 29));
+                                break;
+                            }
+                            case 91:{//hex 08 5B
+                                #ifdef debug
+                                nMatch8++;
+                                cout<<"Found zlib header(08 5B) with 256 byte window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 30));
+                                break;
+                            }
+                            case 153:{//hex 08 99
+                                #ifdef debug
+                                nMatch8++;
+                                cout<<"Found zlib header(08 99) with 256 byte window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 31));
+                                break;
+                            }
+                            case 215:{//hex 08 D7
+                                #ifdef debug
+                                nMatch8++;
+                                cout<<"Found zlib header(08 D7) with 256 byte window at offset: "<<i<<endl;
+                                #endif // debug
+                                offsetList.push_back(fileOffset(i, 32));
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                }
+            }
+            scanpos=scanend;
+        }
+        //PHASE 2 on the new offsets
+        numOffsets=offsetList.size();
+        for (i=numChecked; i<numOffsets; i++)
+        {
+            if ((lastGoodOffset+lastStreamLength)<=offsetList[i].offset)
+            {
+                uint64_t streamLength;
+                uint64_t inflatedLength;
+                //this blocks if the stream goes past the data read so far
+                const std::vector<unsigned char>* dict=0;
+                if (offsetList[i].offsetType>fdict_types){//a stream with a preset dictionary can only be validated if its dictionary is known
+                    dict=dictionaries.find(in, offsetList[i].offset, streams, fastInflate);
+                    ret=(dict!=0)?validateZlib(in, offsetList[i].offset, streamLength, inflatedLength, dict):Z_DATA_ERROR;
+                } else {
+                    ret=validateStream(in, fastInflate, offsetList[i].offset, streamLength, inflatedLength);
+                }
+                //check the return value
+                switch (ret)
+                {
+                    case Z_DATA_ERROR://the compressed data was invalid, most likely it was not a good offset
+                    case Z_BUF_ERROR://the input ended before the stream did
+                    {
+                        #ifdef debug
+                        dataErrors++;
+                        #endif // debug
+                        break;
+                    }
+                    case Z_STREAM_END://decompression was succesful
+                    {
+                        #ifdef debug
+                        switch(offsetList[i].offsetType){
+                            //32K window streams
+                            case 1:{//78 01
+                                cout<<"Stream #"<<i<<"(78 01) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp32k++;
+                                type1++;
+                                break;
+                            }
+                            case 2:{//78 5E
+                                cout<<"Stream #"<<i<<"(78 5E) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp32k++;
+                                type2++;
+                                break;
+                            }
+                            case 3:{//78 9C
+                                cout<<"Stream #"<<i<<"(78 9C) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp32k++;
+                                type3++;
+                                break;
+                            }
+                            case 4:{//78 DA
+                                cout<<"Stream #"<<i<<"(78 DA) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp32k++;
+                                type4++;
+                                break;
+                            }
+                            //16K window streams
+                            case 5:{//68 DE
+                                cout<<"Stream #"<<i<<"(68 DE) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp16k++;
+                                break;
+                            }
+                            case 6:{//68 81
+                                cout<<"Stream #"<<i<<"(68 81) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp16k++;
+                                break;
+                            }
+                            case 7:{//68 43
+                                cout<<"Stream #"<<i<<"(68 43) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp16k++;
+                                break;
+                            }
+                            case 8:{//68 05
+                                cout<<"Stream #"<<i<<"(68 05) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp16k++;
+                                break;
+                            }
+                            //8K window streams
+                            case 9:{//58 C3
+                                cout<<"Stream #"<<i<<"(58 C3) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp8k++;
+                                break;
+                            }
+                            case 10:{//58 85
+                                cout<<"Stream #"<<i<<"(58 85) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp8k++;
+                                break;
+                            }
+                            case 11:{//58 47
+                                cout<<"Stream #"<<i<<"(58 47) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp8k++;
+                                break;
+                            }
+                            case 12:{//58 09
+                                cout<<"Stream #"<<i<<"(58 09) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp8k++;
+                                break;
+                            }
+                            //4K window streams
+                            case 13:{
+                                cout<<"Stream #"<<i<<"(48 C7) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp4k++;
+                                break;
+                            }
+                            case 14:{
+                                cout<<"Stream #"<<i<<"(48 89) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp4k++;
+                                break;
+                            }
+                            case 15:{
+                                cout<<"Stream #"<<i<<"(48 4B) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp4k++;
+                                break;
+                            }
+                            case 16:{
+                                cout<<"Stream #"<<i<<"(48 0D) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp4k++;
+                                break;
+                            }
+                            //2K window streams
+                            case 17:{
+                                cout<<"Stream #"<<i<<"(38 CB) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp2k++;
+                                break;
+                            }
+                            case 18:{
+                                cout<<"Stream #"<<i<<"(38 8D) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp2k++;
+                                break;
+                            }
+                            case 19:{
+                                cout<<"Stream #"<<i<<"(38 4F) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp2k++;
+                                break;
+                            }
+                            case 20:{
+                                cout<<"Stream #"<<i<<"(38 11) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp2k++;
+                                break;
+                            }
+                            //1K window streams
+                            case 21:{
+                                cout<<"Stream #"<<i<<"(28 CF) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp1k++;
+                                break;
+                            }
+                            case 22:{
+                                cout<<"Stream #"<<i<<"(28 91) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp1k++;
+                                break;
+                            }
+                            case 23:{
+                                cout<<"Stream #"<<i<<"(28 53) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp1k++;
+                                break;
+                            }
+                            case 24:{
+                                cout<<"Stream #"<<i<<"(28 15) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp1k++;
+                                break;
+                            }
+                            //512 byte window streams
+                            case 25:{
+                                cout<<"Stream #"<<i<<"(18 19) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp512++;
+                                break;
+                            }
+                            case 26:{
+                                cout<<"Stream #"<<i<<"(18 57) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp512++;
+                                break;
+                            }
+                            case 27:{
+                                cout<<"Stream #"<<i<<"(18 95) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp512++;
+                                break;
+                            }
+                            case 28:{
+                                cout<<"Stream #"<<i<<"(18 D3) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp512++;
+                                break;
+                            }
+                            //256 byte window streams
+                            case 29:{
+                                cout<<"Stream #"<<i<<"(08 1D) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp256++;
+                                break;
+                            }
+                            case 30:{
+                                cout<<"Stream #"<<i<<"(08 5B) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp256++;
+                                break;
+                            }
+                            case 31:{
+                                cout<<"Stream #"<<i<<"(08 99) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp256++;
+                                break;
+                            }
+                            case 32:{
+                                cout<<"Stream #"<<i<<"(08 D7) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecomp256++;
+                                break;
+                            }
+                            default:{
+                                cout<<"Stream #"<<i<<"(preset dictionary) decompressed, "<<streamLength<<" bytes to "<<inflatedLength<<" bytes"<<endl;
+                                numDecompDict++;
+                                break;
+                            }
+                        }
+                        #endif // debug
+                        if (streamLength>=16){
+                            lastGoodOffset=offsetList[i].offset;
+                            lastStreamLength=streamLength;
+                            uint64_t index=streams.add(offsetList[i].offset, offsetList[i].offsetType, streamLength, inflatedLength);
+                            if (dict!=0){
+                                streams.setDictionary(index, dict);
+                            } else {
+                                dictionaries.addStream(index, streams, in);
+                            }
+                            journal.startWhenRead(in);
+                            journal.addStream(index, streams);
+                            //take the result from the journal if the earlier run got that far
+                            if ((index<journalStreams.size())&&searched[index]&&(journalStreams.offset[index]==offsetList[i].offset)&&
+                                (journalStreams.streamLength[index]==streamLength)&&(journalStreams.inflatedLength[index]==inflatedLength)){
+                                streams.store(index, journalStreams.get(index));
+                            } else if (((concentrate<0)||(static_cast<int_fast64_t>(index)==concentrate))&&(estimateSample==0)){
+                                //hand the stream to the search workers
+                                searchJob job(index, streams);
+                                if (budget.fileLimit>0){//the workers start after phase 2 and search the input in place
+                                    jobs.push(job);
                                 } else {
-                                    #ifdef debug
-                                    cout<<"   stream sizes match, comparing"<<endl;
-                                    #endif // debug
-                                    identicalBytes=0;
-                                    for (i=0; i<strm1.total_out;i++){
-                                        if ((recompBuffer[i]-rBuffer[(i+streamOffsetList[j].offset)])==0){
-                                            identicalBytes++;
-                                        }
-                                    }
-                                    if (identicalBytes==streamOffsetList[j].streamLength){
-                                        #ifdef debug
-                                        cout<<"   recompression succesful, full match"<<endl;
-                                        #endif // debug
-                                        fullmatch=true;
-                                        numFullmatch++;
-                                    } else {
-                                        #ifdef debug
-                                        cout<<"   partial match, "<<identicalBytes<<" bytes out of "<<streamOffsetList[j].streamLength<<" identical"<<endl;
-                                        pause();
-                                        #endif // debug
-                                        clevel--;
-                                    }
-                                }
-
-                                //deallocate the Zlib stream and check if it went well
-                                ret=deflateEnd(&strm1);
-                                if (ret != Z_OK)
-                                {
-                                    cout<<"deflateInit() failed with exit code:"<<ret<<endl;//should never happen normally
-                                    pause();
-                                    abort();
+                                    queueSearch(jobs, job, in, memory, sizediffTresh, slowmode);
                                 }
-                                delete [] recompBuffer;
-                                #ifdef debug
-                                cout<<"   deflate stream end done"<<endl;
-                                #endif // debug
-                            } while ((!fullmatch)&&(clevel>=7));
-                            memlevel--;
-                        } while ((!fullmatch)&&(memlevel>=1));
+                            }
+                        } else{
+                            #ifdef debug
+                            dataErrors++;
+                            cout<<"   stream is under 16 bytes, ignoring"<<endl;
+                            #endif // debug
+                        }
                         break;
                     }
-                }*/
                 }
-                break;
             }
-            case Z_DATA_ERROR: //the compressed data was invalid, this should never happen since the offsets have been checked
+            #ifdef debug
+            else
             {
-                cout<<"inflate() failed with data error"<<endl;
-                pause();
-                abort();
+                cout<<"skipping offset #"<<i<<" ("<<offsetList[i].offset<<") because it cannot be a header"<<endl;
             }
-            case Z_BUF_ERROR: //this should not happen since the decompressed lengths are known
-            {
-                cout<<"inflate() failed with memory error"<<endl;
-                pause();
-                abort();
+            #endif // debug
+        }
+        numChecked=numOffsets;
+    } while (scanning);
+    #ifdef debug
+    cout<<endl;
+	cout<<"32K full header matches:"<<nMatch1<<endl;
+	cout<<"16K full header matches:"<<nMatch2<<endl;
+	cout<<"8K full header matches:"<<nMatch3<<endl;
+	cout<<"4K full header matches:"<<nMatch4<<endl;
+	cout<<"2K full header matches:"<<nMatch5<<endl;
+	cout<<"1K full header matches:"<<nMatch6<<endl;
+	cout<<"512 byte full header matches:"<<nMatch7<<endl;
+	cout<<"256 byte full header matches:"<<nMatch8<<endl;
+	cout<<"preset dictionary header matches:"<<nMatchDict<<endl;
+	cout<<"Total header matches:"<<(nMatch1+nMatch2+nMatch3+nMatch4+nMatch5+nMatch6+nMatch7+nMatch8+nMatchDict)<<endl;
+	cout<<"Number of collected offsets:"<<offsetList.size()<<endl;
+	//sanity check, the number of offsets in the vector should always be the sum of found offsets
+	if ((nMatch1+nMatch2+nMatch3+nMatch4+nMatch5+nMatch6+nMatch7+nMatch8+nMatchDict)!=offsetList.size()){
+        cout<<"search error"<<endl;
+        pause();
+        abort();
+	}
+    cout<<endl;
+    cout<<"Decompressed 32K streams: "<<numDecomp32k<<endl;
+    cout<<"type1: "<<type1<<endl;
+    cout<<"type2: "<<type2<<endl;
+    cout<<"type3: "<<type3<<endl;
+    cout<<"type4: "<<type4<<endl;
+    cout<<"Decompressed 16K streams: "<<numDecomp16k<<endl;
+    cout<<"Decompressed 8K streams: "<<numDecomp8k<<endl;
+    cout<<"Decompressed 4K streams: "<<numDecomp4k<<endl;
+    cout<<"Decompressed 2K streams: "<<numDecomp2k<<endl;
+    cout<<"Decompressed 1K streams: "<<numDecomp1k<<endl;
+    cout<<"Decompressed 512 byte streams: "<<numDecomp512<<endl;
+    cout<<"Decompressed 256 byte streams: "<<numDecomp256<<endl;
+    cout<<"Decompressed streams with a preset dictionary: "<<numDecompDict<<endl;
+    cout<<"data errors: "<<dataErrors<<endl;
+    cout<<"Total decompressed streams: "<<(numDecomp32k+numDecomp16k+numDecomp8k+numDecomp4k+numDecomp2k+numDecomp1k+numDecomp512+numDecomp256+numDecompDict)<<endl;
+    #endif // debug
+    cout<<"Good offsets: "<<streams.size()<<endl;
+    offsetList.clear();
+    offsetList.shrink_to_fit();
+    #ifdef debug
+    pause();
+    #endif // debug
+    //PHASE 3
+    //the search workers have been finding the parameters to use for recompression since the first stream was validated
+    //close their queue and wait for them to finish the remaining streams
+    reader.join();
+    journal.startWhenRead(in);
+    if (!journalStreamsDone){
+        journal.addRecord(journal_streams_done, std::vector<unsigned char>());
+    }
+    journalStreams.clear();
+    if ((budget.fileLimit>0)||(estimateSample>0)){//the search starts only now, see above
+        budget.start=std::chrono::steady_clock::now();
+        for (unsigned k=0; k<nthreads; k++){
+            workers.push_back(std::thread(searchWorker, &jobs, &streams, static_cast<const unsigned char*>(in.data.data()), &budget, &memory, model, &journal,
+                                          sizediffTresh, slowmode));
+        }
+    }
+    if (estimateSample>0){//only the sample is searched
+        strata=pickSample(streams, estimateSample);
+        for (uint64_t h=0; h<strata.size(); h++){
+            for (uint64_t k=0; k<strata[h].sample.size(); k++){
+                searchJob job(strata[h].sample[k], streams);
+                jobs.push(job);
             }
-            default: //shit hit the fan, should never happen normally
-            {
-                cout<<"inflate() failed with exit code:"<<ret<<endl;
-                pause();
-                abort();
+        }
+    }
+    jobs.close();
+    for (unsigned k=0; k<workers.size(); k++){
+        workers[k].join();
+    }
+    workers.clear();
+    rBuffer=in.data.data();
+    infileSize=in.data.size();
+    if (pipeMode){
+        cout<<"Input size:"<<infileSize<<endl;
+    }
+    if (estimateSample>0){
+        //extrapolate the number of recompressed streams and the size of their records in the ATZ file from the sample
+        //the search time is extrapolated from the inflated length, which is what it mostly depends on
+        std::vector<double> recompY(streams.size(), 0);
+        std::vector<double> growthY(streams.size(), 0);
+        uint64_t nsample=0;
+        bool sampleGroup[payload_groups]={false};
+        double sampleInflated=0;
+        double totalInflated=0;
+        for (uint64_t j=0; j<streams.size(); j++){
+            totalInflated=totalInflated+streams.inflatedLength[j];
+        }
+        for (uint64_t h=0; h<strata.size(); h++){
+            for (uint64_t k=0; k<strata[h].sample.size(); k++){
+                j=strata[h].sample[k];
+                streamOffset so=streams.get(j);
+                nsample++;
+                sampleInflated=sampleInflated+so.inflatedLength;
+                if (so.recomp){
+                    recompY[j]=1;
+                    //the table stores the gap to the previous recompressed stream instead of the offset,
+                    //the end of the previous stream in the file is the closest one that is known here, the index is counted below
+                    uint64_t prevEnd=(j>0)?(streams.offset[j-1]+streams.streamLength[j-1]):0;
+                    uint64_t runCount=varintLength(so.diffRunLen.size());
+                    uint64_t tableLen=recordLength(so)-48/atz_index_interval-varintLength(so.offset)+varintLength((so.offset>prevEnd)?(so.offset-prevEnd):0);
+                    if (so.clevel!=0){//stored streams have no diff
+                        tableLen=tableLen+runCount;
+                    }
+                    uint64_t runLen=so.diffSize()-so.diffByteVal.size()-runCount;
+                    //the payload replaces the stream in the residue, plus its table record and diff
+                    growthY[j]=static_cast<double>(so.inflatedLength)-so.streamLength+tableLen+runLen+so.diffByteVal.size();
+                    //and its checksum record: the length of its table, diff runs and diff values records and the crc32 of the record and of the payload
+                    growthY[j]=growthY[j]+varintLength(tableLen)+varintLength(runLen)+varintLength(so.diffByteVal.size())+8;
+                    if (so.payloadLength()>0){
+                        sampleGroup[payloadGroup(so, rBuffer, so.nestedLength>0)]=true;
+                    }
+                }
             }
         }
-        //deallocate the zlib stream, check for errors and deallocate the decompression buffer
-        ret=inflateEnd(&strm);
-        if (ret!=Z_OK)
-        {
-            cout<<"inflateEnd() failed with exit code:"<<ret<<endl;//should never happen normally
-            pause();
-            abort();
+        double recompEst;
+        double recompHalf;
+        double growthEst;
+        double growthHalf;
+        estimateTotal(strata, recompY, recompEst, recompHalf);
+        estimateTotal(strata, growthY, growthEst, growthHalf);
+        double searchTime=secondsSince(budget.start);
+        double atzBase=infileSize+12+varintLength(infileSize)+varintLength(recompEst)+5*3;//header and section headers
+        //the index has 6 values for every checkpoint
+        uint64_t ncheckpoints=(static_cast<uint64_t>(recompEst+0.5)+atz_index_interval-1)/atz_index_interval;
+        atzBase=atzBase+sectionLength(varintLength(atz_index_interval)+ncheckpoints*48);
+        //the checksums section: its header, the residue pieces, the crc32 of four sections and of the section itself
+        atzBase=atzBase+sectionLength(std::max(ncheckpoints, static_cast<uint64_t>(1))*4+5*4);
+        //the groups section is only written if the payloads fall in more than one group
+        int usedGroups=0;
+        for (int g=0; g<payload_groups; g++){
+            if (sampleGroup[g]) usedGroups++;
         }
-        delete [] decompBuffer;
-    }
-    if (concentrate>=0){
-        numGoodOffsets=streamOffsetList.size();
+        if (usedGroups>1){
+            atzBase=atzBase+sectionLength(varintLength(payload_groups)+static_cast<uint64_t>(recompEst+0.5)+ncheckpoints*payload_groups*8);
+        }
+        cout<<"estimate from "<<nsample<<" of "<<streams.size()<<" streams, searched in "<<searchTime<<" s"<<endl;
+        cout<<"recompressed streams: "<<static_cast<uint64_t>(recompEst+0.5)<<" (95% confidence: "<<static_cast<uint64_t>(std::max(recompEst-recompHalf, 0.0)+0.5);
+        cout<<" to "<<static_cast<uint64_t>(std::min(recompEst+recompHalf, static_cast<double>(streams.size()))+0.5)<<")"<<endl;
+        cout<<"ATZ size: "<<static_cast<uint64_t>(atzBase+growthEst)<<" bytes (95% confidence: "<<static_cast<uint64_t>(atzBase+growthEst-growthHalf);
+        cout<<" to "<<static_cast<uint64_t>(atzBase+growthEst+growthHalf)<<"), "<<(atzBase+growthEst)*100/std::max(infileSize, static_cast<uint64_t>(1))<<"% of the input"<<endl;
+        if (sampleInflated>0){
+            cout<<"a full search would take about "<<searchTime*totalInflated/sampleInflated<<" s"<<endl;
+        }
+        return 0;
     }
     cout<<endl;
     #ifdef debug
-    cout<<"fullmatch streams:"<<numFullmatch<<" out of "<<numGoodOffsets<<endl;
-    cout<<"streamOffsetList.size():"<<streamOffsetList.size()<<endl;
+    cout<<"fullmatch streams:"<<numFullmatch<<" out of "<<streams.size()<<endl;
+    cout<<"stored streams:"<<numStored<<endl;
+    cout<<"streams.size():"<<streams.size()<<endl;
     cout<<endl;
     pause();
     cout<<"Stream info"<<endl;
     #endif // debug
-    for (j=0; j<streamOffsetList.size(); j++){
+    for (uint64_t j=0; j<streams.size(); j++){
         #ifdef debug
+        //the table only keeps the diff of the streams that are recompressed
+        streamOffset so=streams.get(j);
         cout<<"-------------------------"<<endl;
         cout<<"   stream #"<<j<<endl;
-        cout<<"   offset:"<<streamOffsetList[j].offset<<endl;
-        cout<<"   memlevel:"<<+streamOffsetList[j].memlvl<<endl;
-        cout<<"   clevel:"<<+streamOffsetList[j].clevel<<endl;
-        cout<<"   window:"<<+streamOffsetList[j].window<<endl;
-        cout<<"   best match:"<<streamOffsetList[j].identBytes<<" out of "<<streamOffsetList[j].streamLength<<endl;
-        cout<<"   diffBytes:"<<streamOffsetList[j].diffByteOffsets.size()<<endl;
-        cout<<"   diffVals:"<<streamOffsetList[j].diffByteVal.size()<<endl;
+        cout<<"   offset:"<<so.offset<<endl;
+        cout<<"   memlevel:"<<+so.memlvl<<endl;
+        cout<<"   clevel:"<<+so.clevel<<endl;
+        cout<<"   window:"<<+so.window<<endl;
+        cout<<"   strategy:"<<+so.strategy<<endl;
+        cout<<"   recompressed:"<<so.recomp<<endl;
+        cout<<"   diffRuns:"<<so.diffRunLen.size()<<endl;
+        cout<<"   diffVals:"<<so.diffByteVal.size()<<endl;
+        cout<<"   diffSize:"<<so.diffSize()<<endl;
+        cout<<"   mismatched runs(gap,length):";
+        for (i=0; i<so.diffRunLen.size(); i++){
+            cout<<so.diffRunGap[i]<<","<<so.diffRunLen[i]<<";";
+        }
+        cout<<endl;
         #endif // debug
-        if (((streamOffsetList[j].streamLength-streamOffsetList[j].identBytes)<=recompTresh)&&(streamOffsetList[j].identBytes>0)){
+        if (streams.recomp(j)){//decided by the cost model as the search results came in
             recomp++;
-            streamOffsetList[j].recomp=true;
         }
-        #ifdef debug
-        cout<<"   mismatched bytes:";
-        for (i=0; i<streamOffsetList[j].diffByteOffsets.size(); i++){
-            cout<<streamOffsetList[j].diffByteOffsets[i]<<";";
+    }
+    cout<<"recompressed:"<<recomp<<"/"<<streams.size()<<endl;
+    cout<<"stream table: "<<streams.memoryUsage()<<" bytes";
+    if (streams.size()>0){
+        cout<<", "<<streams.memoryUsage()/streams.size()<<" per stream";
+    }
+    cout<<endl;
+    if ((budget.streamLimit>0)||(budget.fileLimit>0)){
+        cout<<"search budget used: "<<budget.fileAttempts<<" deflate attempts in "<<static_cast<uint64_t>(secondsSince(budget.start)*1000)<<" ms"<<endl;
+        cout<<"streams stopped early by the budget: "<<budget.numCut<<endl;
+        cout<<"streams skipped by the file budget: "<<budget.numSkipped<<endl;
+        for (uint64_t j=0; j<streams.size(); j++){
+            if (streams.skipped(j)){
+                cout<<"   skipped stream #"<<j<<" at "<<streams.offset[j]<<", "<<streams.streamLength[j]<<" bytes left in the residue"<<endl;
+            }
+            if (streams.cut(j)&&(!streams.recomp(j))){
+                cout<<"   stopped stream #"<<j<<" at "<<streams.offset[j]<<", "<<streams.streamLength[j]<<" bytes left in the residue"<<endl;
+            }
         }
-        cout<<endl;
-        #endif // debug
     }
-    cout<<"recompressed:"<<recomp<<"/"<<streamOffsetList.size()<<endl;
+    if (nestDepth>0){
+        //the payloads can have zlib streams of their own(a PNG in a PDF in a ZIP), those are found and searched in memory
+        //and the payload is replaced with the ATZ image of it, phase 5 rebuilds the innermost streams first
+        inflateBackend backend;
+        uint64_t numNested=0;
+        uint64_t numNoRoom=0;
+        nested.resize(streams.size());
+        for (uint64_t j=0; j<streams.size(); j++){
+            if (!streams.recomp(j)) continue;
+            streamOffset so=streams.get(j);
+            //the payload, the copy precompressMemory makes of it and the image, a payload without room for them is not nested
+            if (!memory.tryPin(so.inflatedLength*3)){
+                numNoRoom++;
+                continue;
+            }
+            vector<unsigned char> payload(so.inflatedLength);
+            inflatePayload(backend, so, rBuffer, payload.data());
+            if (precompressMemory(payload.data(), so.inflatedLength, nestDepth, budget, memory, *model, sizediffTresh, slowmode, 0, 0, nested[j])>0){
+                numNested++;
+            }
+            memory.unpin(so.inflatedLength*3);
+            if (!memory.tryPin(nested[j].size())){
+                numNoRoom++;
+                vector<unsigned char>().swap(nested[j]);
+            }
+            nestedPinned=nestedPinned+nested[j].size();
+        }
+        cout<<"nested: "<<numNested<<" of "<<recomp<<" payloads have recompressed streams inside"<<endl;
+        if (numNoRoom>0){
+            cout<<"   "<<numNoRoom<<" payloads were not nested because of the memory limit"<<endl;
+        }
+    }
+    if (memory.limit>0){
+        cout<<"streams not searched because of the memory limit: "<<memory.numTooLarge<<endl;
+    }
     #ifdef debug
     pause();
     #endif // debug
 
     //PHASE 4
-    //take the information created in phase 3 and use it to create an ATZ file(see ATZ file format spec.)
-    outfile.open(atzfile_name, std::ios::out | std::ios::binary | std::ios::trunc);
-	if (!outfile.is_open()) {
-       cout << "error: open file for output failed!" << endl;
-       pause();
- 	   abort();
-	}
-    {//write file header and version
-        unsigned char* atz1=new unsigned char[4];
-        atz1[0]=65;
-        atz1[1]=84;
-        atz1[2]=90;
-        atz1[3]=1;
-        outfile.write(reinterpret_cast<char*>(atz1), 4);
-        delete [] atz1;
-    }
-
-    outfile.write(reinterpret_cast<char*>(&atzlen), 8);
-    outfile.write(reinterpret_cast<char*>(&infileSize), 8);//the length of the original file
-    outfile.write(reinterpret_cast<char*>(&recomp), 8);//number of recompressed streams
-
-    for(j=0;j<streamOffsetList.size();j++){//write recompressed stream descriptions
-        if (streamOffsetList[j].recomp==true){//we are operating on the j-th stream
-            #ifdef debug
-            cout<<"recompressing stream #"<<j<<endl;
-            #endif // debug
-            outfile.write(reinterpret_cast<char*>(&streamOffsetList[j].offset), 8);
-            outfile.write(reinterpret_cast<char*>(&streamOffsetList[j].streamLength), 8);
-            outfile.write(reinterpret_cast<char*>(&streamOffsetList[j].inflatedLength), 8);
-            outfile.write(reinterpret_cast<char*>(&streamOffsetList[j].clevel), 1);
-            outfile.write(reinterpret_cast<char*>(&streamOffsetList[j].window), 1);
-            outfile.write(reinterpret_cast<char*>(&streamOffsetList[j].memlvl), 1);
-
-            {
-                uint64_t diffbytes=streamOffsetList[j].diffByteOffsets.size();
-                outfile.write(reinterpret_cast<char*>(&diffbytes), 8);
-                if (diffbytes>0){
-                    uint64_t firstdiff=streamOffsetList[j].firstDiffByte;
-                    outfile.write(reinterpret_cast<char*>(&firstdiff), 8);
-                    uint64_t diffos;
-                    uint8_t diffval;
-                    for(i=0;i<diffbytes;i++){
-                        diffos=streamOffsetList[j].diffByteOffsets[i];
-                        outfile.write(reinterpret_cast<char*>(&diffos), 8);
-                    }
-                    for(i=0;i<diffbytes;i++){
-                        diffval=streamOffsetList[j].diffByteVal[i];
-                        outfile.write(reinterpret_cast<char*>(&diffval), 1);
-                    }
-                }
-            }
-
-            //create a new Zlib stream to do decompression
-            strm.zalloc = Z_NULL;
-            strm.zfree = Z_NULL;
-            strm.opaque = Z_NULL;
-            strm.avail_in= streamOffsetList[j].streamLength;
-            strm.next_in=rBuffer+streamOffsetList[j].offset;
-            //initialize the stream for decompression and check for error
-            ret=inflateInit(&strm);
-            if (ret != Z_OK)
-            {
-                cout<<"inflateInit() failed with exit code:"<<ret<<endl;
-                pause();
-                abort();
-            }
-            //a buffer needs to be created to hold the resulting decompressed data
-            unsigned char* decompBuffer= new unsigned char[streamOffsetList[j].inflatedLength];
-            strm.next_out=decompBuffer;
-            strm.avail_out=streamOffsetList[j].inflatedLength;
-            ret=inflate(&strm, Z_FINISH);//try to do the actual decompression in one pass
-            //check the return value
-            switch (ret)
-            {
-                case Z_STREAM_END://decompression was succesful
-                {
-                    break;
-                }
-                default://shit hit the fan, should never happen normally
-                {
-                    cout<<"inflate() failed with exit code:"<<ret<<endl;
-                    pause();
-                    abort();
-                }
-            }
-            //deallocate the zlib stream, check for errors
-            ret=inflateEnd(&strm);
-            if (ret!=Z_OK)
-            {
-                cout<<"inflateEnd() failed with exit code:"<<ret<<endl;//should never happen normally
-                pause();
-                return ret;
-            }
-            outfile.write(reinterpret_cast<char*>(decompBuffer), streamOffsetList[j].inflatedLength);
-            delete [] decompBuffer;
+    //take the information created in phase 3 and use it to create an ATZ file(see the ATZ2 layout at the top)
+    if (pipeMode){
+        atzout=&stdoutData;
+    } else {
+        outfile.open(atzfile_name, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!outfile.is_open()) {
+           cout << "error: open file for output failed!" << endl;
+           pause();
+           abort();
         }
     }
-
-
-    for(j=0;j<streamOffsetList.size();j++){//write the gaps before streams and non-recompressed streams to disk as the residue
-        if ((lastos+lastlen)==streamOffsetList[j].offset){
-            #ifdef debug
-            cout<<"no gap before stream #"<<j<<endl;
-            #endif // debug
-            if (streamOffsetList[j].recomp==false){
-                #ifdef debug
-                cout<<"copying stream #"<<j<<endl;
-                #endif // debug
-                outfile.write(reinterpret_cast<char*>(rBuffer+streamOffsetList[j].offset), streamOffsetList[j].streamLength);
-            }
-        }else{
-            #ifdef debug
-            cout<<"gap of "<<(streamOffsetList[j].offset-(lastos+lastlen))<<" bytes before stream #"<<j<<endl;
-            #endif // debug
-            outfile.write(reinterpret_cast<char*>(rBuffer+lastos+lastlen), (streamOffsetList[j].offset-(lastos+lastlen)));
-            if (streamOffsetList[j].recomp==false){
-                #ifdef debug
-                cout<<"copying stream #"<<j<<endl;
-                #endif // debug
-                outfile.write(reinterpret_cast<char*>(rBuffer+streamOffsetList[j].offset), streamOffsetList[j].streamLength);
-            }
+    if (lzmaPreset>=0){
+        #ifdef use_lzma
+        //the encoder takes a lot of memory per thread, it gets as many threads as the memory limit has room for
+        unsigned xzThreads=nthreads;
+        while ((xzThreads>1)&&(!memory.fits(lzmaOutputBuf::memoryUsage(lzmaPreset, xzThreads)))){
+            xzThreads--;
         }
-        lastos=streamOffsetList[j].offset;
-        lastlen=streamOffsetList[j].streamLength;
+        uint64_t xzMemory=lzmaOutputBuf::memoryUsage(lzmaPreset, xzThreads);
+        memory.pin(xzMemory);
+        lzmaOutputBuf xzBuf(*atzout, lzmaPreset, xzThreads);
+        std::ostream xzOut(&xzBuf);
+        atzlen=writeAtz(xzOut, streams, rBuffer, infileSize, nested, 0, memory);
+        xzBuf.finish();
+        filelen=xzBuf.written;
+        memory.unpin(xzMemory);
+        cout<<"ATZ data: "<<atzlen<<" bytes, compressed with xz"<<endl;
+        #endif // use_lzma
+    } else {
+        atzlen=writeAtz(*atzout, streams, rBuffer, infileSize, nested, 0, memory);
+        filelen=atzlen;
     }
-    if((lastos+lastlen)<infileSize){//if there is stuff after the last stream, write that to disk too
-        #ifdef debug
-        cout<<(infileSize-(lastos+lastlen))<<" bytes copied from the end of the file"<<endl;
-        #endif // debug
-        outfile.write(reinterpret_cast<char*>(rBuffer+lastos+lastlen), (infileSize-(lastos+lastlen)));
+    atzout->flush();
+    if ((!*atzout)||((!pipeMode)&&(static_cast<uint64_t>(outfile.tellp())!=filelen))){
+        cout<<"error: writing the ATZ file failed"<<endl;
+        pause();
+        abort();
+    }
+    cout<<"Total bytes written: "<<filelen<<endl;
+    if (memory.limit>0){
+        cout<<"peak memory accounted: "<<memory.peak<<" of "<<memory.limit<<" bytes"<<endl;
     }
-
-    atzlen=outfile.tellp();
-    cout<<"Total bytes written: "<<atzlen<<endl;
-    outfile.seekp(4);//go back to the placeholder
-    outfile.write(reinterpret_cast<char*>(&atzlen), 8);
     #ifdef debug
     pause();
     #endif // debug
-    streamOffsetList.clear();
-    streamOffsetList.shrink_to_fit();
+    streams.clear();
+    memory.unpin(nestedPinned+in.data.capacity());
+    vector<vector<unsigned char> >().swap(nested);
+    in.data.clear();
+    in.data.shrink_to_fit();
+    if (pipeMode){//stdout cannot be read back, so there is no verification
+        return 0;
+    }
     outfile.close();
-    delete [] rBuffer;
 
     PHASE5:
     //PHASE 5: verify that we can reconstruct the original file, using only data from the ATZ file
     infileSize=0;
     atzlen=0;
-    lastos=28;
     uint64_t origlen=0;
     uint64_t nstrms=0;
 
-    std::ifstream atzfile(atzfile_name, std::ios::in | std::ios::binary);
-	if (!atzfile.is_open()) {
-       cout << "error: open ATZ file for input failed!" << endl;
-       pause();
- 	   abort();
-	}
-	cout<<"reconstructing from "<<atzfile_name<<endl;
-    if (stat(atzfile_name, &statresults) == 0){
-    	cout<<"File size:"<<statresults.st_size<<endl;
-    }
-    else{
-    	cout<<"Error determining file size."<<endl;
-    	pause();
-    	abort();
-    }
-    infileSize=statresults.st_size;
-    //setting up read buffer and reading the entire file into the buffer
-    unsigned char* atzBuffer = new unsigned char[infileSize];
-    atzfile.read(reinterpret_cast<char*>(atzBuffer), infileSize);
-    atzfile.close();
-
-    if ((atzBuffer[0]!=65)||(atzBuffer[1]!=84)||(atzBuffer[2]!=90)||(atzBuffer[3]!=1)){
-        cout<<"ATZ1 header not found"<<endl;
+    std::ifstream atzfile;
+    std::istream* atzsrc=&atzfile;
+    if (strcmp(atzfile_name, "-")==0){//stdin cannot seek, so the ATZ data is read completely before it is parsed
+        cout<<"reconstructing from stdin"<<endl;
+        atzsrc=&std::cin;
+    } else {
+        atzfile.open(atzfile_name, std::ios::in | std::ios::binary);
+        if (!atzfile.is_open()) {
+           cout << "error: open ATZ file for input failed!" << endl;
+           pause();
+           abort();
+        }
+        cout<<"reconstructing from "<<atzfile_name<<endl;
+        if (stat(atzfile_name, &statresults) == 0){
+            cout<<"File size:"<<statresults.st_size<<endl;
+        }
+        else{
+            cout<<"Error determining file size."<<endl;
+            pause();
+            abort();
+        }
+        if ((memory.limit>0)&&(!memory.fits(statresults.st_size))&&(!isXzFile(atzfile))){
+            //the ATZ file does not fit the memory limit, so it is checked and rebuilt piece by piece through its index(see -scrub and -x)
+            //only ATZ2 files have an index, an ATZ1 file has to be read whole
+            unsigned char head[4]={0, 0, 0, 0};
+            atzfile.read(reinterpret_cast<char*>(head), 4);
+            atzfile.clear();
+            atzfile.seekg(0);
+            if (head[3]<2){
+                cout<<"error: the ATZ file is an ATZ1 file without an index, it has to be read whole and does not fit the memory limit(see -mem-limit)"<<endl;
+                pause();
+                abort();
+            }
+            cout<<"the ATZ file does not fit the memory limit, rebuilding the file piece by piece"<<endl;
+            atzfile.close();
+            if (scrubFile(atzfile_name, nthreads)>0){
+                cout<<"corrupt ATZ file: the parts above do not match their checksums"<<endl;
+                pause();
+                abort();
+            }
+            std::ofstream recfile(reconfile_name, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!recfile.is_open()) {
+               cout << "error: open file for output failed!" << endl;
+               pause();
+               abort();
+            }
+            extractRange(atzfile_name, 0, UINT64_MAX, recfile);
+            recfile.flush();
+            if (!recfile){
+                cout<<"error: writing the reconstructed file failed"<<endl;
+                pause();
+                abort();
+            }
+            return 0;
+        }
+        in.data.reserve(statresults.st_size);
+    }
+    if (isXzFile(*atzsrc)){//see -lzma
+        #ifdef use_lzma
+        cout<<"the ATZ file is compressed with xz, decompressing it"<<endl;
+        lzmaInputBuf xzBuf(*atzsrc, nthreads);
+        std::istream xzIn(&xzBuf);
+        readInput(&xzIn, &in, &memory);
+        #else
+        cout<<"error: the ATZ file is compressed with xz, decompress it with xz -d or use a build with liblzma(-Duse_lzma)"<<endl;
         pause();
         abort();
+        #endif // use_lzma
+    } else {
+        readInput(atzsrc, &in, &memory);
     }
-    atzlen=*reinterpret_cast<uint64_t*>(&atzBuffer[4]);
+    atzfile.close();
+    infileSize=in.data.size();
+    unsigned char* atzBuffer=in.data.data();
+    memoryStreamBuf atzBuf(atzBuffer, infileSize);
+    std::istream atzStream(&atzBuf);
+    atzLayout layout;
+    readAtzLayout(atzStream, layout, 0);//checks the header and finds the sections
+    atzlen=layout.atzlen;
     if (atzlen!=infileSize){
         cout<<"atzlen mismatch"<<endl;
         pause();
         abort();
     }
-    origlen=*reinterpret_cast<uint64_t*>(&atzBuffer[12]);
-    nstrms=*reinterpret_cast<uint64_t*>(&atzBuffer[20]);
+    if ((layout.checksumslen>0)&&(scrubAtz(0, atzBuffer, infileSize, layout, nthreads)>0)){//see -scrub
+        cout<<"corrupt ATZ file: the parts above do not match their checksums"<<endl;
+        pause();
+        abort();
+    }
+    origlen=layout.origlen;
+    nstrms=layout.nstrms;
+    uint64_t residueos=layout.residueos;
+    //the reconstructed file goes to stdout in stdin/stdout mode
+    std::ofstream recfile;
+    std::ostream* recout=&stdoutData;
+    if (strcmp(reconfile_name, "-")!=0){
+        recfile.open(reconfile_name, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!recfile.is_open()) {
+           cout << "error: open file for output failed!" << endl;
+           pause();
+           abort();
+        }
+        recout=&recfile;
+    }
+
     #ifdef debug
     cout<<"nstrms:"<<nstrms<<endl;
     #endif // debug
     if (nstrms>0){
         streamOffsetList.reserve(nstrms);
         //reead in all the info about the streams
-        for (j=0;j<nstrms;j++){
-            #ifdef debug
-            cout<<"stream #"<<j<<endl;
-            #endif // debug
-            streamOffsetList.push_back(streamOffset(*reinterpret_cast<uint64_t*>(&atzBuffer[lastos]), -1, *reinterpret_cast<uint64_t*>(&atzBuffer[8+lastos]), *reinterpret_cast<uint64_t*>(&atzBuffer[16+lastos])));
-            streamOffsetList[j].clevel=atzBuffer[24+lastos];
-            streamOffsetList[j].window=atzBuffer[25+lastos];
-            streamOffsetList[j].memlvl=atzBuffer[26+lastos];
-            #ifdef debug
-            cout<<"   offset:"<<streamOffsetList[j].offset<<endl;
-            cout<<"   memlevel:"<<+streamOffsetList[j].memlvl<<endl;
-            cout<<"   clevel:"<<+streamOffsetList[j].clevel<<endl;
-            cout<<"   window:"<<+streamOffsetList[j].window<<endl;
-            #endif // debug
-            //partial match handling
-            uint64_t diffbytes=*reinterpret_cast<uint64_t*>(&atzBuffer[27+lastos]);
-            if (diffbytes>0){//if the stream is just a partial match
+        if (layout.version==2){
+            readStreamList(atzBuffer, layout, streamOffsetList);
+            for (uint64_t j=0; j<streamOffsetList.size(); j++){
+                if (streamOffsetList[j].sharedPos>0){
+                    cout<<"this is an archive member, unpack the archive with -unpack"<<endl;
+                    pause();
+                    abort();
+                }
+            }
+        } else {//ATZ1, fixed size records with the inflated data right after each record
+            lastos=28;
+            for (j=0;j<nstrms;j++){
                 #ifdef debug
-                cout<<"   partial match"<<endl;
+                cout<<"stream #"<<j<<endl;
                 #endif // debug
-                streamOffsetList[j].firstDiffByte=*reinterpret_cast<uint64_t*>(&atzBuffer[35+lastos]);
-                streamOffsetList[j].diffByteOffsets.reserve(diffbytes);
-                streamOffsetList[j].diffByteVal.reserve(diffbytes);
-                for (i=0;i<diffbytes;i++){
-                    streamOffsetList[j].diffByteOffsets.push_back(*reinterpret_cast<uint64_t*>(&atzBuffer[43+8*i+lastos]));
-                    streamOffsetList[j].diffByteVal.push_back(atzBuffer[43+diffbytes*8+i+lastos]);
+                streamOffsetList.push_back(streamOffset(*reinterpret_cast<uint64_t*>(&atzBuffer[lastos]), -1, *reinterpret_cast<uint64_t*>(&atzBuffer[8+lastos]), *reinterpret_cast<uint64_t*>(&atzBuffer[16+lastos])));
+                streamOffsetList[j].clevel=atzBuffer[24+lastos];
+                if (streamOffsetList[j].clevel==0){//stored stream, read the zlib header and the block lengths
+                    streamOffsetList[j].zlibHeader=(atzBuffer[25+lastos]<<8)|atzBuffer[26+lastos];
+                    uint64_t nblocks=*reinterpret_cast<uint64_t*>(&atzBuffer[27+lastos]);
+                    #ifdef debug
+                    cout<<"   offset:"<<streamOffsetList[j].offset<<endl;
+                    cout<<"   stored, "<<nblocks<<" blocks"<<endl;
+                    #endif // debug
+                    if (((35+lastos)>infileSize)||(nblocks>((infileSize-(35+lastos))/2))){
+                        cout<<"corrupt ATZ file: stream table is truncated"<<endl;
+                        pause();
+                        abort();
+                    }
+                    streamOffsetList[j].storedBlockLen.resize(nblocks);
+                    memcpy(streamOffsetList[j].storedBlockLen.data(), &atzBuffer[35+lastos], nblocks*2);
+                    checkStoredBlocks(streamOffsetList[j]);
+                    if (streamOffsetList[j].inflatedLength>(infileSize-(35+lastos+nblocks*2))){
+                        cout<<"corrupt ATZ file: stream table is truncated"<<endl;
+                        pause();
+                        abort();
+                    }
+                    streamOffsetList[j].atzInfos=&atzBuffer[35+nblocks*2+lastos];
+                    lastos=lastos+35+nblocks*2+streamOffsetList[j].inflatedLength;
+                    continue;
                 }
-                streamOffsetList[j].atzInfos=&atzBuffer[43+diffbytes*9+lastos];
-                lastos=lastos+43+diffbytes*9+streamOffsetList[j].inflatedLength;
-            } else{//if the stream is a full match
+                streamOffsetList[j].window=atzBuffer[25+lastos];
+                streamOffsetList[j].memlvl=atzBuffer[26+lastos];
                 #ifdef debug
-                cout<<"   full match"<<endl;
+                cout<<"   offset:"<<streamOffsetList[j].offset<<endl;
+                cout<<"   memlevel:"<<+streamOffsetList[j].memlvl<<endl;
+                cout<<"   clevel:"<<+streamOffsetList[j].clevel<<endl;
+                cout<<"   window:"<<+streamOffsetList[j].window<<endl;
                 #endif // debug
-                streamOffsetList[j].firstDiffByte=-1;//negative value signals full match
-                streamOffsetList[j].atzInfos=&atzBuffer[35+lastos];
-                lastos=lastos+35+streamOffsetList[j].inflatedLength;
+                //partial match handling
+                uint64_t diffbytes=*reinterpret_cast<uint64_t*>(&atzBuffer[27+lastos]);
+                if (diffbytes>0){//if the stream is just a partial match
+                    #ifdef debug
+                    cout<<"   partial match"<<endl;
+                    #endif // debug
+                    //ATZ1 stores every mismatching byte separately, with offsets relative to the previous one
+                    uint64_t diffpos=*reinterpret_cast<uint64_t*>(&atzBuffer[35+lastos]);
+                    for (i=0;i<diffbytes;i++){
+                        diffpos=diffpos+*reinterpret_cast<uint64_t*>(&atzBuffer[43+8*i+lastos]);
+                        streamOffsetList[j].addDiffByte(diffpos, atzBuffer[43+diffbytes*8+i+lastos]);
+                    }
+                    streamOffsetList[j].atzInfos=&atzBuffer[43+diffbytes*9+lastos];
+                    lastos=lastos+43+diffbytes*9+streamOffsetList[j].inflatedLength;
+                } else{//if the stream is a full match
+                    #ifdef debug
+                    cout<<"   full match"<<endl;
+                    #endif // debug
+                    streamOffsetList[j].atzInfos=&atzBuffer[35+lastos];
+                    lastos=lastos+35+streamOffsetList[j].inflatedLength;
+                }
             }
+            residueos=lastos;
         }
         #ifdef debug
-        cout<<"lastos:"<<lastos<<endl;
+        cout<<"residueos:"<<residueos<<endl;
         #endif // debug
-        uint64_t residueos=lastos;
         uint64_t gapsum=0;
         #ifdef debug
         pause();
@@ -1562,145 +7344,30 @@ int main(int argc, char* argv[]) {
         //do the reconstructing
         lastos=0;
         lastlen=0;
-        std::ofstream recfile(reconfile_name, std::ios::out | std::ios::binary | std::ios::trunc);
         //write the gap before the stream(if the is one), then do the compression using the parameters from the ATZ file
         //then modify the compressed data according to the ATZ file(if necessary)
         for(j=0;j<streamOffsetList.size();j++){
             if ((lastos+lastlen)==streamOffsetList[j].offset){//no gap before the stream
                 #ifdef debug
                 cout<<"no gap before stream #"<<j<<endl;
-                cout<<"reconstructing stream #"<<j<<endl;
                 #endif // debug
-                //a buffer needs to be created to hold the compressed data
-                unsigned char* compBuffer= new unsigned char[streamOffsetList[j].streamLength+32768];
-                {
-                    //do compression
-                    #ifdef debug
-                    cout<<"   compressing"<<endl;
-                    #endif // debug
-                    strm.zalloc = Z_NULL;
-                    strm.zfree = Z_NULL;
-                    strm.opaque = Z_NULL;
-                    strm.next_in=streamOffsetList[j].atzInfos;
-                    strm.avail_in=streamOffsetList[j].inflatedLength;
-                    //initialize the stream for compression and check for error
-                    ret=deflateInit2(&strm, streamOffsetList[j].clevel, Z_DEFLATED, streamOffsetList[j].window, streamOffsetList[j].memlvl, Z_DEFAULT_STRATEGY);
-                    if (ret != Z_OK)
-                    {
-                        cout<<"deflateInit() failed with exit code:"<<ret<<endl;
-                        pause();
-                        abort();
-                    }
-                    strm.next_out=compBuffer;
-                    strm.avail_out=streamOffsetList[j].streamLength+32768;
-                    ret=deflate(&strm, Z_FINISH);//try to do the actual decompression in one pass
-                    //check the return value
-                    switch (ret)
-                    {
-                        case Z_STREAM_END://decompression was succesful
-                        {
-                            break;
-                        }
-                        default://shit hit the fan, should never happen normally
-                        {
-                            cout<<"deflate() failed with exit code:"<<ret<<endl;
-                            pause();
-                            abort();
-                        }
-                    }
-                    //deallocate the zlib stream, check for errors
-                    ret=deflateEnd(&strm);
-                    if (ret!=Z_OK)
-                    {
-                        cout<<"deflateEnd() failed with exit code:"<<ret<<endl;//should never happen normally
-                        pause();
-                        return ret;
-                    }
-                }
-                //do stream modification if needed
-                if (streamOffsetList[j].firstDiffByte>=0){
-                    #ifdef debug
-                    cout<<"   modifying "<<streamOffsetList[j].diffByteOffsets.size()<<" bytes"<<endl;
-                    #endif // debug
-                    uint64_t db=streamOffsetList[j].diffByteOffsets.size();
-                    uint64_t sum=0;
-                    for(i=0;i<db;i++){
-                        compBuffer[streamOffsetList[j].firstDiffByte+streamOffsetList[j].diffByteOffsets[i]+sum]=streamOffsetList[j].diffByteVal[i];
-                        sum=sum+streamOffsetList[j].diffByteOffsets[i];
-                    }
-                }
-                recfile.write(reinterpret_cast<char*>(compBuffer), streamOffsetList[j].streamLength);
-                delete [] compBuffer;
             }else{
                 #ifdef debug
                 cout<<"gap of "<<(streamOffsetList[j].offset-(lastos+lastlen))<<" bytes before stream #"<<j<<endl;
                 #endif // debug
-                recfile.write(reinterpret_cast<char*>(atzBuffer+residueos+gapsum), (streamOffsetList[j].offset-(lastos+lastlen)));
+                recout->write(reinterpret_cast<char*>(atzBuffer+residueos+gapsum), (streamOffsetList[j].offset-(lastos+lastlen)));
                 gapsum=gapsum+(streamOffsetList[j].offset-(lastos+lastlen));
-                #ifdef debug
-                cout<<"reconstructing stream #"<<j<<endl;
-                #endif // debug
-                //a buffer needs to be created to hold the compressed data
-                unsigned char* compBuffer= new unsigned char[streamOffsetList[j].streamLength+32768];
-                {
-                    //do compression
-                    #ifdef debug
-                    cout<<"   compressing"<<endl;
-                    #endif // debug
-                    strm.zalloc = Z_NULL;
-                    strm.zfree = Z_NULL;
-                    strm.opaque = Z_NULL;
-                    strm.next_in=streamOffsetList[j].atzInfos;
-                    strm.avail_in=streamOffsetList[j].inflatedLength;
-                    //initialize the stream for compression and check for error
-                    ret=deflateInit2(&strm, streamOffsetList[j].clevel, Z_DEFLATED, streamOffsetList[j].window, streamOffsetList[j].memlvl, Z_DEFAULT_STRATEGY);
-                    if (ret != Z_OK)
-                    {
-                        cout<<"deflateInit() failed with exit code:"<<ret<<endl;
-                        pause();
-                        abort();
-                    }
-                    strm.next_out=compBuffer;
-                    strm.avail_out=streamOffsetList[j].streamLength+32768;
-                    ret=deflate(&strm, Z_FINISH);//try to do the actual decompression in one pass
-                    //check the return value
-                    switch (ret)
-                    {
-                        case Z_STREAM_END://decompression was succesful
-                        {
-                            break;
-                        }
-                        default://shit hit the fan, should never happen normally
-                        {
-                            cout<<"deflate() failed with exit code:"<<ret<<endl;
-                            pause();
-                            abort();
-                        }
-                    }
-                    //deallocate the zlib stream, check for errors
-                    ret=deflateEnd(&strm);
-                    if (ret!=Z_OK)
-                    {
-                        cout<<"deflateEnd() failed with exit code:"<<ret<<endl;//should never happen normally
-                        pause();
-                        return ret;
-                    }
-                }
-                //do stream modification if needed
-                if (streamOffsetList[j].firstDiffByte>=0){
-                    #ifdef debug
-                    cout<<"   modifying "<<streamOffsetList[j].diffByteOffsets.size()<<" bytes"<<endl;
-                    #endif // debug
-                    uint64_t db=streamOffsetList[j].diffByteOffsets.size();
-                    uint64_t sum=0;
-                    for(i=0;i<db;i++){
-                        compBuffer[streamOffsetList[j].firstDiffByte+streamOffsetList[j].diffByteOffsets[i]+sum]=streamOffsetList[j].diffByteVal[i];
-                        sum=sum+streamOffsetList[j].diffByteOffsets[i];
-                    }
-                }
-                recfile.write(reinterpret_cast<char*>(compBuffer), streamOffsetList[j].streamLength);
-                delete [] compBuffer;
             }
+            #ifdef debug
+            cout<<"reconstructing stream #"<<j<<endl;
+            #endif // debug
+            //a buffer needs to be created to hold the compressed data
+            unsigned char* compBuffer= new unsigned char[streamOffsetList[j].streamLength+32768];
+            std::vector<unsigned char> unpacked;
+            unpackNested(streamOffsetList[j], unpacked);//nested payloads are rebuilt innermost first, in memory
+            rebuildStream(streamOffsetList[j], compBuffer);
+            recout->write(reinterpret_cast<char*>(compBuffer), streamOffsetList[j].streamLength);
+            delete [] compBuffer;
             lastos=streamOffsetList[j].offset;
             lastlen=streamOffsetList[j].streamLength;
         }
@@ -1708,22 +7375,25 @@ int main(int argc, char* argv[]) {
             #ifdef debug
             cout<<"copying "<<(origlen-(lastos+lastlen))<<" bytes to the end of the file"<<endl;
             #endif // debug
-            recfile.write(reinterpret_cast<char*>(atzBuffer+residueos+gapsum), (origlen-(lastos+lastlen)));
+            recout->write(reinterpret_cast<char*>(atzBuffer+residueos+gapsum), (origlen-(lastos+lastlen)));
         }
-        recfile.close();
     }else{//if there are no recompressed streams
         #ifdef debug
         cout<<"no recompressed streams in the ATZ file, copying "<<origlen<<" bytes"<<endl;
         #endif // debug
-        std::ofstream recfile(reconfile_name, std::ios::out | std::ios::binary | std::ios::trunc);
-        recfile.write(reinterpret_cast<char*>(atzBuffer+28), origlen);
-        recfile.close();
+        recout->write(reinterpret_cast<char*>(atzBuffer+residueos), origlen);
     }
 
+    recout->flush();
+    if (!*recout){
+        cout<<"error: writing the reconstructed file failed"<<endl;
+        pause();
+        abort();
+    }
+    recfile.close();
     #ifdef debug
     pause();
     #endif // debug
-    delete [] atzBuffer;
     /*delete [] infile_name;
     delete [] atzfile_name;
     delete [] reconfile_name;*/